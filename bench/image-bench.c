@@ -0,0 +1,309 @@
+/*
+ * Wallpaper decode benchmark.
+ *
+ * Synthesises a noisy photographic-sized image, writes it out in every format
+ * the loader was built with and times the old cairo PNG path against
+ * image_decode_file(). One JSON object per case is printed on stdout.
+ *
+ * usage: image-bench [width height [iterations [hint_width hint_height]]]
+ */
+#include "image.h"
+#include <cairo.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef HAVE_JPEG
+#include <jpeglib.h>
+#endif
+#ifdef HAVE_WEBP
+#include <webp/encode.h>
+#endif
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static cairo_surface_t *synthesise(int width, int height) {
+	cairo_surface_t *surface =
+	    cairo_image_surface_create(CAIRO_FORMAT_RGB24, width, height);
+	cairo_surface_flush(surface);
+	uint8_t *data = cairo_image_surface_get_data(surface);
+	int stride = cairo_image_surface_get_stride(surface);
+	uint32_t seed = 0x12345678;
+	for (int y = 0; y < height; y++) {
+		uint32_t *row = (uint32_t *)(data + (size_t)y * stride);
+		for (int x = 0; x < width; x++) {
+			// smooth gradients plus grain, roughly like a photo
+			seed = seed * 1664525u + 1013904223u;
+			int noise = (seed >> 27) - 16;
+			int r = x * 255 / width + noise;
+			int g = y * 255 / height + noise;
+			int b = ((x + y) * 127 / (width + height)) + 64 + noise;
+			r = r < 0 ? 0 : r > 255 ? 255 : r;
+			g = g < 0 ? 0 : g > 255 ? 255 : g;
+			b = b < 0 ? 0 : b > 255 ? 255 : b;
+			row[x] = 0xff000000u | r << 16 | g << 8 | b;
+		}
+	}
+	cairo_surface_mark_dirty(surface);
+	return surface;
+}
+
+#ifdef HAVE_JPEG
+static int write_jpeg(cairo_surface_t *surface, const char *path) {
+	FILE *file = fopen(path, "wb");
+	if (!file) {
+		return -1;
+	}
+	// plain RGB rows, libjpeg without the turbo extensions takes those
+	uint8_t *rgb = malloc((size_t)cairo_image_surface_get_width(surface) * 3);
+	if (!rgb) {
+		fclose(file);
+		return -1;
+	}
+	struct jpeg_compress_struct cinfo;
+	struct jpeg_error_mgr jerr;
+	cinfo.err = jpeg_std_error(&jerr);
+	jpeg_create_compress(&cinfo);
+	jpeg_stdio_dest(&cinfo, file);
+	cinfo.image_width = cairo_image_surface_get_width(surface);
+	cinfo.image_height = cairo_image_surface_get_height(surface);
+	cinfo.input_components = 3;
+	cinfo.in_color_space = JCS_RGB;
+	jpeg_set_defaults(&cinfo);
+	jpeg_set_quality(&cinfo, 90, TRUE);
+	jpeg_start_compress(&cinfo, TRUE);
+	uint8_t *data = cairo_image_surface_get_data(surface);
+	int stride = cairo_image_surface_get_stride(surface);
+	while (cinfo.next_scanline < cinfo.image_height) {
+		const uint32_t *pixels =
+		    (uint32_t *)(data + (size_t)cinfo.next_scanline * stride);
+		for (JDIMENSION x = 0; x < cinfo.image_width; x++) {
+			rgb[x * 3] = pixels[x] >> 16;
+			rgb[x * 3 + 1] = pixels[x] >> 8;
+			rgb[x * 3 + 2] = pixels[x];
+		}
+		JSAMPROW row = rgb;
+		jpeg_write_scanlines(&cinfo, &row, 1);
+	}
+	jpeg_finish_compress(&cinfo);
+	jpeg_destroy_compress(&cinfo);
+	free(rgb);
+	fclose(file);
+	return 0;
+}
+#endif
+
+static void put_u32be(uint8_t *out, uint32_t value) {
+	out[0] = value >> 24;
+	out[1] = value >> 16;
+	out[2] = value >> 8;
+	out[3] = value;
+}
+
+// The reference QOI encoder, RGB only since the source has no alpha.
+static int write_qoi(cairo_surface_t *surface, const char *path) {
+	int width = cairo_image_surface_get_width(surface);
+	int height = cairo_image_surface_get_height(surface);
+	int stride = cairo_image_surface_get_stride(surface);
+	const uint8_t *data = cairo_image_surface_get_data(surface);
+	uint8_t *out = malloc(14 + (size_t)width * height * 4 + 8);
+	if (!out) {
+		return -1;
+	}
+	size_t n = 0;
+	memcpy(out, "qoif", 4);
+	put_u32be(out + 4, width);
+	put_u32be(out + 8, height);
+	out[12] = 3; // channels
+	out[13] = 0; // sRGB
+	n = 14;
+
+	uint8_t index[64][4] = {{0}};
+	uint8_t prev[4] = {0, 0, 0, 255};
+	int run = 0;
+	for (int y = 0; y < height; y++) {
+		const uint32_t *row = (uint32_t *)(data + (size_t)y * stride);
+		for (int x = 0; x < width; x++) {
+			uint8_t px[4] = {row[x] >> 16, row[x] >> 8, row[x], 255};
+			if (memcmp(px, prev, 4) == 0) {
+				if (++run == 62) {
+					out[n++] = 0xc0 | (run - 1);
+					run = 0;
+				}
+				continue;
+			}
+			if (run) {
+				out[n++] = 0xc0 | (run - 1);
+				run = 0;
+			}
+			int hash =
+			    (px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64;
+			if (memcmp(index[hash], px, 4) == 0) {
+				out[n++] = hash;
+			} else {
+				memcpy(index[hash], px, 4);
+				int8_t vr = px[0] - prev[0];
+				int8_t vg = px[1] - prev[1];
+				int8_t vb = px[2] - prev[2];
+				int8_t vg_r = vr - vg;
+				int8_t vg_b = vb - vg;
+				if (vr > -3 && vr < 2 && vg > -3 && vg < 2 &&
+				    vb > -3 && vb < 2) {
+					out[n++] = 0x40 | (vr + 2) << 4 |
+						   (vg + 2) << 2 | (vb + 2);
+				} else if (vg_r > -9 && vg_r < 8 && vg > -33 &&
+					   vg < 32 && vg_b > -9 && vg_b < 8) {
+					out[n++] = 0x80 | (vg + 32);
+					out[n++] = (vg_r + 8) << 4 | (vg_b + 8);
+				} else {
+					out[n++] = 0xfe;
+					memcpy(out + n, px, 3);
+					n += 3;
+				}
+			}
+			memcpy(prev, px, 4);
+		}
+	}
+	if (run) {
+		out[n++] = 0xc0 | (run - 1);
+	}
+	static const uint8_t padding[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+	memcpy(out + n, padding, sizeof(padding));
+	n += sizeof(padding);
+
+	FILE *file = fopen(path, "wb");
+	int ret = file && fwrite(out, 1, n, file) == n ? 0 : -1;
+	if (file) {
+		fclose(file);
+	}
+	free(out);
+	return ret;
+}
+
+#ifdef HAVE_WEBP
+static int write_webp(cairo_surface_t *surface, const char *path) {
+	uint8_t *out = NULL;
+	size_t size = WebPEncodeBGRA(cairo_image_surface_get_data(surface),
+				     cairo_image_surface_get_width(surface),
+				     cairo_image_surface_get_height(surface),
+				     cairo_image_surface_get_stride(surface),
+				     90, &out);
+	FILE *file = fopen(path, "wb");
+	if (!size || !file || fwrite(out, 1, size, file) != size) {
+		WebPFree(out);
+		if (file) {
+			fclose(file);
+		}
+		return -1;
+	}
+	WebPFree(out);
+	fclose(file);
+	return 0;
+}
+#endif
+
+struct bench_case {
+	const char *name;
+	const char *path;
+	uint32_t hint_width;
+	uint32_t hint_height;
+	bool cairo_png; // the pre-loader code path
+};
+
+static uint64_t run_case(const struct bench_case *c, int iterations,
+			 int *out_width, int *out_height) {
+	uint64_t best = UINT64_MAX;
+	for (int i = 0; i < iterations; i++) {
+		uint64_t start = now_ns();
+		cairo_surface_t *image =
+		    c->cairo_png
+			? cairo_image_surface_create_from_png(c->path)
+			: image_decode_file(c->path, c->hint_width,
+					    c->hint_height);
+		uint64_t elapsed = now_ns() - start;
+		if (!image || cairo_surface_status(image)) {
+			cairo_surface_destroy(image);
+			return 0;
+		}
+		*out_width = cairo_image_surface_get_width(image);
+		*out_height = cairo_image_surface_get_height(image);
+		cairo_surface_destroy(image);
+		if (elapsed < best) {
+			best = elapsed;
+		}
+	}
+	return best;
+}
+
+int main(int argc, char **argv) {
+	int width = argc > 2 ? atoi(argv[1]) : 6000;
+	int height = argc > 2 ? atoi(argv[2]) : 4000;
+	int iterations = argc > 3 ? atoi(argv[3]) : 5;
+	uint32_t hint_width = argc > 5 ? atoi(argv[4]) : 1920;
+	uint32_t hint_height = argc > 5 ? atoi(argv[5]) : 1080;
+
+	char dir[] = "/tmp/locker-image-bench-XXXXXX";
+	if (!mkdtemp(dir)) {
+		perror("mkdtemp");
+		return 1;
+	}
+	char png[64], qoi[64], jpeg[64], webp[64];
+	snprintf(png, sizeof(png), "%s/image.png", dir);
+	snprintf(qoi, sizeof(qoi), "%s/image.qoi", dir);
+	snprintf(jpeg, sizeof(jpeg), "%s/image.jpg", dir);
+	snprintf(webp, sizeof(webp), "%s/image.webp", dir);
+
+	cairo_surface_t *source = synthesise(width, height);
+	cairo_surface_write_to_png(source, png);
+
+	struct bench_case cases[8];
+	size_t count = 0;
+	cases[count++] = (struct bench_case){"png-cairo-stdio", png, 0, 0, true};
+	cases[count++] = (struct bench_case){"png-mmap", png, 0, 0, false};
+	if (write_qoi(source, qoi) == 0) {
+		cases[count++] = (struct bench_case){"qoi", qoi, 0, 0, false};
+	}
+#ifdef HAVE_JPEG
+	if (write_jpeg(source, jpeg) == 0) {
+		cases[count++] =
+		    (struct bench_case){"jpeg-full", jpeg, 0, 0, false};
+		cases[count++] = (struct bench_case){
+		    "jpeg-dct-scaled", jpeg, hint_width, hint_height, false};
+	}
+#endif
+#ifdef HAVE_WEBP
+	if (write_webp(source, webp) == 0) {
+		cases[count++] = (struct bench_case){
+		    "webp-scaled", webp, hint_width, hint_height, false};
+	}
+#endif
+	cairo_surface_destroy(source);
+
+	uint64_t baseline = 0;
+	for (size_t i = 0; i < count; i++) {
+		int out_width = 0, out_height = 0;
+		uint64_t ns = run_case(&cases[i], iterations, &out_width,
+				       &out_height);
+		if (i == 0) {
+			baseline = ns;
+		}
+		printf("{\"case\":\"%s\",\"source\":\"%dx%d\",\"decoded\":\"%"
+		       "dx%d\",\"ns\":%llu,\"speedup\":%.2f}\n",
+		       cases[i].name, width, height, out_width, out_height,
+		       (unsigned long long)ns,
+		       ns ? (double)baseline / ns : 0.0);
+	}
+
+	unlink(png);
+	unlink(qoi);
+	unlink(jpeg);
+	unlink(webp);
+	rmdir(dir);
+	return 0;
+}
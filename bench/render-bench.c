@@ -0,0 +1,222 @@
+/*
+ * Headless render benchmark.
+ *
+ * Drives the renderer straight into malloc'd ARGB32 memory at common output
+ * sizes with a photographic-sized wallpaper. For every case the best time of
+ * a number of frames is reported, along with the destination bytes a frame
+ * writes. One JSON object per case is printed on stdout.
+ *
+ * The feedback ring animations do not depend on the output size, they are
+ * measured once per buffer scale over a second of animation time.
+ *
+ * usage: render-bench [iterations [wallpaper_width wallpaper_height]]
+ */
+#include "render.h"
+#include <cairo.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+struct resolution {
+	const char *name;
+	uint32_t width;
+	uint32_t height;
+};
+
+static const struct resolution resolutions[] = {
+    {"1080p", 1920, 1080}, {"1440p", 2560, 1440}, {"4k", 3840, 2160},
+    {"5k", 5120, 2880},	   {"8k", 7680, 4320},
+};
+
+static const struct {
+	const char *name;
+	auth_state_t state;
+} states[] = {
+    {"locked", AUTH_STATE_LOCKED},
+    {"authenticating", AUTH_STATE_AUTHENTICATING},
+    {"success", AUTH_STATE_SUCCESS},
+    {"typing", AUTH_STATE_TYPING},
+};
+
+#define STATE_COUNT (sizeof(states) / sizeof(states[0]))
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static cairo_surface_t *synthesise(int width, int height) {
+	cairo_surface_t *surface =
+	    cairo_image_surface_create(CAIRO_FORMAT_RGB24, width, height);
+	cairo_surface_flush(surface);
+	uint8_t *data = cairo_image_surface_get_data(surface);
+	int stride = cairo_image_surface_get_stride(surface);
+	for (int y = 0; y < height; y++) {
+		uint32_t *row = (uint32_t *)(data + (size_t)y * stride);
+		for (int x = 0; x < width; x++) {
+			uint32_t r = x * 255 / width, g = y * 255 / height;
+			row[x] = 0xff000000u | r << 16 | g << 8 | (r ^ g);
+		}
+	}
+	cairo_surface_mark_dirty(surface);
+	return surface;
+}
+
+static void report(const char *name, const struct resolution *res,
+		   uint64_t ns, uint64_t bytes) {
+	printf("{\"case\":\"%s\",\"resolution\":\"%s\",\"size\":\"%ux%u\","
+	       "\"ns_per_frame\":%llu,\"bytes_touched\":%llu}\n",
+	       name, res->name, res->width, res->height,
+	       (unsigned long long)ns, (unsigned long long)bytes);
+}
+
+// Cycles through the states like a typing session would.
+static void bench_icons(const char *name, const struct render_params *params,
+			const struct resolution *res, int iterations,
+			uint8_t *pixels) {
+	uint32_t stride = res->width * 4;
+	uint64_t best = UINT64_MAX;
+	uint64_t icon_bytes = 0;
+	for (int i = 0; i < iterations * (int)STATE_COUNT; i++) {
+		uint64_t start = now_ns();
+		struct render_rect damage =
+		    render_icon(params, states[i % STATE_COUNT].state,
+				res->width, res->height, stride, 1, pixels);
+		uint64_t elapsed = now_ns() - start;
+		best = elapsed < best ? elapsed : best;
+		icon_bytes = (uint64_t)damage.width * damage.height * 4;
+	}
+	report(name, res, best, icon_bytes);
+}
+
+static void bench_resolution(const struct render_params *params,
+			     const struct resolution *res, int iterations) {
+	uint32_t stride = res->width * 4;
+	uint64_t frame_bytes = (uint64_t)stride * res->height;
+	uint8_t *pixels = malloc(frame_bytes);
+	if (!pixels) {
+		return;
+	}
+	cairo_surface_t *surface = cairo_image_surface_create_for_data(
+	    pixels, CAIRO_FORMAT_ARGB32, res->width, res->height, stride);
+
+	uint64_t best = UINT64_MAX;
+	for (int i = 0; i < iterations; i++) {
+		cairo_t *cr = cairo_create(surface);
+		uint64_t start = now_ns();
+		render_background(cr, params, res->width, res->height);
+		cairo_surface_flush(surface);
+		uint64_t elapsed = now_ns() - start;
+		cairo_destroy(cr);
+		best = elapsed < best ? elapsed : best;
+	}
+	report("background", res, best, frame_bytes);
+
+	// each of these is a whole-surface render_frame, the full repaint the
+	// icon-only case below is compared against
+	for (size_t s = 0; s < STATE_COUNT; s++) {
+		best = UINT64_MAX;
+		for (int i = 0; i < iterations; i++) {
+			uint64_t start = now_ns();
+			render_frame(params, states[s].state, res->width,
+				     res->height, stride, 1, pixels);
+			uint64_t elapsed = now_ns() - start;
+			best = elapsed < best ? elapsed : best;
+		}
+		char name[64];
+		snprintf(name, sizeof(name), "redraw-%s", states[s].name);
+		report(name, res, best, frame_bytes);
+	}
+
+	// the locker repaints icons from a backdrop made when the frame was
+	struct render_params with_backdrop = *params;
+	struct render_backdrop *backdrop =
+	    render_backdrop_create(params, res->width, res->height, 1);
+	if (backdrop) {
+		with_backdrop.backdrop = backdrop;
+		bench_icons("icon-only", &with_backdrop, res, iterations,
+			    pixels);
+		render_backdrop_destroy(backdrop);
+	}
+	// the fallback that clips and rescales the wallpaper every time
+	bench_icons("icon-only-wallpaper", params, res, iterations, pixels);
+
+	cairo_surface_destroy(surface);
+	free(pixels);
+}
+
+static const struct {
+	const char *name;
+	enum anim_kind kind;
+	double duration; // seconds of animation to sample
+} anims[] = {
+    {"anim-typing", ANIM_TYPING, 0.3},
+    {"anim-spinner", ANIM_SPINNER, 1.0},
+    {"anim-shake", ANIM_SHAKE, 0.45},
+};
+
+static void bench_animations(const struct render_params *params,
+			     int iterations) {
+	for (uint32_t scale = 1; scale <= 2; scale++) {
+		uint32_t size = render_anim_size(params) * scale;
+		uint32_t stride = size * 4;
+		uint8_t *pixels = malloc((size_t)stride * size);
+		if (!pixels) {
+			return;
+		}
+		for (size_t a = 0; a < sizeof(anims) / sizeof(anims[0]); a++) {
+			// a frame every 1/144 s, like a high refresh output
+			int frames = anims[a].duration * 144;
+			uint64_t total = 0;
+			for (int i = 0; i < iterations; i++) {
+				uint64_t start = now_ns();
+				for (int f = 0; f < frames; f++) {
+					struct render_anim anim = {
+					    .kind = anims[a].kind,
+					    .t = f / 144.0,
+					    .angle = 0.25,
+					};
+					render_anim(params, &anim, stride,
+						    scale, pixels);
+				}
+				total += now_ns() - start;
+			}
+			printf("{\"case\":\"%s\",\"scale\":%u,\"size\":\"%ux%u\","
+			       "\"ns_per_frame\":%llu,\"bytes_touched\":%llu}\n",
+			       anims[a].name, scale, size, size,
+			       (unsigned long long)(total /
+						    ((uint64_t)iterations *
+						     frames)),
+			       (unsigned long long)stride * size);
+		}
+		free(pixels);
+	}
+}
+
+int main(int argc, char **argv) {
+	int iterations = argc > 1 ? atoi(argv[1]) : 10;
+	int wallpaper_width = argc > 3 ? atoi(argv[2]) : 6000;
+	int wallpaper_height = argc > 3 ? atoi(argv[3]) : 4000;
+
+	struct render_params params = {
+	    .wallpaper = synthesise(wallpaper_width, wallpaper_height),
+	    .filter = CAIRO_FILTER_GOOD,
+	    .icon_font_family = "JetBrainsMono Nerd Font",
+	    .icon_size = 50,
+	};
+	params.icon_font = cairo_toy_font_face_create(
+	    params.icon_font_family, CAIRO_FONT_SLANT_NORMAL,
+	    CAIRO_FONT_WEIGHT_BOLD);
+
+	for (size_t i = 0; i < sizeof(resolutions) / sizeof(resolutions[0]);
+	     i++) {
+		bench_resolution(&params, &resolutions[i], iterations);
+	}
+	bench_animations(&params, iterations);
+
+	cairo_font_face_destroy(params.icon_font);
+	cairo_surface_destroy(params.wallpaper);
+	return 0;
+}
@@ -0,0 +1,36 @@
+#ifndef HEADER_ANIM
+#define HEADER_ANIM
+#include "overlay.h"
+#include <stdint.h>
+
+struct prog_state;
+struct wl_callback;
+
+// Feedback drawn as a ring around the icon.
+enum anim_kind {
+	ANIM_NONE,
+	ANIM_TYPING,  // a highlighted segment that fades out
+	ANIM_ERASE,   // the same in red, for backspace and escape
+	ANIM_SPINNER, // turns until PAM has answered
+	ANIM_SHAKE,   // the password was wrong
+};
+
+// The animation currently playing, shared by every output.
+struct anim {
+	enum anim_kind kind;
+	uint64_t start_ns;
+	double angle; // where the typing segment starts, in turns
+};
+
+// The ring is drawn on an overlay over the icon. Frames are paced by
+// wl_surface.frame and no callback is requested once nothing moves.
+struct anim_output {
+	struct overlay overlay;
+	struct wl_callback *frame;
+};
+
+// Starts kind on every output, replacing whatever was playing. ANIM_NONE
+// clears the ring.
+void anim_start(struct prog_state *state, enum anim_kind kind);
+void anim_output_finish(struct anim_output *anim);
+#endif
@@ -3,4 +3,22 @@
 #include "state.h"
 int init_pam(struct prog_state *state);
 int authenticate_user(struct prog_state *state);
+// Runs authenticate_user() on a worker and calls done with its result from
+// the event loop. Returns -1 if the worker could not be started.
+int auth_start(struct prog_state *state,
+	       void (*done)(struct prog_state *state, int result));
+// Waits for a password check still running and ends PAM. Called on exit
+// before anything the worker uses is torn down.
+void auth_finish(struct prog_state *state);
+// Starts config.concurrent_pam in a child, done is called once it succeeds.
+// A failed attempt is started again unless it failed right away. Does
+// nothing without a configured service.
+int auth_concurrent_start(struct prog_state *state,
+			  void (*done)(struct prog_state *state, int result));
+// Kills the child, for when the password won or the locker exits.
+void auth_concurrent_stop(struct prog_state *state);
+// The child is the locker started again with AUTH_HELPER_ARG first, main()
+// hands those runs to auth_helper_main() before doing anything else.
+#define AUTH_HELPER_ARG "--concurrent-pam-helper"
+int auth_helper_main(int argc, char **argv);
 #endif
@@ -0,0 +1,31 @@
+#ifndef HEADER_CLOCKFACE
+#define HEADER_CLOCKFACE
+#include <stdbool.h>
+#include <stdint.h>
+
+struct output_state;
+struct prog_state;
+struct render_clock;
+
+// The time and date above the icon. Each output shows them on an overlay,
+// so a tick uploads a box of a few hundred pixels instead of a frame.
+struct clockface {
+	int timer_fd; // CLOCK_REALTIME, fires on the minute or second
+	int tz_fd;    // inotify on the time zone link, -1 if unavailable
+	struct render_clock *render; // fonts and shaped text, NULL until started
+	char time[64]; // what the overlays show
+	char date[64];
+	uint32_t width; // of the box, in logical pixels, fits any time
+	uint32_t height;
+};
+
+// Shows the clock on every output and starts ticking. Does nothing unless
+// the clock is enabled.
+void clockface_start(struct prog_state *state);
+// Draws the current text on one output, for outputs configured after start.
+void clockface_draw(struct output_state *output);
+// Stops the timer while the outputs are off, resume redraws right away.
+void clockface_suspend(struct prog_state *state);
+void clockface_resume(struct prog_state *state);
+void clockface_finish(struct prog_state *state);
+#endif
@@ -0,0 +1,67 @@
+#ifndef HEADER_CONFIG
+#define HEADER_CONFIG
+#include "log.h"
+#include <cairo.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum {
+	PROFILE_LOW_POWER,
+	PROFILE_BALANCED,
+	PROFILE_QUALITY,
+} perf_profile_t;
+
+// Everything the user can tune. Filled once by config_load() from the
+// profile defaults, then the config file, then the command line; nothing
+// is parsed after startup.
+struct config {
+	perf_profile_t profile;
+
+	char *wallpaper; // already expanded, NULL paints a plain background
+	char *icon_font;
+	uint32_t icon_size;
+
+	bool decay_enabled;
+	uint32_t decay_interval; // seconds
+
+	// wait for the seat to go idle instead of locking right away
+	uint32_t idle_timeout; // seconds, 0 locks immediately
+	uint32_t idle_warning; // seconds before the timeout to pre-render
+	// seconds without a key press on the lock screen before blanking it
+	uint32_t power_off_after; // 0 never blanks
+
+	// clock above the icon, formats are for strftime(3)
+	bool clock;
+	char *clock_format;
+	char *date_format; // NULL leaves the date out
+	bool clock_seconds; // tick every second instead of every minute
+
+	// PAM service checking the password
+	char *pam_service;
+	// read services from here instead of /etc/pam.d, NULL for the default
+	char *pam_confdir;
+	// PAM service tried alongside the password, NULL runs none
+	char *concurrent_pam;
+
+	// render strategies the profiles toggle
+	bool hidpi;	    // render at the output's scale
+	bool redraw_typing; // show the typing icon, costs a repaint per edit
+	bool animations;    // feedback ring around the icon
+	bool low_memory;    // free decoded images, trim under pressure
+	cairo_filter_t filter;
+	bool hud; // debug overlay with render stats
+	log_level_t log_level;
+
+	char *trace_file; // Chrome trace output, NULL disables tracing
+	char *input_trace_file; // redacted key events are recorded here
+	uint32_t profile_startup; // lock and unlock this many times, 0 is off
+	uint32_t loop_stats_interval; // seconds between loop reports, 0 is exit only
+	char *metrics_file;   // Prometheus textfile written at unlock
+	char *metrics_socket; // UNIX socket serving the same text
+};
+
+// Returns 0 on success, 1 when --help was handled and -1 on bad input.
+int config_load(struct config *config, int argc, char **argv);
+void config_finish(struct config *config);
+const char *config_profile_name(perf_profile_t profile);
+#endif
@@ -4,7 +4,19 @@
 #include <state.h>
 #include <stdint.h>
 
-void createBuffer(uint32_t width, uint32_t height, uint32_t stride,
-		  struct prog_state *state);
+int prepare_fonts(struct prog_state *state);
+// Starts decoding the wallpaper, sized for the outputs known so far.
+void load_wallpaper(struct prog_state *state);
+// Starts the decode once the lock is requested and every output sent its
+// modes, so it overlaps the compositor setting up the lock surfaces.
+void maybe_load_wallpaper(struct prog_state *state);
+// Frees the decoded wallpaper once every lock surface has its frame. Icon
+// changes are drawn from the buffers' backdrops, and the next full frame
+// (a new output, a power on) decodes it again.
+void release_wallpaper(struct prog_state *state);
+struct lock_buffer *createBuffer(uint32_t width, uint32_t height,
+				 uint32_t stride, uint32_t scale,
+				 struct prog_state *state);
+void destroyBuffer(struct lock_buffer *buffer);
 void change_icon_state(struct prog_state *client_state, auth_state_t state);
 #endif
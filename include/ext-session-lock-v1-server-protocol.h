@@ -0,0 +1,339 @@
+/* Generated by wayland-scanner 1.24.0 */
+
+#ifndef EXT_SESSION_LOCK_V1_SERVER_PROTOCOL_H
+#define EXT_SESSION_LOCK_V1_SERVER_PROTOCOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "wayland-server.h"
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+struct wl_client;
+struct wl_resource;
+
+/**
+ * @page page_ext_session_lock_v1 The ext_session_lock_v1 protocol
+ * secure session locking with arbitrary graphics
+ *
+ * @section page_ifaces_ext_session_lock_v1 Interfaces
+ * - @subpage page_iface_ext_session_lock_manager_v1 - used to lock the session
+ * - @subpage page_iface_ext_session_lock_v1 - manage lock state and create lock surfaces
+ * - @subpage page_iface_ext_session_lock_surface_v1 - a surface displayed while the session is locked
+ * @section page_copyright_ext_session_lock_v1 Copyright
+ * <pre>
+ *
+ * Copyright 2021 Isaac Freund
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ * </pre>
+ */
+struct ext_session_lock_manager_v1;
+struct ext_session_lock_surface_v1;
+struct ext_session_lock_v1;
+struct wl_output;
+struct wl_surface;
+
+#ifndef EXT_SESSION_LOCK_MANAGER_V1_INTERFACE
+#define EXT_SESSION_LOCK_MANAGER_V1_INTERFACE
+/**
+ * @page page_iface_ext_session_lock_manager_v1 ext_session_lock_manager_v1
+ * @section page_iface_ext_session_lock_manager_v1_desc Description
+ *
+ * This interface is used to request that the session be locked.
+ * @section page_iface_ext_session_lock_manager_v1_api API
+ * See @ref iface_ext_session_lock_manager_v1.
+ */
+/**
+ * @defgroup iface_ext_session_lock_manager_v1 The ext_session_lock_manager_v1 interface
+ *
+ * This interface is used to request that the session be locked.
+ */
+extern const struct wl_interface ext_session_lock_manager_v1_interface;
+#endif
+#ifndef EXT_SESSION_LOCK_V1_INTERFACE
+#define EXT_SESSION_LOCK_V1_INTERFACE
+/**
+ * @page page_iface_ext_session_lock_v1 ext_session_lock_v1
+ * @section page_iface_ext_session_lock_v1_desc Description
+ *
+ * In response to the creation of this object the compositor must send
+ * either the locked or finished event.
+ * @section page_iface_ext_session_lock_v1_api API
+ * See @ref iface_ext_session_lock_v1.
+ */
+/**
+ * @defgroup iface_ext_session_lock_v1 The ext_session_lock_v1 interface
+ *
+ * In response to the creation of this object the compositor must send
+ * either the locked or finished event.
+ */
+extern const struct wl_interface ext_session_lock_v1_interface;
+#endif
+#ifndef EXT_SESSION_LOCK_SURFACE_V1_INTERFACE
+#define EXT_SESSION_LOCK_SURFACE_V1_INTERFACE
+/**
+ * @page page_iface_ext_session_lock_surface_v1 ext_session_lock_surface_v1
+ * @section page_iface_ext_session_lock_surface_v1_desc Description
+ *
+ * The client may use lock surfaces to display a screensaver, render a
+ * dialog to enter a password and unlock the session, or however else it
+ * sees fit.
+ * @section page_iface_ext_session_lock_surface_v1_api API
+ * See @ref iface_ext_session_lock_surface_v1.
+ */
+/**
+ * @defgroup iface_ext_session_lock_surface_v1 The ext_session_lock_surface_v1 interface
+ *
+ * The client may use lock surfaces to display a screensaver, render a
+ * dialog to enter a password and unlock the session, or however else it
+ * sees fit.
+ */
+extern const struct wl_interface ext_session_lock_surface_v1_interface;
+#endif
+
+/**
+ * @ingroup iface_ext_session_lock_manager_v1
+ * @struct ext_session_lock_manager_v1_interface
+ */
+struct ext_session_lock_manager_v1_interface {
+	/**
+	 * destroy the session lock manager object
+	 *
+	 * This informs the compositor that the session lock manager
+	 * object will no longer be used. Existing objects created through
+	 * this interface remain valid.
+	 */
+	void (*destroy)(struct wl_client *client,
+			struct wl_resource *resource);
+	/**
+	 * attempt to lock the session
+	 *
+	 * This request creates a session lock and asks the compositor to
+	 * lock the session. The compositor will send either the
+	 * ext_session_lock_v1.locked or ext_session_lock_v1.finished event
+	 * on the created object in response to this request.
+	 */
+	void (*lock)(struct wl_client *client,
+		     struct wl_resource *resource,
+		     uint32_t id);
+};
+
+
+/**
+ * @ingroup iface_ext_session_lock_manager_v1
+ */
+#define EXT_SESSION_LOCK_MANAGER_V1_DESTROY_SINCE_VERSION 1
+/**
+ * @ingroup iface_ext_session_lock_manager_v1
+ */
+#define EXT_SESSION_LOCK_MANAGER_V1_LOCK_SINCE_VERSION 1
+
+#ifndef EXT_SESSION_LOCK_V1_ERROR_ENUM
+#define EXT_SESSION_LOCK_V1_ERROR_ENUM
+enum ext_session_lock_v1_error {
+	/**
+	 * attempted to destroy session lock while locked
+	 */
+	EXT_SESSION_LOCK_V1_ERROR_INVALID_DESTROY = 0,
+	/**
+	 * unlock requested but locked event was never sent
+	 */
+	EXT_SESSION_LOCK_V1_ERROR_INVALID_UNLOCK = 1,
+	/**
+	 * given wl_surface already has a role
+	 */
+	EXT_SESSION_LOCK_V1_ERROR_ROLE = 2,
+	/**
+	 * given output already has a lock surface
+	 */
+	EXT_SESSION_LOCK_V1_ERROR_DUPLICATE_OUTPUT = 3,
+	/**
+	 * given wl_surface has a buffer attached or committed
+	 */
+	EXT_SESSION_LOCK_V1_ERROR_ALREADY_CONSTRUCTED = 4,
+};
+#endif /* EXT_SESSION_LOCK_V1_ERROR_ENUM */
+
+/**
+ * @ingroup iface_ext_session_lock_v1
+ * @struct ext_session_lock_v1_interface
+ */
+struct ext_session_lock_v1_interface {
+	/**
+	 * destroy the session lock
+	 *
+	 * This informs the compositor that the lock object will no
+	 * longer be used. Existing objects created through this interface
+	 * remain valid.
+	 *
+	 * After this request is made, lock surfaces created through this
+	 * object should be destroyed by the client as they will no longer
+	 * be used by the compositor.
+	 *
+	 * It is a protocol error to make this request if the locked event
+	 * was sent, the unlock_and_destroy request must be used instead.
+	 */
+	void (*destroy)(struct wl_client *client,
+			struct wl_resource *resource);
+	/**
+	 * create a lock surface for a given output
+	 *
+	 * The client is expected to create lock surfaces for all outputs
+	 * currently present and any new outputs as they are advertised.
+	 * These won't be displayed by the compositor unless the lock is
+	 * successful and the locked event is sent.
+	 */
+	void (*get_lock_surface)(struct wl_client *client,
+				 struct wl_resource *resource,
+				 uint32_t id,
+				 struct wl_resource *surface,
+				 struct wl_resource *output);
+	/**
+	 * unlock the session, destroying the object
+	 *
+	 * This request indicates that the session should be unlocked,
+	 * for example because the user has entered their password and it
+	 * has been verified by the client.
+	 *
+	 * This request also informs the compositor that the lock object
+	 * will no longer be used and should be destroyed.
+	 */
+	void (*unlock_and_destroy)(struct wl_client *client,
+				   struct wl_resource *resource);
+};
+
+#define EXT_SESSION_LOCK_V1_LOCKED 0
+#define EXT_SESSION_LOCK_V1_FINISHED 1
+
+/**
+ * @ingroup iface_ext_session_lock_v1
+ */
+#define EXT_SESSION_LOCK_V1_LOCKED_SINCE_VERSION 1
+/**
+ * @ingroup iface_ext_session_lock_v1
+ */
+#define EXT_SESSION_LOCK_V1_FINISHED_SINCE_VERSION 1
+
+/**
+ * @ingroup iface_ext_session_lock_v1
+ */
+#define EXT_SESSION_LOCK_V1_DESTROY_SINCE_VERSION 1
+/**
+ * @ingroup iface_ext_session_lock_v1
+ */
+#define EXT_SESSION_LOCK_V1_GET_LOCK_SURFACE_SINCE_VERSION 1
+/**
+ * @ingroup iface_ext_session_lock_v1
+ */
+#define EXT_SESSION_LOCK_V1_UNLOCK_AND_DESTROY_SINCE_VERSION 1
+
+/**
+ * @ingroup iface_ext_session_lock_v1
+ * Sends an locked event to the client owning the resource.
+ * @param resource_ The client's resource
+ */
+static inline void
+ext_session_lock_v1_send_locked(struct wl_resource *resource_)
+{
+	wl_resource_post_event(resource_, EXT_SESSION_LOCK_V1_LOCKED);
+}
+
+/**
+ * @ingroup iface_ext_session_lock_v1
+ * Sends an finished event to the client owning the resource.
+ * @param resource_ The client's resource
+ */
+static inline void
+ext_session_lock_v1_send_finished(struct wl_resource *resource_)
+{
+	wl_resource_post_event(resource_, EXT_SESSION_LOCK_V1_FINISHED);
+}
+
+/**
+ * @ingroup iface_ext_session_lock_surface_v1
+ * @struct ext_session_lock_surface_v1_interface
+ */
+struct ext_session_lock_surface_v1_interface {
+	/**
+	 * destroy the lock surface object
+	 *
+	 * This informs the compositor that the lock surface object will
+	 * no longer be used.
+	 *
+	 * It is recommended for a lock client to destroy lock surfaces if
+	 * their corresponding wl_output global is removed.
+	 *
+	 * If a lock surface on an active output is destroyed before the
+	 * ext_session_lock_v1.unlock_and_destroy event is sent, the
+	 * compositor must fall back to rendering a solid color.
+	 */
+	void (*destroy)(struct wl_client *client,
+			struct wl_resource *resource);
+	/**
+	 * ack a configure event
+	 *
+	 * When a configure event is received, if a client commits the
+	 * surface in response to the configure event, then the client must
+	 * make an ack_configure request sometime before the commit request,
+	 * passing along the serial of the configure event.
+	 * @param serial serial from the configure event
+	 */
+	void (*ack_configure)(struct wl_client *client,
+			      struct wl_resource *resource,
+			      uint32_t serial);
+};
+
+#define EXT_SESSION_LOCK_SURFACE_V1_CONFIGURE 0
+
+/**
+ * @ingroup iface_ext_session_lock_surface_v1
+ */
+#define EXT_SESSION_LOCK_SURFACE_V1_CONFIGURE_SINCE_VERSION 1
+
+/**
+ * @ingroup iface_ext_session_lock_surface_v1
+ */
+#define EXT_SESSION_LOCK_SURFACE_V1_DESTROY_SINCE_VERSION 1
+/**
+ * @ingroup iface_ext_session_lock_surface_v1
+ */
+#define EXT_SESSION_LOCK_SURFACE_V1_ACK_CONFIGURE_SINCE_VERSION 1
+
+/**
+ * @ingroup iface_ext_session_lock_surface_v1
+ * Sends an configure event to the client owning the resource.
+ * @param resource_ The client's resource
+ * @param serial serial for use in ack_configure
+ * @param width None
+ * @param height None
+ */
+static inline void
+ext_session_lock_surface_v1_send_configure(struct wl_resource *resource_, uint32_t serial, uint32_t width, uint32_t height)
+{
+	wl_resource_post_event(resource_, EXT_SESSION_LOCK_SURFACE_V1_CONFIGURE, serial, width, height);
+}
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef HEADER_IMAGE
+#define HEADER_IMAGE
+#include <cairo.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Decodes a wallpaper on a worker thread so the Wayland handshake can run in
+// the meantime. The hint is the largest size the image will be painted at;
+// decoders that can scale while decoding (JPEG DCT scaling, WebP) stop at the
+// smallest size that still covers it. A zero hint decodes at full size.
+struct image_loader {
+	pthread_t thread;
+	bool running;
+	char *path;
+	uint32_t hint_width;
+	uint32_t hint_height;
+	cairo_surface_t *image;
+	// decoded instead when path is NULL or cannot be loaded
+	const uint8_t *fallback_data;
+	size_t fallback_size;
+	// CLOCK_MONOTONIC timestamps for the startup report
+	uint64_t start_ns;
+	uint64_t end_ns;
+	uint64_t wait_ns;
+};
+
+cairo_surface_t *image_decode_memory(const uint8_t *data, size_t size,
+				     uint32_t hint_width, uint32_t hint_height);
+cairo_surface_t *image_decode_file(const char *path, uint32_t hint_width,
+				   uint32_t hint_height);
+
+int image_loader_start(struct image_loader *loader, const char *path,
+		       uint32_t hint_width, uint32_t hint_height);
+// Joins the worker if needed. The returned surface stays owned by the loader.
+cairo_surface_t *image_loader_wait(struct image_loader *loader);
+void image_loader_finish(struct image_loader *loader);
+#endif
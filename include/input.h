@@ -0,0 +1,21 @@
+#ifndef HEADER_INPUT
+#define HEADER_INPUT
+#include "state.h"
+#include <stdbool.h>
+#include <xkbcommon/xkbcommon.h>
+
+// What a key press asks of the caller. The state machine only edits the
+// password buffer, drawing, timers and PAM are left to whoever drives it.
+struct input_effect {
+	auth_state_t icon; // state to show, may be the current one
+	bool submit;	   // the password is complete, authenticate it
+};
+
+// Whether sym is handled as text going into the password.
+bool input_key_types_text(xkb_keysym_t sym, int len);
+// Handles one key press, text holds the len bytes of UTF-8 it produced.
+struct input_effect input_handle_key(struct auth_state *auth,
+				     xkb_keysym_t sym, const char *text,
+				     int len);
+void clearPasswordBuffer(struct auth_state *auth_state);
+#endif
@@ -0,0 +1,47 @@
+#ifndef HEADER_INPUT_TRACE
+#define HEADER_INPUT_TRACE
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Input traces are text, one event per line after a version header:
+//   <microseconds> key <evdev keycode> <0 released|1 pressed>
+//   <microseconds> mods <depressed> <latched> <locked> <group>
+// Every key typing into the password is recorded as INPUT_REDACTED_KEY, so a
+// trace keeps the rhythm and length of a password but not its contents.
+// Shift and the other modifiers would still give away which characters were
+// typed, so a mods line only records that the modifiers changed and always
+// carries zeros.
+#define INPUT_TRACE_HEADER "# locker input trace v1"
+#define INPUT_REDACTED_KEY 30 // KEY_A
+
+enum input_event_type {
+	INPUT_EVENT_KEY,
+	INPUT_EVENT_MODIFIERS,
+};
+
+struct input_event {
+	enum input_event_type type;
+	uint64_t time_us; // since the first event
+	uint32_t key;
+	uint32_t state;
+	uint32_t depressed;
+	uint32_t latched;
+	uint32_t locked;
+	uint32_t group;
+};
+
+struct input_recorder {
+	FILE *file; // NULL when not recording
+	uint64_t start_ns;
+};
+
+int input_recorder_open(struct input_recorder *recorder, const char *path);
+void input_record_key(struct input_recorder *recorder, uint32_t key,
+		      uint32_t state, bool redact);
+void input_record_modifiers(struct input_recorder *recorder);
+void input_recorder_close(struct input_recorder *recorder);
+// Returns 1 with the next event, 0 at the end of the trace and -1 on a
+// malformed line.
+int input_trace_read(FILE *file, struct input_event *event);
+#endif
@@ -0,0 +1,33 @@
+#ifndef HEADER_KEYMAP
+#define HEADER_KEYMAP
+#include <stdint.h>
+#include <xkbcommon/xkbcommon.h>
+
+// Compiled keymaps by the text they were compiled from. Every
+// keyboard on every seat, a layout switch back and a dock coming back all
+// send a keymap, usually one already seen, and compiling one is the
+// slowest thing on the input path.
+#define KEYMAP_CACHE_SIZE 4
+
+struct keymap_cache_entry {
+	uint64_t hash; // of the text, the entry is free while keymap is NULL
+	uint32_t size;
+	// compared on a hash match, a collision must not type with the
+	// wrong layout
+	char *text;
+	uint64_t last_used;
+	struct xkb_keymap *keymap;
+};
+
+struct keymap_cache {
+	struct keymap_cache_entry entries[KEYMAP_CACHE_SIZE];
+	uint64_t uses;
+};
+
+// Returns a new reference the caller unrefs, or NULL if the text does not
+// compile. text is what wl_keyboard.keymap sent, size bytes long.
+struct xkb_keymap *keymap_cache_get(struct keymap_cache *cache,
+				    struct xkb_context *context,
+				    const char *text, uint32_t size);
+void keymap_cache_finish(struct keymap_cache *cache);
+#endif
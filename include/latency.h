@@ -0,0 +1,60 @@
+#ifndef HEADER_LATENCY
+#define HEADER_LATENCY
+#include <stdint.h>
+#include <time.h>
+#include <wayland-util.h>
+
+struct output_state;
+struct prog_state;
+struct wl_registry;
+struct wl_surface;
+struct wp_presentation;
+
+#define LATENCY_SAMPLES 1024
+// frames in flight at once, more than a few means the compositor is behind
+#define LATENCY_PENDING 8
+
+struct latency_stats;
+
+// One frame waiting for its presentation feedback, free while feedback is
+// NULL.
+struct latency_feedback {
+	struct latency_stats *stats;
+	struct wp_presentation_feedback *feedback;
+	uint64_t input_ns;
+};
+
+// Keystroke-to-photon latencies of one output. The most recent samples are
+// kept and sorted only when reporting. Frames wait in a fixed array, so
+// measuring a key press allocates nothing; with every slot taken the frame
+// goes unmeasured.
+struct latency_stats {
+	uint32_t samples[LATENCY_SAMPLES]; // microseconds
+	uint32_t count;			   // recorded so far, may wrap the ring
+	uint32_t max;
+	uint32_t discarded; // frames the compositor never showed
+	struct latency_feedback pending[LATENCY_PENDING];
+};
+
+// Correlates key presses with the frames they cause through wp_presentation.
+// Only commits made while a key is being handled are measured.
+struct latency {
+	struct wp_presentation *presentation;
+	clockid_t clock;   // presentation clock, input is stamped with it too
+	uint64_t input_ns; // key being handled, 0 outside the key handler
+};
+
+void latency_bind(struct prog_state *state, struct wl_registry *registry,
+		  uint32_t name);
+// Starts a sample at the key event's time when it can be trusted, see
+// latency.c, and otherwise now. event_ms is NULL for synthesized repeats.
+void latency_input_begin(struct latency *latency, const uint32_t *event_ms);
+void latency_input_end(struct latency *latency);
+// Asks for feedback on the commit about to be made on surface, the lock
+// surface of output or one of its overlays.
+void latency_commit(struct output_state *output, struct wl_surface *surface);
+void latency_stats_init(struct latency_stats *stats);
+void latency_stats_finish(struct latency_stats *stats);
+void latency_report(struct prog_state *state);
+void latency_finish(struct latency *latency);
+#endif
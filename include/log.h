@@ -0,0 +1,54 @@
+#ifndef HEADER_LOG
+#define HEADER_LOG
+#include <stdarg.h>
+
+// Leveled logging that never blocks the caller. Messages are formatted into
+// a lock-free ring and written to stderr by a background thread, so a slow
+// journal cannot delay input handling or rendering. When the ring is full
+// messages are dropped and counted instead.
+//
+// Never pass password contents, only lengths or states.
+typedef enum {
+	LOG_LEVEL_ERROR,
+	LOG_LEVEL_WARN,
+	LOG_LEVEL_INFO,
+	LOG_LEVEL_DEBUG,
+} log_level_t;
+
+typedef enum {
+	LOG_CAT_CORE,
+	LOG_CAT_OUTPUT,
+	LOG_CAT_RENDER,
+	LOG_CAT_INPUT,
+	LOG_CAT_AUTH,
+	LOG_CAT_COUNT,
+} log_category_t;
+
+// calls above this level are compiled out, set with -Dlog_level
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+extern log_level_t log_level;
+
+#define log_msg(level, category, ...)                                        \
+	do {                                                                 \
+		if ((level) <= LOG_COMPILE_LEVEL && (level) <= log_level) {  \
+			log_write((level), (category), __VA_ARGS__);         \
+		}                                                            \
+	} while (0)
+#define log_error(category, ...)                                             \
+	log_msg(LOG_LEVEL_ERROR, category, __VA_ARGS__)
+#define log_warn(category, ...) log_msg(LOG_LEVEL_WARN, category, __VA_ARGS__)
+#define log_info(category, ...) log_msg(LOG_LEVEL_INFO, category, __VA_ARGS__)
+#define log_debug(category, ...)                                             \
+	log_msg(LOG_LEVEL_DEBUG, category, __VA_ARGS__)
+
+// Until log_init() messages are written synchronously.
+void log_init(log_level_t level);
+void log_write(log_level_t level, log_category_t category, const char *fmt,
+	       ...) __attribute__((format(printf, 3, 4)));
+// Writes out everything queued and stops the writer thread.
+void log_finish(void);
+int log_parse_level(const char *name, log_level_t *out);
+#endif
@@ -0,0 +1,61 @@
+#ifndef HEADER_LOOP
+#define HEADER_LOOP
+#include <poll.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+struct prog_state;
+
+#define LOOP_MAX_SOURCES 16
+
+typedef enum {
+	LOOP_SOURCE_WAYLAND,
+	LOOP_SOURCE_TIMER,
+	LOOP_SOURCE_SIGNAL,
+	LOOP_SOURCE_OTHER,
+	LOOP_SOURCE_KIND_COUNT,
+} loop_source_kind_t;
+
+typedef void (*loop_handler_t)(struct prog_state *state, int fd,
+			       short revents);
+
+struct loop_source {
+	int fd;
+	short events;
+	loop_source_kind_t kind;
+	loop_handler_t handler;
+};
+
+// What the loop cost since loop_stats_begin(). A locked machine should sit in
+// poll() almost all the time, every wakeup is counted by the source that
+// caused it.
+struct loop_stats {
+	uint64_t iterations;
+	uint64_t timeouts; // poll() returned with nothing ready
+	uint64_t wakeups[LOOP_SOURCE_KIND_COUNT];
+	uint64_t begin_ns;
+	struct timeval begin_utime;
+	struct timeval begin_stime;
+};
+
+// A poll(2) loop around the Wayland connection and any extra fds (signals,
+// timers, workers). Unlike wl_display_dispatch() it returns on EINTR and
+// wakes up for the other sources.
+struct event_loop {
+	struct loop_source sources[LOOP_MAX_SOURCES];
+	size_t count;
+	struct loop_stats stats;
+};
+
+int loop_add_fd(struct event_loop *loop, int fd, short events,
+		loop_source_kind_t kind, loop_handler_t handler);
+void loop_remove_fd(struct event_loop *loop, int fd);
+// Flushes, waits for one batch of events and dispatches them. Returns -1 if
+// the Wayland connection failed.
+int loop_dispatch(struct prog_state *state, int timeout);
+void loop_stats_begin(struct event_loop *loop);
+// Prints wakeups, iterations and CPU time since loop_stats_begin().
+void loop_stats_report(struct event_loop *loop, const char *when);
+#endif
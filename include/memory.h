@@ -0,0 +1,26 @@
+#ifndef HEADER_MEMORY
+#define HEADER_MEMORY
+#include <stdint.h>
+
+struct output_state;
+struct prog_state;
+
+// Resident set size of the process, now and at its highest, in bytes. 0 when
+// it cannot be read.
+uint64_t memory_rss(void);
+uint64_t memory_peak_rss(void);
+// The most a locked output holds once its frame is up: the frame, the icon
+// backdrop and the overlays it may use, at their largest. In low-memory mode
+// nothing else grows with the number of outputs.
+uint64_t memory_output_bound(struct output_state *output);
+// Logs current and peak RSS, in low-memory mode also every output's bound.
+void memory_report(struct prog_state *state, const char *when);
+// Low-memory mode lets go of the decoded wallpaper once all frames have it.
+void memory_frames_done(struct prog_state *state);
+// Frees what can be rebuilt when needed: the decoded wallpaper, overlays
+// showing nothing, and heap malloc keeps around.
+void memory_trim(struct prog_state *state);
+// Trims whenever the kernel reports memory pressure (PSI). Returns -1 when
+// pressure cannot be watched, which is not an error on older kernels.
+int memory_watch(struct prog_state *state);
+#endif
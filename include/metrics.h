@@ -0,0 +1,52 @@
+#ifndef HEADER_METRICS
+#define HEADER_METRICS
+#include <stdint.h>
+#include <stdio.h>
+
+struct event_loop;
+
+// Process wide counters and histograms. Recording is a relaxed atomic add on
+// static storage, safe from any thread and from the render and input paths.
+typedef enum {
+	METRIC_AUTH_ATTEMPTS,
+	METRIC_AUTH_FAILURES,
+	METRIC_DECAYS,
+	METRIC_BUFFERS_ALLOCATED,
+	METRIC_LOOP_ITERATIONS,
+	// one per loop_source_kind_t, in the same order
+	METRIC_WAKEUPS_WAYLAND,
+	METRIC_WAKEUPS_TIMER,
+	METRIC_WAKEUPS_SIGNAL,
+	METRIC_WAKEUPS_OTHER,
+	METRIC_MEMORY_TRIMS,
+	METRIC_KEYMAP_COMPILES,
+	METRIC_COUNTER_COUNT,
+} metric_counter_t;
+
+typedef enum {
+	METRIC_FRAME_RENDER,
+	METRIC_PAM_AUTHENTICATE,
+	METRIC_ANIM_FRAME,
+	METRIC_HISTOGRAM_COUNT,
+} metric_histogram_t;
+
+typedef enum {
+	METRIC_TIME_TO_LOCK,
+	METRIC_LOCKED_CPU_USER,
+	METRIC_LOCKED_CPU_SYSTEM,
+	METRIC_GAUGE_COUNT,
+} metric_gauge_t;
+
+void metrics_count(metric_counter_t counter);
+// durations are in nanoseconds, exported in seconds
+void metrics_observe(metric_histogram_t histogram, uint64_t ns);
+void metrics_set(metric_gauge_t gauge, uint64_t ns);
+
+// Prometheus text exposition format
+void metrics_write(FILE *out);
+// Replaces path atomically, as the node exporter textfile collector wants.
+int metrics_write_textfile(const char *path);
+// Serves a snapshot to every client connecting to the UNIX socket at path.
+int metrics_listen(struct event_loop *loop, const char *path);
+void metrics_finish(struct event_loop *loop);
+#endif
@@ -0,0 +1,20 @@
+#ifndef HEADER_NOTICE
+#define HEADER_NOTICE
+#include <stdbool.h>
+
+struct output_state;
+struct prog_state;
+
+// The last message PAM had for the user, shown below the icon on an overlay
+// so it never costs a full frame.
+struct notice {
+	char text[128]; // empty while nothing is shown
+	bool error;
+};
+
+// Replaces the message on every output.
+void notice_show(struct prog_state *state, const char *text, bool error);
+void notice_clear(struct prog_state *state);
+// Draws the current message on one output, for newly configured outputs.
+void notice_draw(struct output_state *output);
+#endif
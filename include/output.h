@@ -0,0 +1,18 @@
+#ifndef HEADER_OUTPUT
+#define HEADER_OUTPUT
+#include "state.h"
+#include <stdint.h>
+
+struct output_state *output_create(struct prog_state *state,
+				   struct wl_output *wl_output,
+				   uint32_t global_name);
+void output_create_lock_surface(struct output_state *output);
+// Renders a frame at the size the lock surface is expected to get, so a
+// lock requested later is drawn by the time it is configured.
+void output_prepare_buffer(struct output_state *output);
+void output_drop_buffer(struct output_state *output);
+// Renders the frame of a configured lock surface again after its buffer was
+// dropped. Nothing is committed, the compositor still shows the old frame.
+void output_restore_buffer(struct output_state *output);
+void output_destroy(struct output_state *output);
+#endif
@@ -0,0 +1,50 @@
+#ifndef HEADER_OVERLAY
+#define HEADER_OVERLAY
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct output_state;
+struct wl_buffer;
+struct wl_subsurface;
+struct wl_surface;
+
+struct overlay_buffer {
+	struct wl_buffer *buffer;
+	uint8_t *data;
+	bool busy; // committed and not yet released by the compositor
+};
+
+// A small transparent subsurface over an output's lock surface, for parts
+// of the screen that change on their own. Updating one never repaints or
+// uploads the full-size frame underneath, and its commits do not wait for
+// the lock surface.
+struct overlay {
+	struct output_state *output;
+	struct wl_surface *surface;
+	struct wl_subsurface *subsurface;
+	struct overlay_buffer buffers[2];
+	uint8_t *pool_data;
+	size_t pool_size;
+	uint32_t width; // of the buffers, in buffer pixels
+	uint32_t height;
+	uint32_t scale;
+	int32_t x; // on the lock surface, INT32_MIN until placed
+	int32_t y;
+	// called once a buffer is released after overlay_buffer() found none
+	void (*released)(struct output_state *output);
+	bool waiting;
+};
+
+// Creates the subsurface and its buffers on first use and keeps them at the
+// given box, in logical pixels. Returns false while the output has no
+// configured lock surface or the compositor has no subsurfaces.
+bool overlay_place(struct overlay *overlay, struct output_state *output,
+		   int32_t x, int32_t y, uint32_t width, uint32_t height);
+// A buffer the compositor is not reading, NULL while it holds both.
+struct overlay_buffer *overlay_buffer(struct overlay *overlay);
+// Attaches buffer, damages the box given in buffer pixels and commits.
+void overlay_commit(struct overlay *overlay, struct overlay_buffer *buffer,
+		    int32_t x, int32_t y, int32_t width, int32_t height);
+void overlay_finish(struct overlay *overlay);
+#endif
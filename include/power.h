@@ -0,0 +1,16 @@
+#ifndef HEADER_POWER
+#define HEADER_POWER
+#include <stdint.h>
+
+struct prog_state;
+struct wl_registry;
+
+// Blanks a lock screen nobody is looking at: the outputs are turned off
+// through wlr-output-power-management and the rendered frames are freed.
+// The compositor keeps showing the last committed frame, so turning back on
+// only needs the buffers rendered again for the next change.
+void power_bind(struct prog_state *state, struct wl_registry *registry,
+		uint32_t name);
+void power_off(struct prog_state *state);
+void power_on(struct prog_state *state);
+#endif
@@ -0,0 +1,146 @@
+#ifndef HEADER_RENDER
+#define HEADER_RENDER
+#include "state.h"
+#include <cairo.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+struct render_backdrop;
+
+// The lock screen renderer. It paints into caller provided ARGB32 memory and
+// knows nothing about Wayland, so benchmarks can drive it headless.
+struct render_params {
+	cairo_surface_t *wallpaper; // NULL paints a plain background
+	cairo_filter_t filter;
+	cairo_font_face_t *icon_font; // NULL selects icon_font_family by name
+	const char *icon_font_family;
+	// the clock and PAM messages, NULL falls back to the icon font
+	cairo_font_face_t *text_font;
+	uint32_t icon_size;
+	// repaints under the icon come from here instead of the wallpaper
+	const struct render_backdrop *backdrop;
+};
+
+struct render_rect {
+	int32_t x;
+	int32_t y;
+	int32_t width;
+	int32_t height;
+};
+
+// One frame of the feedback ring, t seconds into the animation.
+struct render_anim {
+	enum anim_kind kind;
+	double t;
+	double angle; // where the typing segment starts, in turns
+};
+
+enum render_clock_line {
+	RENDER_CLOCK_TIME,
+	RENDER_CLOCK_DATE,
+	RENDER_CLOCK_LINES,
+};
+
+// Text of one clock line, shaped into glyphs only when it changes.
+struct render_text {
+	char text[64];
+	cairo_glyph_t *glyphs;
+	int glyph_count;
+	double width; // advance in buffer pixels
+};
+
+// The clock's fonts and last shaped lines, kept between ticks so an update
+// that leaves the date alone does not shape it again.
+struct render_clock {
+	uint32_t scale; // the fonts and glyphs are for this buffer scale
+	cairo_scaled_font_t *fonts[RENDER_CLOCK_LINES];
+	struct render_text lines[RENDER_CLOCK_LINES];
+};
+
+// The background under the icon box of one frame size, so an icon change
+// can be drawn after the wallpaper itself was freed.
+struct render_backdrop {
+	struct render_rect box; // in buffer pixels
+	uint8_t *pixels;	// box.width * 4 bytes per row
+};
+
+// Values shown by the debug HUD.
+struct render_hud {
+	uint64_t last_ns;
+	uint64_t avg_ns;
+	uint64_t max_ns;
+	uint64_t frames;
+	uint64_t damage_pixels; // of the last frame
+	uint32_t buffers_busy;	// attached and not yet released
+	uint32_t buffers;
+};
+
+const char *render_icon_text(auth_state_t icon);
+// The icon shown for state, with redraw_typing off the typing state keeps
+// showing the locked icon. States with the same icon need no new frame.
+auth_state_t render_visible_icon(auth_state_t state, bool redraw_typing);
+// Paints the wallpaper stretched over width x height.
+void render_background(cairo_t *cr, const struct render_params *params,
+		       uint32_t width, uint32_t height);
+void render_frame(const struct render_params *params, auth_state_t icon,
+		  uint32_t width, uint32_t height, uint32_t stride,
+		  uint32_t scale, void *pixels);
+// Repaints only the box any icon can cover, the rest of pixels must still
+// hold a frame from render_frame() of the same size. Returns the damage.
+struct render_rect render_icon(const struct render_params *params,
+			       auth_state_t icon, uint32_t width,
+			       uint32_t height, uint32_t stride, uint32_t scale,
+			       void *pixels);
+// Renders the background under the box render_icon() repaints for a width
+// by height buffer. Returns NULL when out of memory.
+struct render_backdrop *render_backdrop_create(
+    const struct render_params *params, uint32_t width, uint32_t height,
+    uint32_t scale);
+void render_backdrop_destroy(struct render_backdrop *backdrop);
+// Side of the square the feedback ring is drawn in, in logical pixels.
+uint32_t render_anim_size(const struct render_params *params);
+// Where that square goes on a width x height logical surface, centred on
+// the icon.
+void render_anim_origin(const struct render_params *params, uint32_t width,
+			uint32_t height, int32_t *x, int32_t *y);
+// Draws one frame of the ring into a transparent square of
+// render_anim_size() * scale pixels. Returns whether the animation still
+// moves; once it does not the square is left empty.
+bool render_anim(const struct render_params *params,
+		 const struct render_anim *anim, uint32_t stride,
+		 uint32_t scale, void *pixels);
+// Width of text set in the font of line, in logical pixels.
+double render_clock_text_width(struct render_clock *clock,
+			       const struct render_params *params,
+			       enum render_clock_line line, const char *text);
+// Height of the box holding both lines, in logical pixels. An empty date
+// leaves its line out.
+uint32_t render_clock_height(struct render_clock *clock,
+			     const struct render_params *params,
+			     bool with_date);
+// Draws time and date centred into a transparent box of width by height
+// logical pixels.
+void render_clock(struct render_clock *clock,
+		  const struct render_params *params, const char *time,
+		  const char *date, uint32_t width, uint32_t height,
+		  uint32_t stride, uint32_t scale, void *pixels);
+void render_clock_finish(struct render_clock *clock);
+// Size of the box PAM messages are shown in, in logical pixels.
+uint32_t render_notice_width(const struct render_params *params);
+uint32_t render_notice_height(const struct render_params *params);
+// Where a box_width wide notice goes, centred below the feedback ring.
+void render_notice_origin(const struct render_params *params, uint32_t width,
+			  uint32_t height, uint32_t box_width, int32_t *x,
+			  int32_t *y);
+// Draws one centred line into a transparent box of width by height logical
+// pixels, in red for errors. An empty text leaves the box clear.
+void render_notice(const struct render_params *params, const char *text,
+		   bool error, uint32_t width, uint32_t height, uint32_t stride,
+		   uint32_t scale, void *pixels);
+// Repaints the HUD box in the top left corner over the frame in pixels and
+// returns it as damage.
+struct render_rect render_hud(const struct render_params *params,
+			      const struct render_hud *hud, uint32_t width,
+			      uint32_t height, uint32_t stride, uint32_t scale,
+			      void *pixels);
+#endif
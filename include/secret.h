@@ -0,0 +1,24 @@
+#ifndef HEADER_SECRET
+#define HEADER_SECRET
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Memory for the password and anything derived from it, carved out of
+// pages of its own. They are locked so they are never swapped, left out of
+// core dumps, zero in forked children and wiped before they are unmapped.
+// Nothing is ever freed back, the arena is sized for what it holds.
+struct secret_arena {
+	uint8_t *base;
+	size_t size;
+	size_t used;
+	bool locked; // mlock can fail under a low RLIMIT_MEMLOCK
+};
+
+int secret_arena_init(struct secret_arena *arena, size_t size);
+// Zeroed memory, NULL once the arena is full.
+void *secret_alloc(struct secret_arena *arena, size_t size);
+// Zeroes memory in a way the compiler cannot drop as a dead store.
+void secret_wipe(void *data, size_t size);
+void secret_arena_finish(struct secret_arena *arena);
+#endif
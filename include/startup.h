@@ -0,0 +1,81 @@
+#ifndef HEADER_STARTUP
+#define HEADER_STARTUP
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct prog_state;
+
+// An independent piece of initialisation run on its own thread. The main
+// thread only joins it once something actually needs its result.
+struct startup_task {
+	const char *name;
+	pthread_t thread;
+	bool running;
+	int (*run)(struct prog_state *state);
+	struct prog_state *state;
+	int result;
+	uint64_t start_ns;
+	uint64_t end_ns;
+	uint64_t wait_ns; // how long the main thread blocked joining it
+};
+
+#define STARTUP_MAX_PHASES 16
+
+struct startup_phase {
+	const char *name;
+	uint64_t end_ns;
+};
+
+// Milestones on the way to a locked screen, each stamped the first time it
+// is reached. --profile-startup compares them across runs.
+enum startup_mark {
+	STARTUP_MARK_PAM,
+	STARTUP_MARK_XKB,
+	STARTUP_MARK_REGISTRY,
+	STARTUP_MARK_LOCK_REQUEST,
+	STARTUP_MARK_CONFIGURE,
+	STARTUP_MARK_BUFFER,
+	STARTUP_MARK_DECODE,
+	STARTUP_MARK_COMMIT,
+	STARTUP_MARK_LOCKED,
+	STARTUP_MARK_COUNT,
+};
+
+struct startup {
+	uint64_t begin_ns;
+	struct startup_phase phases[STARTUP_MAX_PHASES];
+	size_t phase_count;
+	uint64_t marks[STARTUP_MARK_COUNT];
+
+	// set in a run forked by startup_profile(), which reports to the fd
+	bool profiling;
+	int profile_fd;
+
+	struct startup_task pam;
+	struct startup_task xkb;
+	struct startup_task fonts;
+};
+
+uint64_t startup_now_ns(void);
+void startup_begin(struct startup *startup);
+// records that a main thread phase just finished
+void startup_phase(struct startup *startup, const char *name);
+void startup_task_start(struct startup_task *task, const char *name,
+			int (*run)(struct prog_state *state),
+			struct prog_state *state);
+// safe to call repeatedly, returns the task's result
+int startup_task_join(struct startup_task *task);
+void startup_report(struct prog_state *state);
+void startup_mark(struct startup *startup, enum startup_mark mark);
+
+// Forks runs locker processes one after another and prints min, median and
+// max of every milestone. Returns 1 in a forked run, which should go on to
+// lock, 0 in the parent once every run is reported and -1 on failure.
+int startup_profile(struct startup *startup, uint32_t runs);
+// Whether a profiled run has reached every milestone it waits for.
+bool startup_profile_done(const struct startup *startup);
+// Sends the run's milestones to the parent.
+void startup_profile_submit(struct prog_state *state);
+#endif
@@ -1,11 +1,25 @@
 #ifndef HEADER_STATE
 #define HEADER_STATE
+#include "anim.h"
+#include "clockface.h"
+#include "config.h"
+#include "image.h"
+#include "input_trace.h"
+#include "keymap.h"
+#include "latency.h"
+#include "loop.h"
+#include "notice.h"
+#include "secret.h"
+#include "startup.h"
+#include <cairo.h>
+#include <pthread.h>
 #include <security/_pam_types.h>
 #include <security/pam_appl.h>
 #include <security/pam_ext.h>
 #include <security/pam_modules.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <sys/types.h>
 #include <time.h>
 #include <wayland-client-protocol.h>
 #include <wayland-client.h>
@@ -22,49 +36,183 @@ typedef enum {
 struct auth_state {
 	pam_handle_t *pamh;
 	char *username;
+	struct secret_arena secret; // password_buffer lives here
 	char *password_buffer;
 	size_t password_len;
 	uint32_t password_pos;
 	auth_state_t current_state;
 };
 
-struct prog_state {
-	struct wl_display *display;
-	struct wl_compositor *compositor;
-	struct wl_shm *shm;
+// Messages PAM has for the user travel to the event loop as lines, a style
+// character ('i' for information, 'e' for errors) followed by the text.
+struct auth_channel {
+	int fd; // read end in the event loop, -1 while closed
+	char line[256];
+	size_t len;
+};
+
+// A pam_authenticate() call running on its own thread, so the event loop
+// keeps going while PAM takes its time. The password buffer belongs to the
+// worker until done() has been called.
+struct auth_worker {
+	pthread_t thread;
+	bool running;
+	int result;
+	int done_fd; // eventfd in the event loop, -1 until the first attempt
+	int message_fd; // written by the conversation, -1 until then
+	struct auth_channel messages;
+	void (*done)(struct prog_state *state, int result);
+};
+
+// A second PAM service that needs no password, pam_fprintd for example,
+// running from the moment of locking. It lives in a child process because a
+// module blocked on a reader can only be stopped by killing it.
+struct auth_concurrent {
+	pid_t pid; // 0 while not running
+	struct auth_channel messages; // reaches EOF when the child exits
+	uint64_t start_ns;
+	void (*done)(struct prog_state *state, int result);
+};
+
+// A shm backed buffer holding one rendered lock frame. Outputs whose lock
+// surfaces were configured with the same size share a single lock_buffer, so
+// mirrored or identical monitors are rendered once and cost memory once.
+struct lock_buffer {
+	struct wl_list link; // prog_state.buffers
 	struct wl_shm_pool *pool;
 	size_t shm_pool_size;
 	uint8_t *pool_data;
 	struct wl_buffer *buffer;
-	struct wl_seat *seat;
+	uint32_t width;
+	uint32_t height;
+	uint32_t stride;
+	uint32_t scale;
+	struct render_backdrop *backdrop; // for icon changes, see draw.c
+	uint32_t users; // outputs currently attached to this buffer
+	bool busy;	// committed and not yet released by the compositor
+};
+
+// Render timings shown by the debug HUD, see draw.c
+struct frame_stats {
+	uint64_t last_ns;
+	uint64_t total_ns;
+	uint64_t max_ns;
+	uint64_t count;
+	uint64_t damage_pixels; // of the last frame
+};
+
+// Repeats are generated here, the compositor only sends rate and delay.
+struct key_repeat {
+	int timer_fd; // -1 until the first key that repeats
+	int32_t rate; // per second, 0 turns repeat off
+	int32_t delay; // ms before the first repeat
+	uint32_t key; // evdev code of the held key
+	bool active;
+};
+
+// Every seat types into the same password. Keyboards keep their own
+// keymap and modifiers, the keymaps themselves come from the shared cache.
+struct seat_state {
+	struct wl_list link; // prog_state.seats
+	struct prog_state *state;
+	uint32_t global_name;
+	struct wl_seat *wl_seat;
 	struct wl_keyboard *keyboard;
+	struct xkb_keymap *xkb_keymap;
+	struct xkb_state *xkb_state;
+	struct key_repeat repeat;
+};
 
+struct output_state {
+	struct wl_list link; // prog_state.outputs
+	struct prog_state *state;
 	struct wl_output *output;
-	uint32_t logical_width;
-	uint32_t logical_height;
-	//  NOTE: there can be multiple outputs each output is analogus to a
-	//  screen. On my current machine i only have one output and also for
-	//  simplicity i will only bind to one output
+	uint32_t global_name;
+
+	int32_t mode_width;
+	int32_t mode_height;
+	int32_t scale;
+
+	struct wl_surface *surface;
+	struct ext_session_lock_surface_v1 *lock_surface;
+	uint32_t width; // of the lock surface, 0 until it is configured
+	uint32_t height;
+	struct lock_buffer *buffer;
+
+	struct latency_stats latency;
+	bool done; // every property of the output has been sent
+	struct zwlr_output_power_v1 *power; // created on the first power off
+	struct anim_output anim;
+	struct overlay clockface;
+	struct overlay notice;
+};
+
+struct prog_state {
+	struct config config;
+
+	struct wl_display *display;
+	struct wl_registry *registry;
+	struct wl_compositor *compositor;
+	struct wl_subcompositor *subcompositor;
+	struct wl_shm *shm;
+	struct wl_list seats; // seat_state.link
+
+	// every output gets its own lock surface, see output.c
+	struct wl_list outputs; // output_state.link
+	struct wl_list buffers; // lock_buffer.link
+
+	// decoded off the main thread, see image.c
+	struct image_loader wallpaper;
+	// resolved through fontconfig once, on a startup worker; icon_font is
+	// NULL when the embedded theme covers the icons
+	cairo_font_face_t *icon_font;
+	cairo_font_face_t *text_font;
+
+	struct startup startup;
+	struct event_loop loop;
+	struct latency latency;
+	struct frame_stats frame_stats;
+	struct anim anim;
+	struct clockface clockface;
 
 	// keyboard stuff
 	struct xkb_context *xkb_context;
-	struct xkb_keymap *xkb_keymap;
-	struct xkb_state *xkb_state;
+	struct keymap_cache keymaps;
+	struct input_recorder input_recorder;
 
 	// lock stuff
 	struct ext_session_lock_manager_v1 *lock_manager;
 	struct ext_session_lock_v1 *session_lock;
-	struct wl_surface *surface;
-	struct ext_session_lock_surface_v1 *lock_surface;
 	bool locked;
+	// the lock handshake is driven by events, see main.c
+	struct wl_callback *registry_sync;
+	bool registry_done;
+	bool wallpaper_started;
+	int unlock_timer_fd; // shows the success icon before unlocking
+
+	// idle mode waits for these before locking, see main.c
+	struct ext_idle_notifier_v1 *idle_notifier;
+	struct ext_idle_notification_v1 *idle_warning;
+	struct ext_idle_notification_v1 *idle_lock;
+	struct seat_state *idle_seat; // the seat both watch, NULL if none
+	bool prepared; // frames for the idle lock are already rendered
 
 	// auth state
 	struct auth_state auth_state;
+	struct auth_worker auth_worker;
+	struct auth_concurrent auth_concurrent;
+	struct notice notice;
 
 	// decay_state
-	struct wl_callback *decay_callback;
 	uint32_t decay_interval;
 	struct timespec last_activity;
 	bool decay_enabled;
+	// fires at the next decay or power off deadline, see main.c
+	int inactivity_timer_fd;
+	uint64_t inactivity_deadline_ns; // what it is armed for, 0 if not
+
+	// blanking after inactivity, see power.c
+	struct zwlr_output_power_manager_v1 *power_manager;
+	bool powered_off;
 };
 #endif
@@ -0,0 +1,34 @@
+#ifndef HEADER_THEME
+#define HEADER_THEME
+#include "state.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// An icon pre-rasterised at build time by tools/embed-theme.c. The mask is
+// placed at (x_offset, y_offset) relative to the text origin; the ink extents
+// are cairo's text extents so layout matches the runtime font path exactly.
+struct theme_glyph {
+	auth_state_t state;
+	uint16_t size;
+	uint16_t width;
+	uint16_t height;
+	uint16_t stride;
+	int16_t x_offset;
+	int16_t y_offset;
+	float x_bearing;
+	float y_bearing;
+	float ink_width;
+	float ink_height;
+	const uint8_t *data; // CAIRO_FORMAT_A8
+};
+
+extern const struct theme_glyph theme_glyphs[];
+extern const size_t theme_glyph_count;
+// optional fallback wallpaper in any format image.c decodes, may be empty
+extern const uint8_t theme_background[];
+extern const size_t theme_background_size;
+
+const struct theme_glyph *theme_find_glyph(auth_state_t state, uint32_t size);
+// true when every icon exists at this size, so no runtime font is needed
+bool theme_has_size(uint32_t size);
+#endif
@@ -0,0 +1,29 @@
+#ifndef HEADER_TRACE
+#define HEADER_TRACE
+#include <stdbool.h>
+
+// Span tracing exported as Chrome trace JSON (chrome://tracing, Perfetto).
+// Always compiled in; while disabled every macro costs a single branch.
+// Event names must be string literals, only the pointer is recorded.
+extern bool trace_enabled;
+
+void trace_record(const char *name, char phase);
+
+#define TRACE_EVENT(name, phase)                                               \
+	do {                                                                   \
+		if (__builtin_expect(trace_enabled, 0)) {                      \
+			trace_record(name, phase);                             \
+		}                                                              \
+	} while (0)
+
+#define TRACE_BEGIN(name) TRACE_EVENT(name, 'B')
+#define TRACE_END(name) TRACE_EVENT(name, 'E')
+#define TRACE_INSTANT(name) TRACE_EVENT(name, 'i')
+
+// Enables tracing, the trace is written to path on trace_dump().
+void trace_init(const char *path);
+// names the calling thread in the exported trace
+void trace_thread_name(const char *name);
+int trace_dump(void);
+void trace_finish(void);
+#endif
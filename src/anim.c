@@ -0,0 +1,99 @@
+#include "anim.h"
+#include "metrics.h"
+#include "render.h"
+#include "state.h"
+#include "trace.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <wayland-client-protocol.h>
+#include <wayland-client.h>
+
+static void anim_draw(struct output_state *output);
+
+static bool anim_place(struct output_state *output) {
+	struct render_params params = {
+	    .icon_size = output->state->config.icon_size,
+	};
+	uint32_t size = render_anim_size(&params);
+	int32_t x, y;
+	render_anim_origin(&params, output->width, output->height, &x, &y);
+	output->anim.overlay.released = anim_draw;
+	return overlay_place(&output->anim.overlay, output, x, y, size, size);
+}
+
+static void frame_done(void *data, struct wl_callback *callback,
+		       uint32_t time) {
+	struct output_state *output = data;
+	wl_callback_destroy(callback);
+	output->anim.frame = NULL;
+	anim_draw(output);
+}
+
+static const struct wl_callback_listener frame_listener = {
+    .done = frame_done,
+};
+
+static void anim_draw(struct output_state *output) {
+	struct prog_state *state = output->state;
+	struct anim_output *anim = &output->anim;
+	if (!anim_place(output)) {
+		return;
+	}
+	struct overlay_buffer *buffer = overlay_buffer(&anim->overlay);
+	if (!buffer) {
+		return;
+	}
+
+	TRACE_BEGIN("anim frame");
+	// interpolated by the clock, a late frame skips ahead instead of
+	// slowing the animation down
+	uint64_t now = startup_now_ns();
+	struct render_params params = {.icon_size = state->config.icon_size};
+	struct render_anim frame = {
+	    .kind = state->anim.kind,
+	    .t = (now - state->anim.start_ns) / 1e9,
+	    .angle = state->anim.angle,
+	};
+	struct overlay *overlay = &anim->overlay;
+	bool moving = render_anim(&params, &frame, overlay->width * 4,
+				  overlay->scale, buffer->data);
+	metrics_observe(METRIC_ANIM_FRAME, startup_now_ns() - now);
+	if (!moving) {
+		state->anim.kind = ANIM_NONE;
+	} else {
+		anim->frame = wl_surface_frame(overlay->surface);
+		wl_callback_add_listener(anim->frame, &frame_listener, output);
+	}
+	overlay_commit(overlay, buffer, 0, 0, overlay->width, overlay->height);
+	TRACE_END("anim frame");
+}
+
+void anim_start(struct prog_state *state, enum anim_kind kind) {
+	if (!state->config.animations || state->powered_off ||
+	    (kind == ANIM_NONE && state->anim.kind == ANIM_NONE)) {
+		return;
+	}
+	state->anim.kind = kind;
+	state->anim.start_ns = startup_now_ns();
+	if (kind == ANIM_TYPING || kind == ANIM_ERASE) {
+		state->anim.angle = (rand() % 360) / 360.0;
+	}
+
+	struct output_state *output;
+	wl_list_for_each(output, &state->outputs, link) {
+		// a frame already on its way picks up the new animation
+		if (output->anim.frame || output->anim.overlay.waiting ||
+		    (kind == ANIM_NONE && !output->anim.overlay.surface)) {
+			continue;
+		}
+		anim_draw(output);
+	}
+}
+
+void anim_output_finish(struct anim_output *anim) {
+	if (anim->frame) {
+		wl_callback_destroy(anim->frame);
+		anim->frame = NULL;
+	}
+	overlay_finish(&anim->overlay);
+}
@@ -1,9 +1,85 @@
+#include "auth.h"
+#include "log.h"
+#include "loop.h"
+#include "metrics.h"
+#include "notice.h"
 #include "state.h"
+#include "trace.h"
+#include <errno.h>
+#include <fcntl.h>
 #include <security/_pam_types.h>
 #include <security/pam_appl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/eventfd.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// a concurrent service failing faster than this will not do better next time
+#define CONCURRENT_RETRY_NS 2000000000ull
+
+// Lines are written whole and are shorter than PIPE_BUF, so writers never
+// interleave. A full pipe drops the message rather than blocking PAM.
+static void send_message(int fd, int style, const char *text) {
+	char line[200];
+	size_t len = 0;
+	line[len++] = style;
+	for (; *text && len < sizeof(line) - 1; text++) {
+		line[len++] = *text == '\n' ? ' ' : *text;
+	}
+	line[len++] = '\n';
+	if (write(fd, line, len) != (ssize_t)len) {
+		// the loop has not caught up, an older message is still queued
+	}
+}
+
+// Shows every complete line, returns true once the writers are gone.
+static bool channel_read(struct prog_state *state,
+			 struct auth_channel *channel) {
+	for (;;) {
+		size_t room = sizeof(channel->line) - 1 - channel->len;
+		ssize_t n = read(channel->fd, channel->line + channel->len, room);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return n == 0;
+		}
+		channel->len += n;
+		char *start = channel->line;
+		char *end;
+		while ((end = memchr(start, '\n',
+				     channel->line + channel->len - start))) {
+			*end = '\0';
+			if (start[0] != '\0' && start[1] != '\0') {
+				log_info(LOG_CAT_AUTH, "PAM: %s", start + 1);
+				notice_show(state, start + 1, start[0] == 'e');
+			}
+			start = end + 1;
+		}
+		channel->len -= start - channel->line;
+		memmove(channel->line, start, channel->len);
+		if (channel->len == sizeof(channel->line) - 1) {
+			channel->len = 0; // not a line we wrote
+		}
+	}
+}
+
+static int open_channel(int fds[2]) {
+	if (pipe(fds) != 0) {
+		return -1;
+	}
+	for (int i = 0; i < 2; i++) {
+		fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+		fcntl(fds[i], F_SETFL, O_NONBLOCK);
+	}
+	return 0;
+}
 
 /*
  * Adapted from swaylock: https://github.com/swaywm/swaylock
@@ -27,16 +103,27 @@ static int handle_conversation(int num_msg, const struct pam_message **msg,
 		switch (msg[i]->msg_style) {
 		case PAM_PROMPT_ECHO_OFF:
 		case PAM_PROMPT_ECHO_ON:
-			pam_reply[i].resp = strdup(
-			    state->auth_state
-				.password_buffer); // PAM clears and frees this
+			// PAM wipes and free()s responses, so this one copy
+			// has to be on the heap and cannot come from the arena
+			pam_reply[i].resp =
+			    malloc(state->auth_state.password_pos + 1);
 			if (pam_reply[i].resp == NULL) {
 				fprintf(stderr, "Allocation failed 2\n");
 				return PAM_ABORT;
 			}
+			memcpy(pam_reply[i].resp,
+			       state->auth_state.password_buffer,
+			       state->auth_state.password_pos);
+			pam_reply[i].resp[state->auth_state.password_pos] =
+			    '\0';
 			break;
 		case PAM_ERROR_MSG:
+			send_message(state->auth_worker.message_fd, 'e',
+				     msg[i]->msg);
+			break;
 		case PAM_TEXT_INFO:
+			send_message(state->auth_worker.message_fd, 'i',
+				     msg[i]->msg);
 			break;
 		}
 	}
@@ -46,6 +133,22 @@ static int handle_conversation(int num_msg, const struct pam_message **msg,
  * The adapted code ends here
  */
 
+// confdir replaces /etc/pam.d, it needs Linux-PAM 1.4 or later
+static int start_pam(const char *service, const char *user,
+		     const struct pam_conv *conversation, const char *confdir,
+		     pam_handle_t **pamh) {
+	if (!confdir) {
+		return pam_start(service, user, conversation, pamh);
+	}
+#ifdef HAVE_PAM_START_CONFDIR
+	return pam_start_confdir(service, user, conversation, confdir, pamh);
+#else
+	log_error(LOG_CAT_AUTH, "this PAM cannot read services from %s",
+		  confdir);
+	return PAM_SERVICE_ERR;
+#endif
+}
+
 static struct pam_conv conv = {
     .conv = handle_conversation,
     .appdata_ptr = NULL, // set at init_pam
@@ -55,8 +158,13 @@ int init_pam(struct prog_state *state) {
 	conv.appdata_ptr = state;
 	state->auth_state.password_len = 256;
 	state->auth_state.password_pos = 0;
-	state->auth_state.password_buffer =
-	    calloc(state->auth_state.password_len, sizeof(char));
+	if (secret_arena_init(&state->auth_state.secret,
+			      state->auth_state.password_len) != 0) {
+		log_error(LOG_CAT_AUTH, "no memory for the password");
+		return -1;
+	}
+	state->auth_state.password_buffer = secret_alloc(
+	    &state->auth_state.secret, state->auth_state.password_len);
 
 	const char *user = getenv("USER");
 	if (user) {
@@ -65,10 +173,13 @@ int init_pam(struct prog_state *state) {
 		state->auth_state.username = "unknown";
 	}
 
-	fprintf(stderr, "Current user: %s\n", state->auth_state.username);
+	log_info(LOG_CAT_AUTH, "Current user: %s", state->auth_state.username);
 
-	int ret = pam_start("locker", state->auth_state.username, &conv,
-			    &state->auth_state.pamh);
+	TRACE_BEGIN("pam_start");
+	int ret = start_pam(state->config.pam_service,
+			    state->auth_state.username, &conv,
+			    state->config.pam_confdir, &state->auth_state.pamh);
+	TRACE_END("pam_start");
 	if (ret != PAM_SUCCESS) {
 		return -1;
 	}
@@ -78,25 +189,337 @@ int init_pam(struct prog_state *state) {
 int authenticate_user(struct prog_state *state) {
 	struct auth_state *auth_state = &state->auth_state;
 	if (!auth_state->pamh) {
-		fprintf(stderr, "PAM not init\n");
+		log_error(LOG_CAT_AUTH, "PAM not init");
 		return -1;
 	}
-	fprintf(stderr, "AUTHENTICATING USER\n");
+	log_info(LOG_CAT_AUTH, "AUTHENTICATING USER");
 
-	int ret = pam_authenticate(auth_state->pamh, PAM_SILENT);
+	metrics_count(METRIC_AUTH_ATTEMPTS);
+	TRACE_BEGIN("pam_authenticate");
+	uint64_t start = startup_now_ns();
+	// not silent, what modules have to say is shown below the icon
+	int ret = pam_authenticate(auth_state->pamh, 0);
+	metrics_observe(METRIC_PAM_AUTHENTICATE, startup_now_ns() - start);
+	TRACE_END("pam_authenticate");
 	if (ret == PAM_SUCCESS) {
-		ret = pam_acct_mgmt(auth_state->pamh, PAM_SILENT);
+		TRACE_BEGIN("pam_acct_mgmt");
+		ret = pam_acct_mgmt(auth_state->pamh, 0);
+		TRACE_END("pam_acct_mgmt");
 		if (ret == PAM_SUCCESS) {
-			fprintf(stderr,
-				"Verified everything auth successful\n");
+			log_info(LOG_CAT_AUTH,
+				 "Verified everything auth successful");
 		} else {
-			fprintf(stderr, "account verification failed\n");
+			log_warn(LOG_CAT_AUTH, "account verification failed");
+			metrics_count(METRIC_AUTH_FAILURES);
 			return -1;
 		}
 
 	} else {
-		fprintf(stderr, "AUTH FAILED\n");
+		log_warn(LOG_CAT_AUTH, "AUTH FAILED");
+		metrics_count(METRIC_AUTH_FAILURES);
+		return -1;
+	}
+	return 0;
+}
+
+static void *auth_worker_run(void *data) {
+	struct prog_state *state = data;
+	struct auth_worker *worker = &state->auth_worker;
+	trace_thread_name("auth");
+	worker->result = authenticate_user(state);
+	uint64_t one = 1;
+	if (write(worker->done_fd, &one, sizeof(one)) != sizeof(one)) {
+		log_error(LOG_CAT_AUTH, "failed to signal the auth result");
+	}
+	return NULL;
+}
+
+static void handle_auth_done(struct prog_state *state, int fd,
+			     short revents) {
+	struct auth_worker *worker = &state->auth_worker;
+	uint64_t count;
+	if (read(fd, &count, sizeof(count)) != sizeof(count) ||
+	    !worker->running) {
+		return;
+	}
+	pthread_join(worker->thread, NULL);
+	worker->running = false;
+	// the concurrent service may have won in the meantime
+	if (state->auth_state.current_state == AUTH_STATE_SUCCESS) {
+		return;
+	}
+	if (worker->result == 0) {
+		auth_concurrent_stop(state);
+	}
+	worker->done(state, worker->result);
+}
+
+static void handle_worker_messages(struct prog_state *state, int fd,
+				   short revents) {
+	channel_read(state, &state->auth_worker.messages);
+}
+
+static int open_worker_channel(struct prog_state *state) {
+	struct auth_worker *worker = &state->auth_worker;
+	int fds[2];
+	if (open_channel(fds) != 0) {
 		return -1;
 	}
+	if (loop_add_fd(&state->loop, fds[0], POLLIN, LOOP_SOURCE_OTHER,
+			handle_worker_messages) != 0) {
+		close(fds[0]);
+		close(fds[1]);
+		return -1;
+	}
+	worker->messages.fd = fds[0];
+	worker->message_fd = fds[1];
 	return 0;
 }
+
+int auth_start(struct prog_state *state,
+	       void (*done)(struct prog_state *state, int result)) {
+	struct auth_worker *worker = &state->auth_worker;
+	if (worker->running) {
+		return -1;
+	}
+	if (worker->done_fd < 0) {
+		worker->done_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (worker->done_fd < 0) {
+			return -1;
+		}
+		if (loop_add_fd(&state->loop, worker->done_fd, POLLIN,
+				LOOP_SOURCE_OTHER, handle_auth_done) != 0) {
+			close(worker->done_fd);
+			worker->done_fd = -1;
+			return -1;
+		}
+	}
+	if (worker->message_fd < 0 && open_worker_channel(state) != 0) {
+		return -1;
+	}
+	worker->done = done;
+	if (pthread_create(&worker->thread, NULL, auth_worker_run, state) !=
+	    0) {
+		return -1;
+	}
+	worker->running = true;
+	return 0;
+}
+
+void auth_finish(struct prog_state *state) {
+	struct auth_worker *worker = &state->auth_worker;
+	if (worker->running) {
+		// PAM cannot be interrupted, but its delays are short
+		log_info(LOG_CAT_AUTH, "waiting for the password check");
+		pthread_join(worker->thread, NULL);
+		worker->running = false;
+	}
+	if (state->auth_state.pamh) {
+		pam_end(state->auth_state.pamh,
+			state->auth_state.current_state == AUTH_STATE_SUCCESS
+			    ? PAM_SUCCESS
+			    : PAM_AUTH_ERR);
+		state->auth_state.pamh = NULL;
+	}
+}
+
+static int concurrent_conversation(int num_msg, const struct pam_message **msg,
+				   struct pam_response **resp, void *data) {
+	int fd = *(int *)data;
+	*resp = calloc(num_msg, sizeof(struct pam_response));
+	if (!*resp) {
+		return PAM_BUF_ERR;
+	}
+	for (int i = 0; i < num_msg; i++) {
+		switch (msg[i]->msg_style) {
+		case PAM_PROMPT_ECHO_OFF:
+		case PAM_PROMPT_ECHO_ON:
+			// this path has no password to give
+			free(*resp);
+			*resp = NULL;
+			return PAM_CONV_ERR;
+		case PAM_ERROR_MSG:
+			send_message(fd, 'e', msg[i]->msg);
+			break;
+		case PAM_TEXT_INFO:
+			send_message(fd, 'i', msg[i]->msg);
+			break;
+		}
+	}
+	return PAM_SUCCESS;
+}
+
+// The helper talks to the parent through this descriptor only.
+#define HELPER_MESSAGE_FD 3
+
+extern char **environ;
+
+int auth_helper_main(int argc, char **argv) {
+	if (argc != 6) {
+		fprintf(stderr, "%s %s is started by the locker itself\n",
+			argv[0], AUTH_HELPER_ARG);
+		return EXIT_FAILURE;
+	}
+	const char *service = argv[2];
+	const char *user = argv[3];
+	const char *confdir = argv[4][0] ? argv[4] : NULL;
+	pid_t parent = strtol(argv[5], NULL, 10);
+	// a locker that crashed must not leave a reader waiting for a finger
+	if (prctl(PR_SET_PDEATHSIG, SIGKILL) != 0 || getppid() != parent) {
+		return EXIT_FAILURE;
+	}
+
+	int fd = HELPER_MESSAGE_FD;
+	struct pam_conv conversation = {
+	    .conv = concurrent_conversation,
+	    .appdata_ptr = &fd,
+	};
+	pam_handle_t *pamh;
+	int ret = start_pam(service, user, &conversation, confdir, &pamh);
+	if (ret != PAM_SUCCESS) {
+		return EXIT_FAILURE;
+	}
+	ret = pam_authenticate(pamh, 0);
+	if (ret == PAM_SUCCESS) {
+		ret = pam_acct_mgmt(pamh, 0);
+	}
+	pam_end(pamh, ret);
+	return ret == PAM_SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Starts the locker again as the helper. Not fork(): by now the locker has
+// threads, and a forked child may only make async-signal-safe calls until it
+// execs, which rules out PAM and the modules it loads.
+static pid_t spawn_helper(struct prog_state *state, int fd) {
+	char parent[16];
+	snprintf(parent, sizeof(parent), "%d", (int)getpid());
+	const char *confdir = state->config.pam_confdir;
+	char *argv[] = {
+	    "locker",
+	    AUTH_HELPER_ARG,
+	    state->config.concurrent_pam,
+	    state->auth_state.username,
+	    confdir ? (char *)confdir : "",
+	    parent,
+	    NULL,
+	};
+
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_adddup2(&actions, fd, HELPER_MESSAGE_FD);
+	// the locker blocks signals on some threads, the helper starts clean
+	posix_spawnattr_t attr;
+	posix_spawnattr_init(&attr);
+	sigset_t none, all;
+	sigemptyset(&none);
+	sigfillset(&all);
+	posix_spawnattr_setsigmask(&attr, &none);
+	posix_spawnattr_setsigdefault(&attr, &all);
+	posix_spawnattr_setflags(&attr,
+				 POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+	pid_t pid;
+	int err = posix_spawn(&pid, "/proc/self/exe", &actions, &attr, argv,
+			      environ);
+	posix_spawnattr_destroy(&attr);
+	posix_spawn_file_actions_destroy(&actions);
+	if (err != 0) {
+		log_error(LOG_CAT_AUTH, "could not start the PAM helper: %s",
+			  strerror(err));
+		return -1;
+	}
+	return pid;
+}
+
+static void concurrent_close(struct prog_state *state) {
+	struct auth_concurrent *concurrent = &state->auth_concurrent;
+	loop_remove_fd(&state->loop, concurrent->messages.fd);
+	close(concurrent->messages.fd);
+	concurrent->messages.fd = -1;
+	concurrent->pid = 0;
+}
+
+static void handle_concurrent(struct prog_state *state, int fd,
+			      short revents) {
+	struct auth_concurrent *concurrent = &state->auth_concurrent;
+	if (!channel_read(state, &concurrent->messages)) {
+		return;
+	}
+	int status = 0;
+	waitpid(concurrent->pid, &status, 0);
+	concurrent_close(state);
+	if (state->auth_state.current_state == AUTH_STATE_SUCCESS) {
+		return;
+	}
+
+	const char *service = state->config.concurrent_pam;
+	if (WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS) {
+		log_info(LOG_CAT_AUTH, "%s: authenticated", service);
+		concurrent->done(state, 0);
+		return;
+	}
+	if (startup_now_ns() - concurrent->start_ns < CONCURRENT_RETRY_NS) {
+		log_warn(LOG_CAT_AUTH, "%s: failed right away, not retrying",
+			 service);
+		return;
+	}
+	log_info(LOG_CAT_AUTH, "%s: failed, trying again", service);
+	if (auth_concurrent_start(state, concurrent->done) != 0) {
+		log_error(LOG_CAT_AUTH, "%s: could not restart", service);
+	}
+}
+
+int auth_concurrent_start(struct prog_state *state,
+			  void (*done)(struct prog_state *state, int result)) {
+	struct auth_concurrent *concurrent = &state->auth_concurrent;
+	if (!state->config.concurrent_pam || concurrent->pid) {
+		return 0;
+	}
+	int fds[2];
+	if (open_channel(fds) != 0) {
+		return -1;
+	}
+	// blocking writes in the child, it has nothing else to do
+	fcntl(fds[1], F_SETFL, 0);
+	// dup2 onto itself would keep close-on-exec set
+	if (fds[1] == HELPER_MESSAGE_FD) {
+		int fd = fcntl(fds[1], F_DUPFD_CLOEXEC, HELPER_MESSAGE_FD + 1);
+		close(fds[1]);
+		fds[1] = fd;
+	}
+	pid_t pid = fds[1] < 0 ? -1 : spawn_helper(state, fds[1]);
+	if (fds[1] >= 0) {
+		close(fds[1]);
+	}
+	if (pid < 0) {
+		close(fds[0]);
+		return -1;
+	}
+	concurrent->pid = pid;
+	concurrent->messages = (struct auth_channel){.fd = fds[0]};
+	concurrent->start_ns = startup_now_ns();
+	concurrent->done = done;
+	if (loop_add_fd(&state->loop, fds[0], POLLIN, LOOP_SOURCE_OTHER,
+			handle_concurrent) != 0) {
+		kill(pid, SIGKILL);
+		waitpid(pid, NULL, 0);
+		close(fds[0]);
+		concurrent->messages.fd = -1;
+		concurrent->pid = 0;
+		return -1;
+	}
+	log_info(LOG_CAT_AUTH, "%s: started", state->config.concurrent_pam);
+	return 0;
+}
+
+void auth_concurrent_stop(struct prog_state *state) {
+	struct auth_concurrent *concurrent = &state->auth_concurrent;
+	if (!concurrent->pid) {
+		return;
+	}
+	// the module may be blocked on the reader and not listening, SIGKILL
+	// cannot be ignored; fprintd lets go of a device whose client is gone
+	kill(concurrent->pid, SIGKILL);
+	waitpid(concurrent->pid, NULL, 0);
+	concurrent_close(state);
+}
@@ -0,0 +1,291 @@
+#include "clockface.h"
+#include "log.h"
+#include "loop.h"
+#include "overlay.h"
+#include "render.h"
+#include "state.h"
+#include "trace.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TZ_DIR "/etc"
+#define TZ_LINK "localtime"
+
+static void get_params(struct prog_state *state,
+		       struct render_params *params) {
+	startup_task_join(&state->startup.fonts);
+	*params = (struct render_params){
+	    .icon_font = state->icon_font,
+	    .icon_font_family = state->config.icon_font,
+	    .text_font = state->text_font,
+	    .icon_size = state->config.icon_size,
+	};
+}
+
+static const char *date_format(struct prog_state *state) {
+	return state->config.date_format ? state->config.date_format : "";
+}
+
+static void format(const char *fmt, const struct tm *tm, char *out,
+		   size_t size) {
+	if (fmt[0] == '\0' || strftime(out, size, fmt, tm) == 0) {
+		out[0] = '\0';
+	}
+}
+
+// The box is sized once for the widest text the formats can produce, so it
+// never moves or grows while ticking. Digits and names are not equally
+// wide in most fonts, every hour and minute, month and weekday is tried.
+static void measure(struct prog_state *state) {
+	struct clockface *clock = &state->clockface;
+	struct render_params params;
+	get_params(state, &params);
+	const char *date_fmt = date_format(state);
+	char text[64];
+	double width = 0;
+	for (int hour = 0; hour < 24; hour++) {
+		for (int minute = 0; minute < 60; minute++) {
+			struct tm tm = {.tm_hour = hour,
+					.tm_min = minute,
+					.tm_sec = minute,
+					.tm_mday = 28,
+					.tm_year = 100};
+			format(state->config.clock_format, &tm, text,
+			       sizeof(text));
+			double w = render_clock_text_width(
+			    clock->render, &params, RENDER_CLOCK_TIME, text);
+			if (w > width) {
+				width = w;
+			}
+		}
+	}
+	for (int month = 0; date_fmt[0] && month < 12; month++) {
+		for (int day = 0; day < 7; day++) {
+			struct tm tm = {.tm_mon = month,
+					.tm_wday = day,
+					.tm_mday = 28,
+					.tm_yday = 360,
+					.tm_year = 100};
+			format(date_fmt, &tm, text, sizeof(text));
+			double w = render_clock_text_width(
+			    clock->render, &params, RENDER_CLOCK_DATE, text);
+			if (w > width) {
+				width = w;
+			}
+		}
+	}
+	// room for the shadow and for glyphs overhanging their advance
+	clock->width = width + params.icon_size / 2;
+	clock->height =
+	    render_clock_height(clock->render, &params, date_fmt[0]);
+}
+
+// Centred at a third of the height, but never over the ring around the icon.
+static bool place(struct output_state *output) {
+	struct prog_state *state = output->state;
+	struct clockface *clock = &state->clockface;
+	struct render_params params;
+	get_params(state, &params);
+	int32_t anim_x, anim_y;
+	render_anim_origin(&params, output->width, output->height, &anim_x,
+			   &anim_y);
+	uint32_t width =
+	    clock->width < output->width ? clock->width : output->width;
+	int32_t x = ((int32_t)output->width - (int32_t)width) / 2;
+	int32_t y = (int32_t)output->height / 3 - (int32_t)clock->height / 2;
+	if (y + (int32_t)clock->height > anim_y) {
+		y = anim_y - clock->height;
+	}
+	if (y < 0) {
+		y = 0;
+	}
+	return overlay_place(&output->clockface, output, x, y, width,
+			     clock->height);
+}
+
+void clockface_draw(struct output_state *output) {
+	struct prog_state *state = output->state;
+	struct clockface *clock = &state->clockface;
+	if (!clock->render || state->powered_off || !place(output)) {
+		return;
+	}
+	struct overlay *overlay = &output->clockface;
+	overlay->released = clockface_draw;
+	struct overlay_buffer *buffer = overlay_buffer(overlay);
+	if (!buffer) {
+		return;
+	}
+
+	TRACE_BEGIN("clock");
+	struct render_params params;
+	get_params(state, &params);
+	render_clock(clock->render, &params, clock->time, clock->date,
+		     overlay->width / overlay->scale,
+		     overlay->height / overlay->scale, overlay->width * 4,
+		     overlay->scale, buffer->data);
+	overlay_commit(overlay, buffer, 0, 0, overlay->width, overlay->height);
+	TRACE_END("clock");
+}
+
+// Formats the current time and redraws the outputs if the text changed, a
+// forced refresh redraws regardless.
+static void refresh(struct prog_state *state, bool force) {
+	struct clockface *clock = &state->clockface;
+	time_t now = time(NULL);
+	struct tm tm;
+	if (!localtime_r(&now, &tm)) {
+		return;
+	}
+	char time_text[sizeof(clock->time)], date_text[sizeof(clock->date)];
+	format(state->config.clock_format, &tm, time_text, sizeof(time_text));
+	format(date_format(state), &tm, date_text, sizeof(date_text));
+	if (!force && strcmp(time_text, clock->time) == 0 &&
+	    strcmp(date_text, clock->date) == 0) {
+		return;
+	}
+	memcpy(clock->time, time_text, sizeof(clock->time));
+	memcpy(clock->date, date_text, sizeof(clock->date));
+
+	struct output_state *output;
+	wl_list_for_each(output, &state->outputs, link) {
+		clockface_draw(output);
+	}
+}
+
+// Armed for the next wall clock boundary and repeating from there. The
+// period divides a minute, so the zone offset never shifts the boundary.
+// A clock that is set, or a resume from suspend, cancels the timer instead
+// of leaving it waiting for a time that has passed or moved.
+static void arm(struct prog_state *state) {
+	struct clockface *clock = &state->clockface;
+	time_t period = state->config.clock_seconds ? 1 : 60;
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	struct itimerspec spec = {
+	    .it_value = {.tv_sec = (now.tv_sec / period + 1) * period},
+	    .it_interval = {.tv_sec = period},
+	};
+	if (timerfd_settime(clock->timer_fd,
+			    TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &spec,
+			    NULL) != 0) {
+		log_warn(LOG_CAT_RENDER, "clock: could not arm the timer");
+	}
+}
+
+static void handle_timer(struct prog_state *state, int fd, short revents) {
+	uint64_t expirations;
+	if (read(fd, &expirations, sizeof(expirations)) < 0) {
+		if (errno != ECANCELED) {
+			return;
+		}
+		log_debug(LOG_CAT_RENDER, "clock: time changed");
+		refresh(state, true);
+		arm(state);
+		return;
+	}
+	refresh(state, false);
+}
+
+static void handle_tz(struct prog_state *state, int fd, short revents) {
+	char events[4096]
+	    __attribute__((aligned(__alignof__(struct inotify_event))));
+	bool changed = false;
+	ssize_t len;
+	while ((len = read(fd, events, sizeof(events))) > 0) {
+		for (char *p = events; p < events + len;) {
+			const struct inotify_event *event = (void *)p;
+			if (event->len && strcmp(event->name, TZ_LINK) == 0) {
+				changed = true;
+			}
+			p += sizeof(*event) + event->len;
+		}
+	}
+	if (changed) {
+		log_debug(LOG_CAT_RENDER, "clock: time zone changed");
+		tzset();
+		refresh(state, true);
+	}
+}
+
+static void watch_tz(struct prog_state *state) {
+	struct clockface *clock = &state->clockface;
+	int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fd < 0) {
+		return;
+	}
+	// the link is replaced rather than written, watch the directory
+	if (inotify_add_watch(fd, TZ_DIR,
+			      IN_CREATE | IN_MOVED_TO | IN_CLOSE_WRITE) < 0 ||
+	    loop_add_fd(&state->loop, fd, POLLIN, LOOP_SOURCE_OTHER,
+			handle_tz) != 0) {
+		log_warn(LOG_CAT_RENDER,
+			 "clock: time zone changes are not followed");
+		close(fd);
+		return;
+	}
+	clock->tz_fd = fd;
+}
+
+void clockface_start(struct prog_state *state) {
+	struct clockface *clock = &state->clockface;
+	if (!state->config.clock || clock->render) {
+		return;
+	}
+	if (!state->subcompositor) {
+		log_warn(LOG_CAT_RENDER, "clock: the compositor has no "
+					 "subsurfaces, not showing it");
+		return;
+	}
+	int fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+	clock->render = calloc(1, sizeof(*clock->render));
+	if (fd < 0 || !clock->render ||
+	    loop_add_fd(&state->loop, fd, POLLIN, LOOP_SOURCE_TIMER,
+			handle_timer) != 0) {
+		log_warn(LOG_CAT_RENDER, "clock: no timer, not showing it");
+		if (fd >= 0) {
+			close(fd);
+		}
+		free(clock->render);
+		clock->render = NULL;
+		return;
+	}
+	clock->timer_fd = fd;
+	watch_tz(state);
+	measure(state);
+	refresh(state, true);
+	arm(state);
+}
+
+void clockface_suspend(struct prog_state *state) {
+	struct clockface *clock = &state->clockface;
+	if (!clock->render) {
+		return;
+	}
+	struct itimerspec off = {0};
+	timerfd_settime(clock->timer_fd, 0, &off, NULL);
+}
+
+void clockface_resume(struct prog_state *state) {
+	if (!state->clockface.render) {
+		return;
+	}
+	refresh(state, true);
+	arm(state);
+}
+
+// the fds are closed with the rest of the loop's
+void clockface_finish(struct prog_state *state) {
+	struct clockface *clock = &state->clockface;
+	if (clock->render) {
+		render_clock_finish(clock->render);
+		free(clock->render);
+		clock->render = NULL;
+	}
+}
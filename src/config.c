@@ -0,0 +1,610 @@
+#include "config.h"
+#include <cairo.h>
+#include <errno.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <wordexp.h>
+
+#define DEFAULT_WALLPAPER "~/Pictures/lockscreen.png"
+#define MAX_SETTINGS 64
+
+static int set_string(char **field, const char *value) {
+	char *copy = strdup(value);
+	if (!copy) {
+		return -1;
+	}
+	free(*field);
+	*field = copy;
+	return 0;
+}
+
+static int parse_bool(const char *value, bool *out) {
+	if (strcasecmp(value, "true") == 0 || strcasecmp(value, "yes") == 0 ||
+	    strcasecmp(value, "on") == 0 || strcmp(value, "1") == 0) {
+		*out = true;
+		return 0;
+	}
+	if (strcasecmp(value, "false") == 0 || strcasecmp(value, "no") == 0 ||
+	    strcasecmp(value, "off") == 0 || strcmp(value, "0") == 0) {
+		*out = false;
+		return 0;
+	}
+	return -1;
+}
+
+static int parse_uint(const char *value, uint32_t *out) {
+	char *end;
+	errno = 0;
+	unsigned long parsed = strtoul(value, &end, 10);
+	if (errno || end == value || *end != '\0' || parsed > UINT32_MAX) {
+		return -1;
+	}
+	*out = parsed;
+	return 0;
+}
+
+static int apply_wallpaper(struct config *config, const char *value) {
+	free(config->wallpaper);
+	config->wallpaper = NULL;
+	if (value[0] == '\0' || strcmp(value, "none") == 0) {
+		return 0;
+	}
+	wordexp_t result;
+	if (wordexp(value, &result, WRDE_NOCMD | WRDE_SHOWERR) != 0) {
+		return -1;
+	}
+	int ret = result.we_wordc > 0
+		      ? set_string(&config->wallpaper, result.we_wordv[0])
+		      : -1;
+	wordfree(&result);
+	return ret;
+}
+
+static int apply_icon_font(struct config *config, const char *value) {
+	return set_string(&config->icon_font, value);
+}
+
+static int apply_icon_size(struct config *config, const char *value) {
+	return parse_uint(value, &config->icon_size) == 0 &&
+			   config->icon_size > 0
+		   ? 0
+		   : -1;
+}
+
+static int apply_decay(struct config *config, const char *value) {
+	return parse_bool(value, &config->decay_enabled);
+}
+
+static int apply_decay_interval(struct config *config, const char *value) {
+	return parse_uint(value, &config->decay_interval);
+}
+
+static int apply_idle_timeout(struct config *config, const char *value) {
+	return parse_uint(value, &config->idle_timeout);
+}
+
+static int apply_idle_warning(struct config *config, const char *value) {
+	return parse_uint(value, &config->idle_warning);
+}
+
+static int apply_power_off_after(struct config *config, const char *value) {
+	return parse_uint(value, &config->power_off_after);
+}
+
+static int apply_clock(struct config *config, const char *value) {
+	return parse_bool(value, &config->clock);
+}
+
+static int apply_clock_format(struct config *config, const char *value) {
+	return set_string(&config->clock_format, value);
+}
+
+static int apply_clock_seconds(struct config *config, const char *value) {
+	return parse_bool(value, &config->clock_seconds);
+}
+
+static int apply_hidpi(struct config *config, const char *value) {
+	return parse_bool(value, &config->hidpi);
+}
+
+static int apply_animations(struct config *config, const char *value) {
+	return parse_bool(value, &config->animations);
+}
+
+static int apply_low_memory(struct config *config, const char *value) {
+	return parse_bool(value, &config->low_memory);
+}
+
+static int apply_redraw_typing(struct config *config, const char *value) {
+	return parse_bool(value, &config->redraw_typing);
+}
+
+// an empty value turns the feature back off
+static int set_optional_string(char **field, const char *value) {
+	if (value[0] == '\0') {
+		free(*field);
+		*field = NULL;
+		return 0;
+	}
+	return set_string(field, value);
+}
+
+static int apply_date_format(struct config *config, const char *value) {
+	return set_optional_string(&config->date_format, value);
+}
+
+static int apply_pam_service(struct config *config, const char *value) {
+	return set_string(&config->pam_service, value);
+}
+
+static int apply_pam_confdir(struct config *config, const char *value) {
+	return set_optional_string(&config->pam_confdir, value);
+}
+
+static int apply_concurrent_pam(struct config *config, const char *value) {
+	return set_optional_string(&config->concurrent_pam, value);
+}
+
+static int apply_trace_file(struct config *config, const char *value) {
+	return set_optional_string(&config->trace_file, value);
+}
+
+static int apply_input_trace_file(struct config *config, const char *value) {
+	return set_optional_string(&config->input_trace_file, value);
+}
+
+static int apply_profile_startup(struct config *config, const char *value) {
+	return parse_uint(value, &config->profile_startup);
+}
+
+static int apply_loop_stats(struct config *config, const char *value) {
+	return parse_uint(value, &config->loop_stats_interval);
+}
+
+static int apply_metrics_file(struct config *config, const char *value) {
+	return set_optional_string(&config->metrics_file, value);
+}
+
+static int apply_metrics_socket(struct config *config, const char *value) {
+	return set_optional_string(&config->metrics_socket, value);
+}
+
+static int apply_log_level(struct config *config, const char *value) {
+	return log_parse_level(value, &config->log_level);
+}
+
+static int apply_hud(struct config *config, const char *value) {
+	return parse_bool(value, &config->hud);
+}
+
+static int apply_filter(struct config *config, const char *value) {
+	if (strcmp(value, "fast") == 0) {
+		config->filter = CAIRO_FILTER_FAST;
+	} else if (strcmp(value, "good") == 0) {
+		config->filter = CAIRO_FILTER_GOOD;
+	} else if (strcmp(value, "best") == 0) {
+		config->filter = CAIRO_FILTER_BEST;
+	} else {
+		return -1;
+	}
+	return 0;
+}
+
+static const char *profile_names[] = {
+    [PROFILE_LOW_POWER] = "low-power",
+    [PROFILE_BALANCED] = "balanced",
+    [PROFILE_QUALITY] = "quality",
+};
+
+const char *config_profile_name(perf_profile_t profile) {
+	return profile_names[profile];
+}
+
+static int parse_profile(const char *value, perf_profile_t *out) {
+	for (size_t i = 0; i < sizeof(profile_names) / sizeof(*profile_names);
+	     i++) {
+		if (strcmp(value, profile_names[i]) == 0) {
+			*out = i;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+// The profile decides the defaults everything else is layered on.
+static int apply_profile(struct config *config, perf_profile_t profile) {
+	config->profile = profile;
+	config->decay_enabled = true;
+	config->decay_interval = 10;
+	config->idle_warning = 10;
+	config->icon_size = 50;
+	config->log_level = LOG_LEVEL_INFO;
+	if (set_string(&config->icon_font, "JetBrainsMono Nerd Font") != 0 ||
+	    set_string(&config->clock_format, "%H:%M") != 0 ||
+	    set_string(&config->date_format, "%A, %d %B") != 0 ||
+	    set_string(&config->pam_service, "locker") != 0) {
+		return -1;
+	}
+
+	switch (profile) {
+	case PROFILE_LOW_POWER:
+		config->hidpi = false;
+		config->redraw_typing = false;
+		config->animations = false;
+		config->low_memory = true;
+		config->filter = CAIRO_FILTER_FAST;
+		return apply_wallpaper(config, "none");
+	case PROFILE_BALANCED:
+		config->hidpi = false;
+		config->redraw_typing = true;
+		config->animations = true;
+		config->low_memory = false;
+		config->filter = CAIRO_FILTER_GOOD;
+		return apply_wallpaper(config, DEFAULT_WALLPAPER);
+	case PROFILE_QUALITY:
+		config->hidpi = true;
+		config->redraw_typing = true;
+		config->animations = true;
+		config->low_memory = false;
+		config->filter = CAIRO_FILTER_BEST;
+		return apply_wallpaper(config, DEFAULT_WALLPAPER);
+	}
+	return -1;
+}
+
+struct option_def {
+	const char *key;  // "section.name" in the config file, NULL for
+			  // options only the command line may set
+	const char *flag; // long command line option
+	const char *implied; // value of flags that take no argument
+	int (*apply)(struct config *config, const char *value);
+	const char *help;
+};
+
+static const struct option_def options[] = {
+    {"general.profile", "profile", NULL, NULL,
+     "low-power, balanced (default) or quality"},
+    {"general.wallpaper", "wallpaper", NULL, apply_wallpaper,
+     "image to show, 'none' for a plain background"},
+    {"general.decay", "no-decay", "false", apply_decay,
+     "keep the typing state until Escape"},
+    {"general.decay_interval", "decay-interval", NULL, apply_decay_interval,
+     "seconds without input before the password is cleared"},
+    {"idle.timeout", "idle", NULL, apply_idle_timeout,
+     "stay in the background and lock after this many idle seconds"},
+    {"idle.warning", "idle-warning", NULL, apply_idle_warning,
+     "seconds before the idle lock to prepare its frames (10)"},
+    {"power.off_after", "power-off-after", NULL, apply_power_off_after,
+     "seconds without input on the lock screen before outputs go off"},
+    {"clock.enabled", "clock", "true", apply_clock,
+     "show the time and date above the icon"},
+    {"clock.enabled", "no-clock", "false", apply_clock, NULL},
+    {"clock.format", "clock-format", NULL, apply_clock_format,
+     "strftime format of the time (%H:%M)"},
+    {"clock.date_format", "date-format", NULL, apply_date_format,
+     "strftime format of the date, empty to hide it"},
+    {"clock.seconds", "clock-seconds", "true", apply_clock_seconds,
+     "update every second, for formats that show them"},
+    {"auth.service", "pam-service", NULL, apply_pam_service,
+     "PAM service checking the password (locker)"},
+    // picks which PAM stack unlocks, not something a config file decides
+    {NULL, "pam-confdir", NULL, apply_pam_confdir,
+     "read PAM services from this directory instead of /etc/pam.d"},
+    {"auth.concurrent_service", "concurrent-pam", NULL, apply_concurrent_pam,
+     "PAM service without a password (fingerprint) run alongside it"},
+    {"icon.font", "icon-font", NULL, apply_icon_font,
+     "font family used when the icon is not embedded"},
+    {"icon.size", "icon-size", NULL, apply_icon_size, "icon size in pixels"},
+    {"render.hidpi", "hidpi", "true", apply_hidpi,
+     "render at the output scale"},
+    {"render.hidpi", "no-hidpi", "false", apply_hidpi, NULL},
+    {"render.redraw_typing", "no-typing-icon", "false", apply_redraw_typing,
+     "keep the locked icon while typing, saves a repaint"},
+    {"render.animations", "animations", "true", apply_animations,
+     "animate a ring around the icon while typing and authenticating"},
+    {"render.animations", "no-animations", "false", apply_animations, NULL},
+    {"render.low_memory", "low-memory", "true", apply_low_memory,
+     "free the decoded wallpaper once drawn, trim under memory pressure"},
+    {"render.low_memory", "no-low-memory", "false", apply_low_memory, NULL},
+    {"render.filter", "filter", NULL, apply_filter,
+     "wallpaper scaling filter: fast, good or best"},
+    {"debug.log_level", "log-level", NULL, apply_log_level,
+     "error, warn, info (default) or debug"},
+    {"debug.hud", "hud", "true", apply_hud,
+     "overlay render times and buffer use in a corner"},
+    {"debug.trace", "trace", NULL, apply_trace_file,
+     "record a Chrome trace, written on SIGUSR1 and at exit"},
+    {"debug.record_input", "record-input", NULL, apply_input_trace_file,
+     "record key events, minus the password, for input-replay"},
+    {"debug.loop_stats", "loop-stats", NULL, apply_loop_stats,
+     "seconds between wakeup and CPU reports, 0 reports at exit only"},
+    // unlocks without a password, so a config file must not turn it on
+    {NULL, "profile-startup", NULL, apply_profile_startup,
+     "lock and immediately unlock N times, print time-to-lock stats"},
+    {"metrics.file", "metrics-file", NULL, apply_metrics_file,
+     "write Prometheus metrics to this file at unlock"},
+    {"metrics.socket", "metrics-socket", NULL, apply_metrics_socket,
+     "serve Prometheus metrics on this UNIX socket"},
+};
+
+#define OPTION_COUNT (sizeof(options) / sizeof(*options))
+
+struct setting {
+	const struct option_def *option;
+	char *value;
+	char origin[64];
+};
+
+struct settings {
+	struct setting items[MAX_SETTINGS];
+	size_t count;
+};
+
+static int settings_add(struct settings *settings,
+			const struct option_def *option, const char *value,
+			const char *origin) {
+	if (settings->count == MAX_SETTINGS) {
+		fprintf(stderr, "config: too many settings\n");
+		return -1;
+	}
+	struct setting *setting = &settings->items[settings->count];
+	setting->option = option;
+	setting->value = strdup(value);
+	snprintf(setting->origin, sizeof(setting->origin), "%s", origin);
+	if (!setting->value) {
+		return -1;
+	}
+	settings->count++;
+	return 0;
+}
+
+static void settings_clear(struct settings *settings) {
+	for (size_t i = 0; i < settings->count; i++) {
+		free(settings->items[i].value);
+	}
+	settings->count = 0;
+}
+
+static char *trim(char *s) {
+	while (*s == ' ' || *s == '\t') {
+		s++;
+	}
+	char *end = s + strlen(s);
+	while (end > s && (end[-1] == ' ' || end[-1] == '\t' ||
+			   end[-1] == '\n' || end[-1] == '\r')) {
+		*--end = '\0';
+	}
+	return s;
+}
+
+static const struct option_def *find_key(const char *key) {
+	for (size_t i = 0; i < OPTION_COUNT; i++) {
+		if (options[i].key && strcmp(options[i].key, key) == 0) {
+			return &options[i];
+		}
+	}
+	return NULL;
+}
+
+static int read_file(const char *path, bool required,
+		     struct settings *settings) {
+	FILE *file = fopen(path, "r");
+	if (!file) {
+		if (!required && errno == ENOENT) {
+			return 0;
+		}
+		fprintf(stderr, "config: cannot open %s: %s\n", path,
+			strerror(errno));
+		return -1;
+	}
+
+	char line[1024], section[64] = "";
+	int lineno = 0, ret = 0;
+	while (ret == 0 && fgets(line, sizeof(line), file)) {
+		lineno++;
+		char *s = trim(line);
+		if (*s == '\0' || *s == '#' || *s == ';') {
+			continue;
+		}
+		if (*s == '[') {
+			char *end = strchr(s, ']');
+			if (!end) {
+				fprintf(stderr, "config: %s:%d: bad section\n",
+					path, lineno);
+				ret = -1;
+				continue;
+			}
+			*end = '\0';
+			snprintf(section, sizeof(section), "%s", trim(s + 1));
+			continue;
+		}
+
+		char *eq = strchr(s, '=');
+		if (!eq) {
+			fprintf(stderr, "config: %s:%d: expected key = value\n",
+				path, lineno);
+			ret = -1;
+			continue;
+		}
+		*eq = '\0';
+		char key[160], origin[64];
+		snprintf(key, sizeof(key), "%s.%s", section, trim(s));
+		const struct option_def *option = find_key(key);
+		if (!option) {
+			fprintf(stderr, "config: %s:%d: unknown key '%s'\n",
+				path, lineno, key);
+			ret = -1;
+			continue;
+		}
+		snprintf(origin, sizeof(origin), "line %d", lineno);
+		ret = settings_add(settings, option, trim(eq + 1), origin);
+	}
+	fclose(file);
+	return ret;
+}
+
+static void usage(const char *argv0) {
+	printf("usage: %s [options]\n\n"
+	       "  -c, --config FILE          config file (default "
+	       "$XDG_CONFIG_HOME/locker/config)\n",
+	       argv0);
+	for (size_t i = 0; i < OPTION_COUNT; i++) {
+		if (!options[i].help) {
+			continue;
+		}
+		char flag[48];
+		snprintf(flag, sizeof(flag), "--%s%s", options[i].flag,
+			 options[i].implied ? "" : " VALUE");
+		printf("      %-24s %s\n", flag, options[i].help);
+	}
+	printf("  -h, --help                 show this help\n");
+}
+
+static char *default_config_path(void) {
+	const char *xdg = getenv("XDG_CONFIG_HOME");
+	const char *home = getenv("HOME");
+	char path[4096];
+	if (xdg && xdg[0]) {
+		snprintf(path, sizeof(path), "%s/locker/config", xdg);
+	} else if (home) {
+		snprintf(path, sizeof(path), "%s/.config/locker/config", home);
+	} else {
+		return NULL;
+	}
+	return strdup(path);
+}
+
+int config_load(struct config *config, int argc, char **argv) {
+	struct option long_options[OPTION_COUNT + 3];
+	for (size_t i = 0; i < OPTION_COUNT; i++) {
+		long_options[i] = (struct option){
+		    options[i].flag,
+		    options[i].implied ? no_argument : required_argument,
+		    NULL, 256 + (int)i};
+	}
+	long_options[OPTION_COUNT] =
+	    (struct option){"config", required_argument, NULL, 'c'};
+	long_options[OPTION_COUNT + 1] =
+	    (struct option){"help", no_argument, NULL, 'h'};
+	long_options[OPTION_COUNT + 2] = (struct option){0};
+
+	// command line first, it decides which file to read and wins over it
+	struct settings cli = {0}, file = {0};
+	char *config_path = NULL;
+	bool config_required = false;
+	int ret = 0, opt;
+	optind = 1;
+	while (ret == 0 && (opt = getopt_long(argc, argv, "c:p:w:h",
+					      long_options, NULL)) != -1) {
+		switch (opt) {
+		case 'c':
+			free(config_path);
+			config_path = strdup(optarg);
+			config_required = true;
+			break;
+		case 'p':
+			ret = settings_add(&cli, find_key("general.profile"),
+					   optarg, "--profile");
+			break;
+		case 'w':
+			ret = settings_add(&cli, find_key("general.wallpaper"),
+					   optarg, "--wallpaper");
+			break;
+		case 'h':
+			usage(argv[0]);
+			free(config_path);
+			settings_clear(&cli);
+			return 1;
+		default:
+			if (opt < 256 || opt >= 256 + (int)OPTION_COUNT) {
+				usage(argv[0]);
+				ret = -1;
+				break;
+			}
+			const struct option_def *option = &options[opt - 256];
+			ret = settings_add(&cli, option,
+					   option->implied ? option->implied
+							   : optarg,
+					   option->flag);
+		}
+	}
+
+	if (ret == 0 && !config_path) {
+		config_path = default_config_path();
+	}
+	if (ret == 0 && config_path) {
+		ret = read_file(config_path, config_required, &file);
+	}
+
+	// profile first, then the file, then the command line
+	perf_profile_t profile = PROFILE_BALANCED;
+	struct settings *layers[] = {&file, &cli};
+	for (size_t l = 0; ret == 0 && l < 2; l++) {
+		for (size_t i = 0; i < layers[l]->count; i++) {
+			struct setting *setting = &layers[l]->items[i];
+			if (!setting->option->apply &&
+			    parse_profile(setting->value, &profile) != 0) {
+				fprintf(stderr, "config: unknown profile '%s'\n",
+					setting->value);
+				ret = -1;
+			}
+		}
+	}
+	if (ret == 0) {
+		ret = apply_profile(config, profile);
+	}
+	for (size_t l = 0; ret == 0 && l < 2; l++) {
+		for (size_t i = 0; ret == 0 && i < layers[l]->count; i++) {
+			struct setting *setting = &layers[l]->items[i];
+			if (!setting->option->apply) {
+				continue;
+			}
+			ret = setting->option->apply(config, setting->value);
+			if (ret != 0) {
+				fprintf(stderr,
+					"config: invalid value '%s' for %s "
+					"(%s)\n",
+					setting->value,
+					setting->option->key
+					    ? setting->option->key
+					    : setting->option->flag,
+					setting->origin);
+			}
+		}
+	}
+
+	settings_clear(&cli);
+	settings_clear(&file);
+	free(config_path);
+	return ret;
+}
+
+void config_finish(struct config *config) {
+	free(config->wallpaper);
+	free(config->icon_font);
+	free(config->clock_format);
+	free(config->date_format);
+	free(config->pam_service);
+	free(config->pam_confdir);
+	free(config->concurrent_pam);
+	free(config->trace_file);
+	free(config->input_trace_file);
+	free(config->metrics_file);
+	free(config->metrics_socket);
+	config->wallpaper = NULL;
+	config->icon_font = NULL;
+	config->clock_format = NULL;
+	config->date_format = NULL;
+	config->pam_service = NULL;
+	config->pam_confdir = NULL;
+	config->concurrent_pam = NULL;
+	config->trace_file = NULL;
+	config->input_trace_file = NULL;
+	config->metrics_file = NULL;
+	config->metrics_socket = NULL;
+}
@@ -1,141 +1,348 @@
+#include "draw.h"
+#include "image.h"
+#include "log.h"
+#include "metrics.h"
+#include "render.h"
 #include "shared_memory.h"
 #include "state.h"
+#include "theme.h"
+#include "trace.h"
 #include <cairo.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <sys/mman.h>
 #include <unistd.h>
 #include <wayland-client-protocol.h>
-#include <wordexp.h>
-
-static char *getIconAccState(auth_state_t state) {
-	switch (state) {
-	case AUTH_STATE_LOCKED:
-		return "";
-	case AUTH_STATE_SUCCESS:
-		return "";
-	case AUTH_STATE_TYPING:
-		return "";
-	case AUTH_STATE_AUTHENTICATING:
-		return "";
-	}
-	fprintf(stderr, "Some invalid state for auth_state_t\n");
-	return "";
+
+static auth_state_t displayed_icon(struct prog_state *state,
+				   auth_state_t auth_state) {
+	return render_visible_icon(auth_state, state->config.redraw_typing);
 }
 
-static void drawLock(struct prog_state *state, cairo_t *cr) {
-	char *text = getIconAccState(state->auth_state.current_state);
-	fprintf(stderr, "drawing: %s\n", text);
+int prepare_fonts(struct prog_state *state) {
+	struct config *config = &state->config;
+	// the clock and PAM messages are text, which no theme embeds
+	state->text_font = cairo_toy_font_face_create(config->icon_font,
+						      CAIRO_FONT_SLANT_NORMAL,
+						      CAIRO_FONT_WEIGHT_BOLD);
+	// an embedded theme covering the icon size needs no icon font, with
+	// hidpi the sizes depend on output scales we do not know yet
+	bool embedded = !config->hidpi && theme_has_size(config->icon_size);
+	if (embedded) {
+		log_info(LOG_CAT_RENDER,
+			 "icons embedded, the clock and PAM messages use '%s' "
+			 "through fontconfig",
+			 config->icon_font);
+	} else {
+		state->icon_font = cairo_font_face_reference(state->text_font);
+	}
+
+	// the fontconfig lookup and glyph loading happen lazily on first use,
+	// measure every icon and digit once so none of it lands on the lock
+	cairo_surface_t *surface =
+	    cairo_image_surface_create(CAIRO_FORMAT_A8, 1, 1);
+	cairo_t *cr = cairo_create(surface);
+	cairo_set_font_face(cr, state->text_font);
+	cairo_set_font_size(cr, config->icon_size);
 	cairo_text_extents_t extents;
+	cairo_text_extents(cr, "0123456789:", &extents);
+	auth_state_t states[] = {AUTH_STATE_LOCKED, AUTH_STATE_AUTHENTICATING,
+				 AUTH_STATE_SUCCESS, AUTH_STATE_TYPING};
+	for (size_t i = 0; !embedded && i < sizeof(states) / sizeof(states[0]);
+	     i++) {
+		cairo_text_extents(cr, render_icon_text(states[i]), &extents);
+	}
+	cairo_status_t status = cairo_status(cr);
+	cairo_destroy(cr);
+	cairo_surface_destroy(surface);
+	return status == CAIRO_STATUS_SUCCESS ? 0 : -1;
+}
 
-	cairo_set_source_rgb(cr, 0, 0, 0);
-	cairo_select_font_face(cr, "JetBrainsMono Nerd Font",
-			       CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_BOLD);
-	cairo_set_font_size(cr, 50);
+// Gathers what the renderer needs, waiting for startup work still in flight.
+// Only full frames need the wallpaper, icon changes repaint from backdrops
+// and do not bring back a wallpaper that was released.
+static void get_render_params(struct prog_state *state,
+			      struct render_params *params, bool full) {
+	// an output that never sent done (wl_output v1) must not leave the
+	// frame without its wallpaper
+	if (full) {
+		load_wallpaper(state);
+	}
+	TRACE_BEGIN("wait for assets");
+	cairo_surface_t *image = image_loader_wait(&state->wallpaper);
+	startup_task_join(&state->startup.fonts);
+	TRACE_END("wait for assets");
 
-	cairo_text_extents(cr, text, &extents);
+	if (full && !image && state->config.wallpaper) {
+		log_warn(LOG_CAT_RENDER, "failed to get lock_screen wallpaper");
+	}
+	*params = (struct render_params){
+	    .wallpaper = image,
+	    .filter = state->config.filter,
+	    .icon_font = state->icon_font,
+	    .icon_font_family = state->config.icon_font,
+	    .text_font = state->text_font,
+	    .icon_size = state->config.icon_size,
+	};
+}
 
-	double x = state->logical_width / 2.0 -
-		   (extents.width / 2.0 + extents.x_bearing);
-	double y = state->logical_height / 2.0 -
-		   (extents.height / 2.0 + extents.y_bearing) + 200;
+static void record_frame(struct prog_state *state, uint64_t ns,
+			 struct render_rect damage) {
+	struct frame_stats *stats = &state->frame_stats;
+	metrics_observe(METRIC_FRAME_RENDER, ns);
+	stats->last_ns = ns;
+	stats->total_ns += ns;
+	stats->max_ns = ns > stats->max_ns ? ns : stats->max_ns;
+	stats->count++;
+	stats->damage_pixels = (uint64_t)damage.width * damage.height;
+}
 
-	cairo_move_to(cr, x, y);
-	cairo_show_text(cr, text);
+// Paints the HUD over a frame that was just rendered, the stats only change
+// with frames so it never needs a commit of its own.
+static struct render_rect draw_hud(struct prog_state *state,
+				   const struct render_params *params,
+				   uint32_t width, uint32_t height,
+				   uint32_t stride, uint32_t scale,
+				   void *pixels) {
+	if (!state->config.hud) {
+		return (struct render_rect){0};
+	}
+	const struct frame_stats *stats = &state->frame_stats;
+	struct render_hud hud = {
+	    .last_ns = stats->last_ns,
+	    .avg_ns = stats->count ? stats->total_ns / stats->count : 0,
+	    .max_ns = stats->max_ns,
+	    .frames = stats->count,
+	    .damage_pixels = stats->damage_pixels,
+	};
+	struct lock_buffer *buffer;
+	wl_list_for_each(buffer, &state->buffers, link) {
+		hud.buffers++;
+		hud.buffers_busy += buffer->busy;
+	}
+	return render_hud(params, &hud, width, height, stride, scale, pixels);
 }
 
-static void drawImage(struct prog_state *state, uint32_t logical_width,
-		      uint32_t logical_height, uint32_t stride, void *pixels) {
-	cairo_surface_t *cairo_surface = cairo_image_surface_create_for_data(
-	    pixels, CAIRO_FORMAT_ARGB32, logical_width, logical_height, stride);
+static void drawImage(struct prog_state *state, struct lock_buffer *buffer,
+		      uint32_t logical_width, uint32_t logical_height,
+		      uint32_t stride, uint32_t scale, void *pixels) {
+	struct render_params params;
+	get_render_params(state, &params, true);
+	auth_state_t icon =
+	    displayed_icon(state, state->auth_state.current_state);
+	log_debug(LOG_CAT_RENDER, "drawing: %s", render_icon_text(icon));
 
-	cairo_t *cr = cairo_create(cairo_surface);
-	cairo_surface_t *image = NULL;
-	wordexp_t result;
+	uint64_t start = startup_now_ns();
+	render_frame(&params, icon, logical_width, logical_height, stride,
+		     scale, pixels);
+	record_frame(state, startup_now_ns() - start,
+		     (struct render_rect){0, 0, logical_width, logical_height});
+	draw_hud(state, &params, logical_width, logical_height, stride, scale,
+		 pixels);
+	buffer->backdrop = render_backdrop_create(&params, logical_width,
+						  logical_height, scale);
+	if (!buffer->backdrop) {
+		log_warn(LOG_CAT_RENDER, "no backdrop, icons need the "
+					 "wallpaper");
+	}
+}
 
-	//  TODO: i need to pass the wallpaper path as a command line input. ( i
-	//  can put the path in the prog_state)
-	if (wordexp("~/Pictures/lockscreen.png", &result,
-		    WRDE_NOCMD | WRDE_SHOWERR) == 0) {
-		image = cairo_image_surface_create_from_png(result.we_wordv[0]);
+void load_wallpaper(struct prog_state *state) {
+	if (state->wallpaper_started) {
+		return;
 	}
-	wordfree(&result);
+	state->wallpaper_started = true;
 
-	if (image && cairo_surface_status(image) == CAIRO_STATUS_SUCCESS) {
-		uint32_t img_width = cairo_image_surface_get_width(image);
-		uint32_t img_height = cairo_image_surface_get_height(image);
+	// decode just big enough for the largest output we know of
+	uint32_t hint_width = 0, hint_height = 0;
+	struct output_state *output;
+	wl_list_for_each(output, &state->outputs, link) {
+		// modes are in device pixels, without hidpi we render at the
+		// logical size
+		int32_t divisor = state->config.hidpi ? 1 : output->scale;
+		uint32_t width = output->mode_width / divisor;
+		uint32_t height = output->mode_height / divisor;
+		if (width > hint_width) {
+			hint_width = width;
+		}
+		if (height > hint_height) {
+			hint_height = height;
+		}
+	}
 
-		double scale_x = (double)logical_width / img_width;
-		double scale_y = (double)logical_height / img_height;
+	// the embedded background only stands in for a configured wallpaper
+	// that failed, "none" really means a plain background
+	if (state->config.wallpaper) {
+		state->wallpaper.fallback_data = theme_background;
+		state->wallpaper.fallback_size = theme_background_size;
+	}
+	image_loader_start(&state->wallpaper, state->config.wallpaper,
+			   hint_width, hint_height);
+}
 
-		cairo_save(cr);
-		cairo_scale(cr, scale_x, scale_y);
-		cairo_set_source_surface(cr, image, 0, 0);
-		cairo_paint(cr);
-		cairo_restore(cr);
-	} else {
-		fprintf(stderr, "failed to get lock_screen wallpaper\n");
-		cairo_set_source_rgb(cr, 0.2, 0.2, 0.2);
-		cairo_paint(cr);
+void maybe_load_wallpaper(struct prog_state *state) {
+	// an idle lock decodes when its frames are prepared instead
+	if (state->wallpaper_started || !state->registry_done ||
+	    !state->session_lock) {
+		return;
 	}
+	struct output_state *output;
+	wl_list_for_each(output, &state->outputs, link) {
+		if (!output->done) {
+			return;
+		}
+	}
+	load_wallpaper(state);
+}
 
-	drawLock(state, cr);
+void release_wallpaper(struct prog_state *state) {
+	if (!state->wallpaper_started) {
+		return;
+	}
+	// a surface still waiting for its first frame would decode it again
+	struct output_state *output;
+	wl_list_for_each(output, &state->outputs, link) {
+		if (output->lock_surface && !output->width) {
+			return;
+		}
+	}
+	image_loader_finish(&state->wallpaper);
+	state->wallpaper_started = false;
+	log_debug(LOG_CAT_RENDER, "released the decoded wallpaper");
+}
 
-	cairo_surface_destroy(image);
-	cairo_destroy(cr);
-	cairo_surface_destroy(cairo_surface);
+static void buffer_release(void *data, struct wl_buffer *wl_buffer) {
+	struct lock_buffer *buffer = data;
+	buffer->busy = false;
 }
 
-void createBuffer(uint32_t width, uint32_t height, uint32_t stride,
-		  struct prog_state *state) {
-	size_t shm_pool_size = height * stride * 2;
+static const struct wl_buffer_listener buffer_listener = {
+    .release = buffer_release,
+};
+
+struct lock_buffer *createBuffer(uint32_t width, uint32_t height,
+				 uint32_t stride, uint32_t scale,
+				 struct prog_state *state) {
+	// one frame, redraws repaint it in place
+	size_t shm_pool_size = (size_t)height * stride;
 
 	int fd = allocate_shm_file(shm_pool_size);
-	state->pool_data = mmap(NULL, shm_pool_size, PROT_READ | PROT_WRITE,
-				MAP_SHARED, fd, 0);
-	state->pool = wl_shm_create_pool(state->shm, fd, shm_pool_size);
+	if (fd < 0) {
+		return NULL;
+	}
+	uint8_t *pool_data = mmap(NULL, shm_pool_size, PROT_READ | PROT_WRITE,
+				  MAP_SHARED, fd, 0);
+	if (pool_data == MAP_FAILED) {
+		close(fd);
+		return NULL;
+	}
+
+	struct lock_buffer *buffer = calloc(1, sizeof(*buffer));
+	if (!buffer) {
+		munmap(pool_data, shm_pool_size);
+		close(fd);
+		return NULL;
+	}
+	buffer->width = width;
+	buffer->height = height;
+	buffer->stride = stride;
+	buffer->scale = scale;
+	buffer->shm_pool_size = shm_pool_size;
+	buffer->pool_data = pool_data;
+	buffer->pool = wl_shm_create_pool(state->shm, fd, shm_pool_size);
 
 	int index = 0;
 	int offset = height * stride * index;
-	state->buffer = wl_shm_pool_create_buffer(
-	    state->pool, offset, width, height, stride, WL_SHM_FORMAT_ARGB8888);
+	buffer->buffer = wl_shm_pool_create_buffer(
+	    buffer->pool, offset, width, height, stride, WL_SHM_FORMAT_ARGB8888);
+	wl_buffer_add_listener(buffer->buffer, &buffer_listener, buffer);
 
-	uint32_t *pixels = (uint32_t *)&state->pool_data[offset];
-	drawImage(state, width, height, stride, pixels);
+	uint32_t *pixels = (uint32_t *)&buffer->pool_data[offset];
+	TRACE_BEGIN("draw");
+	drawImage(state, buffer, width, height, stride, scale, pixels);
+	TRACE_END("draw");
 
 	close(fd);
+	wl_list_insert(&state->buffers, &buffer->link);
+	metrics_count(METRIC_BUFFERS_ALLOCATED);
+	return buffer;
+}
+
+void destroyBuffer(struct lock_buffer *buffer) {
+	wl_list_remove(&buffer->link);
+	render_backdrop_destroy(buffer->backdrop);
+	wl_buffer_destroy(buffer->buffer);
+	wl_shm_pool_destroy(buffer->pool);
+	munmap(buffer->pool_data, buffer->shm_pool_size);
+	free(buffer);
 }
 
 void redraw_surface(struct prog_state *state) {
-	fprintf(stderr, "request redraw of surface\n");
-	uint32_t stride = state->logical_width * 4;
-	if (!state->buffer) {
-		createBuffer(state->logical_width, state->logical_height,
-			     stride, state);
-		wl_surface_attach(state->surface, state->buffer, 0, 0);
-		wl_surface_commit(state->surface);
-		fprintf(stderr,
-			"successful redraw of surface with new buffer\n");
-		return;
-	}
+	log_debug(LOG_CAT_RENDER, "request redraw of surface");
+	TRACE_BEGIN("redraw");
 
-	int index = 0;
-	int offset = state->logical_height * stride * index;
-
-	uint32_t *pixels = (uint32_t *)&state->pool_data[offset];
-	drawImage(state, state->logical_width, state->logical_height, stride,
-		  pixels);
-	wl_surface_damage_buffer(state->surface, 0, 0, state->logical_width,
-				 state->logical_height);
-	wl_surface_commit(state->surface);
-	fprintf(stderr, "successful redraw of surface\n");
+	struct render_params params;
+	get_render_params(state, &params, false);
+	auth_state_t icon =
+	    displayed_icon(state, state->auth_state.current_state);
+	log_debug(LOG_CAT_RENDER, "drawing: %s", render_icon_text(icon));
+
+	// a state change only swaps the icon: repaint its box in every
+	// distinct buffer once, then hand that damage to each output sharing it
+	struct lock_buffer *buffer;
+	wl_list_for_each(buffer, &state->buffers, link) {
+		int index = 0;
+		int offset = buffer->height * buffer->stride * index;
+
+		uint32_t *pixels = (uint32_t *)&buffer->pool_data[offset];
+		params.backdrop = buffer->backdrop;
+		TRACE_BEGIN("draw");
+		uint64_t start = startup_now_ns();
+		struct render_rect damage =
+		    render_icon(&params, icon, buffer->width, buffer->height,
+				buffer->stride, buffer->scale, pixels);
+		record_frame(state, startup_now_ns() - start, damage);
+		struct render_rect hud_damage =
+		    draw_hud(state, &params, buffer->width, buffer->height,
+			     buffer->stride, buffer->scale, pixels);
+		TRACE_END("draw");
+
+		struct output_state *output;
+		wl_list_for_each(output, &state->outputs, link) {
+			if (output->buffer != buffer) {
+				continue;
+			}
+			TRACE_BEGIN("attach and commit");
+			wl_surface_attach(output->surface, buffer->buffer, 0, 0);
+			wl_surface_damage_buffer(output->surface, damage.x,
+						 damage.y, damage.width,
+						 damage.height);
+			if (hud_damage.width > 0) {
+				wl_surface_damage_buffer(
+				    output->surface, hud_damage.x, hud_damage.y,
+				    hud_damage.width, hud_damage.height);
+			}
+			latency_commit(output, output->surface);
+			wl_surface_commit(output->surface);
+			buffer->busy = true;
+			TRACE_END("attach and commit");
+		}
+	}
+	TRACE_END("redraw");
+	log_debug(LOG_CAT_RENDER, "successful redraw of surface");
 }
 
 void change_icon_state(struct prog_state *client_state, auth_state_t state) {
-	if (client_state->auth_state.current_state != state) {
+	auth_state_t previous = client_state->auth_state.current_state;
+	if (previous != state) {
 		client_state->auth_state.current_state = state;
 
-		fprintf(stderr, "icon state:%d\n", state);
-		redraw_surface(client_state);
+		log_debug(LOG_CAT_INPUT, "icon state:%d", state);
+		// states that look the same on screen do not need a frame
+		if (displayed_icon(client_state, previous) !=
+		    displayed_icon(client_state, state)) {
+			redraw_surface(client_state);
+		}
 	}
 }
@@ -0,0 +1,423 @@
+#include "image.h"
+#include <cairo.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef HAVE_JPEG
+#include <jpeglib.h>
+#endif
+#ifdef HAVE_WEBP
+#include <webp/decode.h>
+#endif
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define IMAGE_LITTLE_ENDIAN 1
+#else
+#define IMAGE_LITTLE_ENDIAN 0
+#endif
+
+// Shrinks width/height (keeping the aspect ratio) to the smallest size that
+// still covers the hint. Never scales up.
+static void scale_to_cover(uint32_t *width, uint32_t *height,
+			   uint32_t hint_width, uint32_t hint_height) {
+	if (hint_width == 0 || hint_height == 0) {
+		return;
+	}
+	double factor_x = (double)hint_width / *width;
+	double factor_y = (double)hint_height / *height;
+	double factor = factor_x > factor_y ? factor_x : factor_y;
+	if (factor >= 1.0) {
+		return;
+	}
+	*width = (uint32_t)(*width * factor + 0.999);
+	*height = (uint32_t)(*height * factor + 0.999);
+}
+
+static uint32_t premultiply(uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
+	if (a != 255) {
+		r = (r * a + 127) / 255;
+		g = (g * a + 127) / 255;
+		b = (b * a + 127) / 255;
+	}
+	return (uint32_t)a << 24 | (uint32_t)r << 16 | (uint32_t)g << 8 | b;
+}
+
+struct memory_reader {
+	const uint8_t *data;
+	size_t size;
+	size_t pos;
+};
+
+static cairo_status_t read_memory(void *closure, unsigned char *data,
+				  unsigned int length) {
+	struct memory_reader *reader = closure;
+	if (reader->size - reader->pos < length) {
+		return CAIRO_STATUS_READ_ERROR;
+	}
+	memcpy(data, reader->data + reader->pos, length);
+	reader->pos += length;
+	return CAIRO_STATUS_SUCCESS;
+}
+
+static cairo_surface_t *decode_png(const uint8_t *data, size_t size) {
+	struct memory_reader reader = {.data = data, .size = size};
+	return cairo_image_surface_create_from_png_stream(read_memory, &reader);
+}
+
+/*
+ * QOI, "The Quite OK Image Format" by Dominic Szablewski.
+ * Specification: https://qoiformat.org/qoi-specification.pdf
+ */
+static uint32_t read_be32(const uint8_t *p) {
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 |
+	       (uint32_t)p[2] << 8 | p[3];
+}
+
+static cairo_surface_t *decode_qoi(const uint8_t *data, size_t size) {
+	const size_t header_size = 14, padding_size = 8;
+	if (size < header_size + padding_size) {
+		return NULL;
+	}
+	uint32_t width = read_be32(data + 4);
+	uint32_t height = read_be32(data + 8);
+	uint8_t channels = data[12];
+	if (width == 0 || height == 0 || width > 32767 || height > 32767 ||
+	    (channels != 3 && channels != 4)) {
+		return NULL;
+	}
+
+	cairo_surface_t *surface = cairo_image_surface_create(
+	    channels == 4 ? CAIRO_FORMAT_ARGB32 : CAIRO_FORMAT_RGB24, width,
+	    height);
+	if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
+		cairo_surface_destroy(surface);
+		return NULL;
+	}
+	cairo_surface_flush(surface);
+	uint8_t *out = cairo_image_surface_get_data(surface);
+	int stride = cairo_image_surface_get_stride(surface);
+
+	uint8_t index[64][4] = {{0}};
+	uint8_t px[4] = {0, 0, 0, 255}; // r, g, b, a
+	size_t p = header_size;
+	size_t end = size - padding_size;
+	uint32_t run = 0;
+
+	for (uint32_t y = 0; y < height; y++) {
+		uint32_t *row = (uint32_t *)(out + (size_t)y * stride);
+		for (uint32_t x = 0; x < width; x++) {
+			if (run > 0) {
+				run--;
+			} else if (p < end) {
+				uint8_t b1 = data[p++];
+				size_t payload = 0;
+				if (b1 == 0xfe) {
+					payload = 3;
+				} else if (b1 == 0xff) {
+					payload = 4;
+				} else if ((b1 & 0xc0) == 0x80) {
+					payload = 1;
+				}
+				if (end - p < payload) {
+					// truncated, not a run or index op
+					cairo_surface_destroy(surface);
+					return NULL;
+				}
+				if (b1 == 0xfe) {
+					memcpy(px, data + p, 3);
+					p += 3;
+				} else if (b1 == 0xff) {
+					memcpy(px, data + p, 4);
+					p += 4;
+				} else if ((b1 & 0xc0) == 0x00) {
+					memcpy(px, index[b1], 4);
+				} else if ((b1 & 0xc0) == 0x40) {
+					px[0] += ((b1 >> 4) & 0x03) - 2;
+					px[1] += ((b1 >> 2) & 0x03) - 2;
+					px[2] += (b1 & 0x03) - 2;
+				} else if ((b1 & 0xc0) == 0x80) {
+					uint8_t b2 = data[p++];
+					int vg = (b1 & 0x3f) - 32;
+					px[0] += vg - 8 + ((b2 >> 4) & 0x0f);
+					px[1] += vg;
+					px[2] += vg - 8 + (b2 & 0x0f);
+				} else if ((b1 & 0xc0) == 0xc0) {
+					run = b1 & 0x3f;
+				}
+				uint32_t hash = (px[0] * 3 + px[1] * 5 +
+						 px[2] * 7 + px[3] * 11) %
+						64;
+				memcpy(index[hash], px, 4);
+			}
+			row[x] = premultiply(px[0], px[1], px[2],
+					     channels == 4 ? px[3] : 255);
+		}
+	}
+
+	cairo_surface_mark_dirty(surface);
+	return surface;
+}
+
+#ifdef HAVE_JPEG
+struct jpeg_error {
+	struct jpeg_error_mgr mgr;
+	jmp_buf jump;
+};
+
+static void jpeg_error_exit(j_common_ptr cinfo) {
+	struct jpeg_error *error = (struct jpeg_error *)cinfo->err;
+	(*cinfo->err->output_message)(cinfo);
+	longjmp(error->jump, 1);
+}
+
+static cairo_surface_t *decode_jpeg(const uint8_t *data, size_t size,
+				    uint32_t hint_width, uint32_t hint_height) {
+	struct jpeg_decompress_struct cinfo;
+	struct jpeg_error error;
+	cairo_surface_t *volatile surface = NULL;
+	JSAMPLE *volatile row_buffer = NULL;
+
+	cinfo.err = jpeg_std_error(&error.mgr);
+	error.mgr.error_exit = jpeg_error_exit;
+	if (setjmp(error.jump)) {
+		jpeg_destroy_decompress(&cinfo);
+		cairo_surface_destroy(surface);
+		free(row_buffer);
+		return NULL;
+	}
+
+	jpeg_create_decompress(&cinfo);
+	jpeg_mem_src(&cinfo, (unsigned char *)data, size);
+	jpeg_read_header(&cinfo, TRUE);
+
+	// DCT-domain downscaling: pick the smallest n/8 that still covers the
+	// hint so most of the IDCT work is never done
+	cinfo.scale_num = 8;
+	cinfo.scale_denom = 8;
+	if (hint_width > 0 && hint_height > 0) {
+		for (unsigned int n = 1; n < 8; n++) {
+			if ((cinfo.image_width * n + 7) / 8 >= hint_width &&
+			    (cinfo.image_height * n + 7) / 8 >= hint_height) {
+				cinfo.scale_num = n;
+				break;
+			}
+		}
+	}
+#ifdef JCS_EXTENSIONS
+	cinfo.out_color_space = IMAGE_LITTLE_ENDIAN ? JCS_EXT_BGRX
+						    : JCS_EXT_XRGB;
+#else
+	cinfo.out_color_space = JCS_RGB;
+#endif
+	jpeg_start_decompress(&cinfo);
+
+	surface = cairo_image_surface_create(
+	    CAIRO_FORMAT_RGB24, cinfo.output_width, cinfo.output_height);
+	if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
+		longjmp(error.jump, 1);
+	}
+	cairo_surface_flush(surface);
+	uint8_t *out = cairo_image_surface_get_data(surface);
+	int stride = cairo_image_surface_get_stride(surface);
+
+#ifndef JCS_EXTENSIONS
+	row_buffer = malloc((size_t)cinfo.output_width * 3);
+	if (!row_buffer) {
+		longjmp(error.jump, 1);
+	}
+#endif
+	while (cinfo.output_scanline < cinfo.output_height) {
+		uint8_t *dest = out + (size_t)cinfo.output_scanline * stride;
+#ifdef JCS_EXTENSIONS
+		JSAMPROW row = dest;
+		jpeg_read_scanlines(&cinfo, &row, 1);
+#else
+		JSAMPROW row = row_buffer;
+		jpeg_read_scanlines(&cinfo, &row, 1);
+		uint32_t *pixels = (uint32_t *)dest;
+		for (JDIMENSION x = 0; x < cinfo.output_width; x++) {
+			pixels[x] = premultiply(row[x * 3], row[x * 3 + 1],
+						row[x * 3 + 2], 255);
+		}
+#endif
+	}
+
+	jpeg_finish_decompress(&cinfo);
+	jpeg_destroy_decompress(&cinfo);
+	free(row_buffer);
+	cairo_surface_mark_dirty(surface);
+	return surface;
+}
+#endif
+
+#ifdef HAVE_WEBP
+static cairo_surface_t *decode_webp(const uint8_t *data, size_t size,
+				    uint32_t hint_width, uint32_t hint_height) {
+	WebPDecoderConfig config;
+	if (!WebPInitDecoderConfig(&config) ||
+	    WebPGetFeatures(data, size, &config.input) != VP8_STATUS_OK) {
+		return NULL;
+	}
+
+	uint32_t width = config.input.width;
+	uint32_t height = config.input.height;
+	scale_to_cover(&width, &height, hint_width, hint_height);
+	if (width != (uint32_t)config.input.width) {
+		config.options.use_scaling = 1;
+		config.options.scaled_width = width;
+		config.options.scaled_height = height;
+	}
+	config.options.use_threads = 1;
+
+	cairo_surface_t *surface =
+	    cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+	if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
+		cairo_surface_destroy(surface);
+		return NULL;
+	}
+	cairo_surface_flush(surface);
+	int stride = cairo_image_surface_get_stride(surface);
+
+	// premultiplied output straight into the cairo surface
+	config.output.colorspace = IMAGE_LITTLE_ENDIAN ? MODE_bgrA : MODE_Argb;
+	config.output.is_external_memory = 1;
+	config.output.u.RGBA.rgba = cairo_image_surface_get_data(surface);
+	config.output.u.RGBA.stride = stride;
+	config.output.u.RGBA.size = (size_t)stride * height;
+
+	VP8StatusCode status = WebPDecode(data, size, &config);
+	WebPFreeDecBuffer(&config.output);
+	if (status != VP8_STATUS_OK) {
+		cairo_surface_destroy(surface);
+		return NULL;
+	}
+	cairo_surface_mark_dirty(surface);
+	return surface;
+}
+#endif
+
+cairo_surface_t *image_decode_memory(const uint8_t *data, size_t size,
+				     uint32_t hint_width,
+				     uint32_t hint_height) {
+	cairo_surface_t *image = NULL;
+
+	if (size >= 8 && memcmp(data, "\x89PNG\r\n\x1a\n", 8) == 0) {
+		image = decode_png(data, size);
+	} else if (size >= 4 && memcmp(data, "qoif", 4) == 0) {
+		image = decode_qoi(data, size);
+	} else if (size >= 3 && memcmp(data, "\xff\xd8\xff", 3) == 0) {
+#ifdef HAVE_JPEG
+		image = decode_jpeg(data, size, hint_width, hint_height);
+#else
+		fprintf(stderr, "built without JPEG support\n");
+#endif
+	} else if (size >= 12 && memcmp(data, "RIFF", 4) == 0 &&
+		   memcmp(data + 8, "WEBP", 4) == 0) {
+#ifdef HAVE_WEBP
+		image = decode_webp(data, size, hint_width, hint_height);
+#else
+		fprintf(stderr, "built without WebP support\n");
+#endif
+	} else {
+		fprintf(stderr, "unknown image format\n");
+	}
+
+	if (image && cairo_surface_status(image) != CAIRO_STATUS_SUCCESS) {
+		cairo_surface_destroy(image);
+		image = NULL;
+	}
+	return image;
+}
+
+cairo_surface_t *image_decode_file(const char *path, uint32_t hint_width,
+				   uint32_t hint_height) {
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return NULL;
+	}
+	struct stat st;
+	if (fstat(fd, &st) < 0 || st.st_size == 0) {
+		close(fd);
+		return NULL;
+	}
+
+	size_t size = st.st_size;
+	uint8_t *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		return NULL;
+	}
+	posix_madvise(data, size, POSIX_MADV_SEQUENTIAL);
+
+	cairo_surface_t *image =
+	    image_decode_memory(data, size, hint_width, hint_height);
+	munmap(data, size);
+	return image;
+}
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void *image_loader_run(void *data) {
+	struct image_loader *loader = data;
+	loader->start_ns = now_ns();
+	if (loader->path) {
+		loader->image = image_decode_file(
+		    loader->path, loader->hint_width, loader->hint_height);
+	}
+	if (!loader->image && loader->fallback_size > 0) {
+		loader->image = image_decode_memory(
+		    loader->fallback_data, loader->fallback_size,
+		    loader->hint_width, loader->hint_height);
+	}
+	loader->end_ns = now_ns();
+	return NULL;
+}
+
+int image_loader_start(struct image_loader *loader, const char *path,
+		       uint32_t hint_width, uint32_t hint_height) {
+	loader->path = path ? strdup(path) : NULL;
+	loader->hint_width = hint_width;
+	loader->hint_height = hint_height;
+	loader->image = NULL;
+	if (!loader->path && loader->fallback_size == 0) {
+		return -1;
+	}
+	if (pthread_create(&loader->thread, NULL, image_loader_run, loader) !=
+	    0) {
+		// decode inline rather than not at all
+		image_loader_run(loader);
+		return 0;
+	}
+	loader->running = true;
+	return 0;
+}
+
+cairo_surface_t *image_loader_wait(struct image_loader *loader) {
+	if (loader->running) {
+		uint64_t start = now_ns();
+		pthread_join(loader->thread, NULL);
+		loader->wait_ns = now_ns() - start;
+		loader->running = false;
+	}
+	return loader->image;
+}
+
+void image_loader_finish(struct image_loader *loader) {
+	image_loader_wait(loader);
+	cairo_surface_destroy(loader->image);
+	loader->image = NULL;
+	free(loader->path);
+	loader->path = NULL;
+}
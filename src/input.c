@@ -0,0 +1,55 @@
+#include "input.h"
+#include "secret.h"
+#include <stdint.h>
+#include <string.h>
+#include <xkbcommon/xkbcommon-keysyms.h>
+
+bool input_key_types_text(xkb_keysym_t sym, int len) {
+	return len > 0 && sym != XKB_KEY_Escape && sym != XKB_KEY_Return &&
+	       sym != XKB_KEY_BackSpace;
+}
+
+void clearPasswordBuffer(struct auth_state *auth_state) {
+	secret_wipe(auth_state->password_buffer, auth_state->password_len);
+	auth_state->password_pos = 0;
+}
+
+struct input_effect input_handle_key(struct auth_state *auth,
+				     xkb_keysym_t sym, const char *text,
+				     int len) {
+	struct input_effect effect = {
+	    .icon = auth->current_state,
+	};
+
+	if (sym == XKB_KEY_Escape) {
+		effect.icon = AUTH_STATE_LOCKED;
+		clearPasswordBuffer(auth);
+	} else if (sym == XKB_KEY_Return) {
+		effect.icon = AUTH_STATE_AUTHENTICATING;
+		effect.submit = true;
+		if (auth->password_pos > 0) {
+			auth->password_buffer[auth->password_pos] = '\0';
+		}
+	} else if (sym == XKB_KEY_BackSpace) {
+		// a whole character, not the last byte of its UTF-8
+		while (auth->password_pos > 0) {
+			auth->password_pos--;
+			uint8_t byte = auth->password_buffer[auth->password_pos];
+			auth->password_buffer[auth->password_pos] = '\0';
+			if ((byte & 0xc0) != 0x80) {
+				break;
+			}
+		}
+		if (auth->password_pos == 0) {
+			effect.icon = AUTH_STATE_LOCKED;
+		}
+	} else {
+		effect.icon = AUTH_STATE_TYPING;
+		if (len > 0 && auth->password_pos + len < auth->password_len - 1) {
+			memcpy(&auth->password_buffer[auth->password_pos], text,
+			       len);
+			auth->password_pos += len;
+		}
+	}
+	return effect;
+}
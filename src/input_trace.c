@@ -0,0 +1,89 @@
+#include "input_trace.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+int input_recorder_open(struct input_recorder *recorder, const char *path) {
+	recorder->file = fopen(path, "w");
+	if (!recorder->file) {
+		perror("failed to open the input trace");
+		return -1;
+	}
+	recorder->start_ns = now_ns();
+	fprintf(recorder->file, "%s\n", INPUT_TRACE_HEADER);
+	return 0;
+}
+
+static uint64_t recorder_time_us(struct input_recorder *recorder) {
+	return (now_ns() - recorder->start_ns) / 1000;
+}
+
+void input_record_key(struct input_recorder *recorder, uint32_t key,
+		      uint32_t state, bool redact) {
+	if (!recorder->file) {
+		return;
+	}
+	fprintf(recorder->file, "%" PRIu64 " key %u %u\n",
+		recorder_time_us(recorder), redact ? INPUT_REDACTED_KEY : key,
+		state);
+}
+
+void input_record_modifiers(struct input_recorder *recorder) {
+	if (!recorder->file) {
+		return;
+	}
+	fprintf(recorder->file, "%" PRIu64 " mods 0 0 0 0\n",
+		recorder_time_us(recorder));
+}
+
+void input_recorder_close(struct input_recorder *recorder) {
+	if (!recorder->file) {
+		return;
+	}
+	if (fclose(recorder->file) != 0) {
+		perror("failed to write the input trace");
+	}
+	recorder->file = NULL;
+}
+
+int input_trace_read(FILE *file, struct input_event *event) {
+	char line[256];
+	while (fgets(line, sizeof(line), file)) {
+		if (line[0] == '#' || line[0] == '\n') {
+			continue;
+		}
+		memset(event, 0, sizeof(*event));
+		char type[8];
+		int used = 0;
+		if (sscanf(line, "%" SCNu64 " %7s %n", &event->time_us, type,
+			   &used) != 2) {
+			return -1;
+		}
+		const char *args = line + used;
+		if (strcmp(type, "key") == 0) {
+			event->type = INPUT_EVENT_KEY;
+			if (sscanf(args, "%u %u", &event->key, &event->state) !=
+			    2) {
+				return -1;
+			}
+		} else if (strcmp(type, "mods") == 0) {
+			event->type = INPUT_EVENT_MODIFIERS;
+			if (sscanf(args, "%u %u %u %u", &event->depressed,
+				   &event->latched, &event->locked,
+				   &event->group) != 4) {
+				return -1;
+			}
+		} else {
+			return -1;
+		}
+		return 1;
+	}
+	return 0;
+}
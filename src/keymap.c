@@ -0,0 +1,86 @@
+#include "keymap.h"
+#include "log.h"
+#include "metrics.h"
+#include "trace.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// FNV-1a, only to skip most of the comparisons against the kept text.
+static uint64_t hash_text(const char *text, uint32_t size) {
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (uint32_t i = 0; i < size; i++) {
+		hash ^= (uint8_t)text[i];
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+struct xkb_keymap *keymap_cache_get(struct keymap_cache *cache,
+				    struct xkb_context *context,
+				    const char *text, uint32_t size) {
+	// the size sent usually counts the terminating NUL
+	size = strnlen(text, size);
+	uint64_t hash = hash_text(text, size);
+	struct keymap_cache_entry *victim = &cache->entries[0];
+	for (size_t i = 0; i < KEYMAP_CACHE_SIZE; i++) {
+		struct keymap_cache_entry *entry = &cache->entries[i];
+		if (entry->keymap && entry->hash == hash &&
+		    entry->size == size &&
+		    memcmp(entry->text, text, size) == 0) {
+			entry->last_used = ++cache->uses;
+			log_debug(LOG_CAT_INPUT, "keymap: reused (%u bytes)",
+				  size);
+			return xkb_keymap_ref(entry->keymap);
+		}
+		if (!entry->keymap ||
+		    (victim->keymap && entry->last_used < victim->last_used)) {
+			victim = entry;
+		}
+	}
+
+	TRACE_BEGIN("keymap compile");
+	uint64_t begin = now_ns();
+	struct xkb_keymap *keymap = xkb_keymap_new_from_buffer(
+	    context, text, size, XKB_KEYMAP_FORMAT_TEXT_V1,
+	    XKB_KEYMAP_COMPILE_NO_FLAGS);
+	TRACE_END("keymap compile");
+	if (!keymap) {
+		log_error(LOG_CAT_INPUT, "keymap: could not compile it");
+		return NULL;
+	}
+	metrics_count(METRIC_KEYMAP_COMPILES);
+	log_debug(LOG_CAT_INPUT, "keymap: compiled %u bytes in %.2f ms", size,
+		  (now_ns() - begin) / 1e6);
+
+	char *copy = malloc(size);
+	if (!copy) {
+		return keymap; // works, just is not kept
+	}
+	memcpy(copy, text, size);
+	xkb_keymap_unref(victim->keymap);
+	free(victim->text);
+	*victim = (struct keymap_cache_entry){
+	    .hash = hash,
+	    .size = size,
+	    .text = copy,
+	    .last_used = ++cache->uses,
+	    .keymap = xkb_keymap_ref(keymap),
+	};
+	return keymap;
+}
+
+void keymap_cache_finish(struct keymap_cache *cache) {
+	for (size_t i = 0; i < KEYMAP_CACHE_SIZE; i++) {
+		xkb_keymap_unref(cache->entries[i].keymap);
+		cache->entries[i].keymap = NULL;
+		free(cache->entries[i].text);
+		cache->entries[i].text = NULL;
+	}
+}
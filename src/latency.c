@@ -0,0 +1,175 @@
+#include "latency.h"
+#include "presentation-time-protocol.h"
+#include "state.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static uint64_t clock_now_ns(clockid_t clock) {
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void feedback_destroy(struct latency_feedback *pending) {
+	wp_presentation_feedback_destroy(pending->feedback);
+	pending->feedback = NULL;
+}
+
+static void feedback_sync_output(void *data,
+				 struct wp_presentation_feedback *feedback,
+				 struct wl_output *output) {}
+
+static void feedback_presented(void *data,
+			       struct wp_presentation_feedback *feedback,
+			       uint32_t tv_sec_hi, uint32_t tv_sec_lo,
+			       uint32_t tv_nsec, uint32_t refresh,
+			       uint32_t seq_hi, uint32_t seq_lo,
+			       uint32_t flags) {
+	struct latency_feedback *pending = data;
+	struct latency_stats *stats = pending->stats;
+	uint64_t presented_ns =
+	    (((uint64_t)tv_sec_hi << 32) | tv_sec_lo) * 1000000000 + tv_nsec;
+
+	if (presented_ns >= pending->input_ns) {
+		uint64_t us = (presented_ns - pending->input_ns) / 1000;
+		uint32_t sample = us > UINT32_MAX ? UINT32_MAX : us;
+		stats->samples[stats->count % LATENCY_SAMPLES] = sample;
+		stats->count++;
+		if (sample > stats->max) {
+			stats->max = sample;
+		}
+	}
+	feedback_destroy(pending);
+}
+
+static void feedback_discarded(void *data,
+			       struct wp_presentation_feedback *feedback) {
+	struct latency_feedback *pending = data;
+	pending->stats->discarded++;
+	feedback_destroy(pending);
+}
+
+static const struct wp_presentation_feedback_listener feedback_listener = {
+    .sync_output = feedback_sync_output,
+    .presented = feedback_presented,
+    .discarded = feedback_discarded,
+};
+
+static void presentation_clock_id(void *data,
+				  struct wp_presentation *presentation,
+				  uint32_t clk_id) {
+	struct latency *latency = data;
+	latency->clock = clk_id;
+}
+
+static const struct wp_presentation_listener presentation_listener = {
+    .clock_id = presentation_clock_id,
+};
+
+void latency_bind(struct prog_state *state, struct wl_registry *registry,
+		  uint32_t name) {
+	struct latency *latency = &state->latency;
+	latency->clock = CLOCK_MONOTONIC;
+	latency->presentation =
+	    wl_registry_bind(registry, name, &wp_presentation_interface, 1);
+	wp_presentation_add_listener(latency->presentation,
+				     &presentation_listener, latency);
+}
+
+// wl_keyboard times are milliseconds from an unspecified base. Compositors
+// whose presentation clock is CLOCK_MONOTONIC stamp input from it as well,
+// so a time at most this old by that clock is taken to be one and the sample
+// includes the delivery to the locker. Otherwise it starts in the handler.
+#define EVENT_TIME_MAX_AGE_MS 1000
+
+void latency_input_begin(struct latency *latency, const uint32_t *event_ms) {
+	if (!latency->presentation) {
+		return;
+	}
+	uint64_t now = clock_now_ns(latency->clock);
+	latency->input_ns = now;
+	if (event_ms && latency->clock == CLOCK_MONOTONIC) {
+		uint64_t now_ms = now / 1000000;
+		uint32_t age_ms = (uint32_t)now_ms - *event_ms;
+		if (age_ms <= EVENT_TIME_MAX_AGE_MS) {
+			latency->input_ns = (now_ms - age_ms) * 1000000;
+		}
+	}
+}
+
+void latency_input_end(struct latency *latency) { latency->input_ns = 0; }
+
+void latency_commit(struct output_state *output, struct wl_surface *surface) {
+	struct latency *latency = &output->state->latency;
+	if (!latency->presentation || latency->input_ns == 0) {
+		return;
+	}
+	struct latency_feedback *pending = NULL;
+	for (size_t i = 0; i < LATENCY_PENDING; i++) {
+		if (!output->latency.pending[i].feedback) {
+			pending = &output->latency.pending[i];
+			break;
+		}
+	}
+	if (!pending) {
+		return;
+	}
+	pending->stats = &output->latency;
+	pending->input_ns = latency->input_ns;
+	pending->feedback =
+	    wp_presentation_feedback(latency->presentation, surface);
+	wp_presentation_feedback_add_listener(pending->feedback,
+					      &feedback_listener, pending);
+}
+
+void latency_stats_init(struct latency_stats *stats) {
+	memset(stats, 0, sizeof(*stats));
+}
+
+void latency_stats_finish(struct latency_stats *stats) {
+	for (size_t i = 0; i < LATENCY_PENDING; i++) {
+		if (stats->pending[i].feedback) {
+			feedback_destroy(&stats->pending[i]);
+		}
+	}
+}
+
+static int compare_samples(const void *a, const void *b) {
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+	return (x > y) - (x < y);
+}
+
+void latency_report(struct prog_state *state) {
+	if (!state->latency.presentation) {
+		fprintf(stderr, "latency: compositor lacks wp_presentation\n");
+		return;
+	}
+	struct output_state *output;
+	wl_list_for_each(output, &state->outputs, link) {
+		struct latency_stats *stats = &output->latency;
+		if (stats->count == 0) {
+			continue;
+		}
+		uint32_t n = stats->count < LATENCY_SAMPLES ? stats->count
+							     : LATENCY_SAMPLES;
+		uint32_t sorted[LATENCY_SAMPLES];
+		memcpy(sorted, stats->samples, n * sizeof(*sorted));
+		qsort(sorted, n, sizeof(*sorted), compare_samples);
+		fprintf(stderr,
+			"latency: output %u: %u frames, p50 %.2f ms, "
+			"p99 %.2f ms, max %.2f ms, %u discarded\n",
+			output->global_name, stats->count,
+			sorted[(n - 1) * 50 / 100] / 1000.0,
+			sorted[(n - 1) * 99 / 100] / 1000.0,
+			stats->max / 1000.0, stats->discarded);
+	}
+}
+
+void latency_finish(struct latency *latency) {
+	if (latency->presentation) {
+		wp_presentation_destroy(latency->presentation);
+		latency->presentation = NULL;
+	}
+}
@@ -0,0 +1,223 @@
+#include "log.h"
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOG_RING_SIZE 256 // messages, a power of two
+#define LOG_MESSAGE_MAX 192
+
+// A bounded multi-producer queue: a slot's sequence number says whether it
+// is free for the producer at that position or ready for the consumer.
+struct log_slot {
+	atomic_size_t sequence;
+	uint64_t ts_ns;
+	log_level_t level;
+	log_category_t category;
+	char message[LOG_MESSAGE_MAX];
+};
+
+log_level_t log_level = LOG_LEVEL_INFO;
+
+static struct log_slot ring[LOG_RING_SIZE];
+static atomic_size_t head;
+static size_t tail; // only touched by the writer
+static atomic_uint_fast64_t dropped;
+
+static pthread_t writer;
+static atomic_bool started;
+static atomic_bool stopping;
+static atomic_bool sleeping;
+static int wake_fd = -1;
+static uint64_t begin_ns;
+
+static const char *level_names[] = {
+    [LOG_LEVEL_ERROR] = "error",
+    [LOG_LEVEL_WARN] = "warn",
+    [LOG_LEVEL_INFO] = "info",
+    [LOG_LEVEL_DEBUG] = "debug",
+};
+
+static const char *category_names[LOG_CAT_COUNT] = {
+    [LOG_CAT_CORE] = "core",	 [LOG_CAT_OUTPUT] = "output",
+    [LOG_CAT_RENDER] = "render", [LOG_CAT_INPUT] = "input",
+    [LOG_CAT_AUTH] = "auth",
+};
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void print_line(uint64_t ts_ns, log_level_t level,
+		       log_category_t category, const char *message) {
+	double seconds = ts_ns > begin_ns ? (ts_ns - begin_ns) / 1e9 : 0.0;
+	fprintf(stderr, "%9.3f %-5s %-6s %s\n", seconds, level_names[level],
+		category_names[category], message);
+}
+
+static void drain(void) {
+	for (;;) {
+		struct log_slot *slot = &ring[tail % LOG_RING_SIZE];
+		size_t sequence = atomic_load_explicit(&slot->sequence,
+						       memory_order_acquire);
+		if (sequence != tail + 1) {
+			break;
+		}
+		print_line(slot->ts_ns, slot->level, slot->category,
+			   slot->message);
+		atomic_store_explicit(&slot->sequence, tail + LOG_RING_SIZE,
+				      memory_order_release);
+		tail++;
+	}
+	uint64_t lost = atomic_exchange(&dropped, 0);
+	if (lost) {
+		fprintf(stderr, "log: %llu messages dropped\n",
+			(unsigned long long)lost);
+	}
+	fflush(stderr);
+}
+
+static bool ring_empty(void) {
+	struct log_slot *slot = &ring[tail % LOG_RING_SIZE];
+	return atomic_load(&slot->sequence) != tail + 1;
+}
+
+static void *writer_run(void *data) {
+	while (!atomic_load(&stopping)) {
+		drain();
+		// producers only pay for a wakeup when the writer sleeps
+		atomic_store(&sleeping, true);
+		// pairs with the fence in log_write: either the producer sees
+		// sleeping or this recheck sees its message
+		atomic_thread_fence(memory_order_seq_cst);
+		if (ring_empty() && !atomic_load(&stopping)) {
+			uint64_t count;
+			while (read(wake_fd, &count, sizeof(count)) < 0 &&
+			       errno == EINTR)
+				;
+		}
+		atomic_store(&sleeping, false);
+	}
+	drain();
+	return NULL;
+}
+
+static void wake_writer(void) {
+	uint64_t one = 1;
+	if (write(wake_fd, &one, sizeof(one)) < 0) {
+		// the counter is saturated, the writer is awake anyway
+	}
+}
+
+void log_init(log_level_t level) {
+	log_level = level;
+	if (!begin_ns) {
+		begin_ns = now_ns();
+	}
+	for (size_t i = 0; i < LOG_RING_SIZE; i++) {
+		atomic_init(&ring[i].sequence, i);
+	}
+	wake_fd = eventfd(0, EFD_CLOEXEC);
+	if (wake_fd < 0) {
+		return;
+	}
+
+	// signals stay with the threads that handle them
+	sigset_t all, old;
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	bool ok = pthread_create(&writer, NULL, writer_run, NULL) == 0;
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (!ok) {
+		close(wake_fd);
+		wake_fd = -1;
+		return;
+	}
+	atomic_store(&started, true);
+	// exit() on a fatal error must not lose what led to it
+	atexit(log_finish);
+}
+
+void log_write(log_level_t level, log_category_t category, const char *fmt,
+	       ...) {
+	va_list args;
+	if (!atomic_load(&started)) {
+		if (!begin_ns) {
+			begin_ns = now_ns();
+		}
+		char message[LOG_MESSAGE_MAX];
+		va_start(args, fmt);
+		vsnprintf(message, sizeof(message), fmt, args);
+		va_end(args);
+		print_line(now_ns(), level, category, message);
+		return;
+	}
+
+	size_t pos = atomic_load_explicit(&head, memory_order_relaxed);
+	struct log_slot *slot;
+	for (;;) {
+		slot = &ring[pos % LOG_RING_SIZE];
+		size_t sequence = atomic_load_explicit(&slot->sequence,
+						       memory_order_acquire);
+		intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+		if (diff == 0) {
+			if (atomic_compare_exchange_weak_explicit(
+				&head, &pos, pos + 1, memory_order_relaxed,
+				memory_order_relaxed)) {
+				break;
+			}
+		} else if (diff < 0) {
+			atomic_fetch_add_explicit(&dropped, 1,
+						  memory_order_relaxed);
+			return;
+		} else {
+			pos = atomic_load_explicit(&head, memory_order_relaxed);
+		}
+	}
+
+	slot->ts_ns = now_ns();
+	slot->level = level;
+	slot->category = category;
+	va_start(args, fmt);
+	vsnprintf(slot->message, sizeof(slot->message), fmt, args);
+	va_end(args);
+	atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+
+	// the release store alone may be ordered after the load of sleeping
+	atomic_thread_fence(memory_order_seq_cst);
+	if (atomic_load(&sleeping)) {
+		wake_writer();
+	}
+}
+
+void log_finish(void) {
+	if (!atomic_exchange(&started, false)) {
+		return;
+	}
+	atomic_store(&stopping, true);
+	wake_writer();
+	pthread_join(writer, NULL);
+	close(wake_fd);
+	wake_fd = -1;
+}
+
+int log_parse_level(const char *name, log_level_t *out) {
+	for (size_t i = 0; i < sizeof(level_names) / sizeof(*level_names);
+	     i++) {
+		if (strcmp(name, level_names[i]) == 0) {
+			*out = i;
+			return 0;
+		}
+	}
+	return -1;
+}
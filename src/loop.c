@@ -0,0 +1,168 @@
+#include "loop.h"
+#include "metrics.h"
+#include "state.h"
+#include "trace.h"
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <wayland-client-core.h>
+
+int loop_add_fd(struct event_loop *loop, int fd, short events,
+		loop_source_kind_t kind, loop_handler_t handler) {
+	if (loop->count == LOOP_MAX_SOURCES) {
+		fprintf(stderr, "too many event loop sources\n");
+		return -1;
+	}
+	loop->sources[loop->count++] = (struct loop_source){
+	    .fd = fd,
+	    .events = events,
+	    .kind = kind,
+	    .handler = handler,
+	};
+	return 0;
+}
+
+void loop_remove_fd(struct event_loop *loop, int fd) {
+	for (size_t i = 0; i < loop->count; i++) {
+		if (loop->sources[i].fd == fd) {
+			loop->sources[i] = loop->sources[--loop->count];
+			return;
+		}
+	}
+}
+
+static void count_wakeup(struct event_loop *loop, loop_source_kind_t kind) {
+	loop->stats.wakeups[kind]++;
+	// the wakeup counters are declared in loop_source_kind_t order
+	metrics_count(METRIC_WAKEUPS_WAYLAND + kind);
+}
+
+int loop_dispatch(struct prog_state *state, int timeout) {
+	struct event_loop *loop = &state->loop;
+	struct wl_display *display = state->display;
+
+	while (wl_display_prepare_read(display) != 0) {
+		if (wl_display_dispatch_pending(display) < 0) {
+			return -1;
+		}
+	}
+	// a full socket buffer is not fatal, poll for POLLOUT in that case
+	short display_events = POLLIN;
+	if (wl_display_flush(display) < 0) {
+		if (errno != EAGAIN) {
+			wl_display_cancel_read(display);
+			return -1;
+		}
+		display_events |= POLLOUT;
+	}
+
+	struct pollfd fds[LOOP_MAX_SOURCES + 1];
+	fds[0] = (struct pollfd){.fd = wl_display_get_fd(display),
+				 .events = display_events};
+	for (size_t i = 0; i < loop->count; i++) {
+		fds[i + 1] = (struct pollfd){.fd = loop->sources[i].fd,
+					     .events = loop->sources[i].events};
+	}
+	size_t count = loop->count + 1;
+
+	int ret = poll(fds, count, timeout);
+	if (ret < 0) {
+		wl_display_cancel_read(display);
+		return errno == EINTR ? 0 : -1;
+	}
+	loop->stats.iterations++;
+	metrics_count(METRIC_LOOP_ITERATIONS);
+	if (ret == 0) {
+		loop->stats.timeouts++;
+	}
+	if (fds[0].revents) {
+		count_wakeup(loop, LOOP_SOURCE_WAYLAND);
+	}
+
+	TRACE_BEGIN("wayland dispatch");
+	if (fds[0].revents & POLLIN) {
+		if (wl_display_read_events(display) < 0) {
+			TRACE_END("wayland dispatch");
+			return -1;
+		}
+	} else {
+		wl_display_cancel_read(display);
+	}
+	int dispatched = wl_display_dispatch_pending(display);
+	TRACE_END("wayland dispatch");
+	if (dispatched < 0 || (fds[0].revents & (POLLERR | POLLHUP))) {
+		return -1;
+	}
+
+	// handlers may add or remove sources, so match by fd
+	for (size_t i = 1; i < count; i++) {
+		if (!fds[i].revents) {
+			continue;
+		}
+		for (size_t j = 0; j < loop->count; j++) {
+			if (loop->sources[j].fd == fds[i].fd) {
+				count_wakeup(loop, loop->sources[j].kind);
+				loop->sources[j].handler(state, fds[i].fd,
+							 fds[i].revents);
+				break;
+			}
+		}
+	}
+	return 0;
+}
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint64_t timeval_ns(struct timeval tv) {
+	return (uint64_t)tv.tv_sec * 1000000000ull + tv.tv_usec * 1000ull;
+}
+
+void loop_stats_begin(struct event_loop *loop) {
+	struct loop_stats *stats = &loop->stats;
+	*stats = (struct loop_stats){.begin_ns = now_ns()};
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) == 0) {
+		stats->begin_utime = usage.ru_utime;
+		stats->begin_stime = usage.ru_stime;
+	}
+}
+
+void loop_stats_report(struct event_loop *loop, const char *when) {
+	const struct loop_stats *stats = &loop->stats;
+	double elapsed = (now_ns() - stats->begin_ns) / 1e9;
+	uint64_t user_ns = 0, system_ns = 0;
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) == 0) {
+		user_ns = timeval_ns(usage.ru_utime) -
+			  timeval_ns(stats->begin_utime);
+		system_ns = timeval_ns(usage.ru_stime) -
+			    timeval_ns(stats->begin_stime);
+	}
+	metrics_set(METRIC_LOCKED_CPU_USER, user_ns);
+	metrics_set(METRIC_LOCKED_CPU_SYSTEM, system_ns);
+
+	uint64_t wakeups = 0;
+	for (size_t i = 0; i < LOOP_SOURCE_KIND_COUNT; i++) {
+		wakeups += stats->wakeups[i];
+	}
+	double minutes = elapsed > 0 ? elapsed / 60 : 1;
+	fprintf(stderr,
+		"loop (%s): %.1f s locked, %llu wakeups (%.2f/min): wayland "
+		"%llu, timer %llu, signal %llu, other %llu; %llu iterations, "
+		"%llu timeouts; cpu user %.3f s, system %.3f s (%.4f%%)\n",
+		when, elapsed, (unsigned long long)wakeups, wakeups / minutes,
+		(unsigned long long)stats->wakeups[LOOP_SOURCE_WAYLAND],
+		(unsigned long long)stats->wakeups[LOOP_SOURCE_TIMER],
+		(unsigned long long)stats->wakeups[LOOP_SOURCE_SIGNAL],
+		(unsigned long long)stats->wakeups[LOOP_SOURCE_OTHER],
+		(unsigned long long)stats->iterations,
+		(unsigned long long)stats->timeouts, user_ns / 1e9,
+		system_ns / 1e9,
+		elapsed > 0 ? (user_ns + system_ns) / 1e7 / elapsed : 0.0);
+}
@@ -1,9 +1,23 @@
 #include "auth.h"
 #include "draw.h"
+#include "ext-idle-notify-v1-protocol.h"
 #include "ext-session-lock-v1-protocol.h"
+#include "input.h"
+#include "keymap.h"
+#include "log.h"
+#include "memory.h"
+#include "loop.h"
+#include "metrics.h"
+#include "output.h"
+#include "power.h"
+#include "presentation-time-protocol.h"
+#include "secret.h"
 #include "state.h"
+#include "trace.h"
+#include "wlr-output-power-management-unstable-v1-protocol.h"
 #include <assert.h>
 #include <bits/time.h>
+#include <signal.h>
 #include <security/_pam_types.h>
 #include <security/pam_appl.h>
 #include <stdbool.h>
@@ -13,6 +27,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
 #include <time.h>
 #include <unistd.h>
 #include <wayland-client-core.h>
@@ -21,49 +37,39 @@
 #include <xkbcommon/xkbcommon-keysyms.h>
 #include <xkbcommon/xkbcommon.h>
 
-static void output_geometry(void *data, struct wl_output *wl_output, int32_t x,
-			    int32_t y, int32_t physical_width,
-			    int32_t physical_height, int32_t subpixel,
-			    const char *make, const char *model,
-			    int32_t transform) {
-	fprintf(stderr, "Physical screen widthxheight: %dx%d mm\n",
-		physical_width, physical_height);
-}
+#define NS_PER_SEC 1000000000ull
 
-static void output_mode(void *data, struct wl_output *wl_output, uint32_t flags,
-			int32_t width, int32_t height, int32_t refresh) {
-	if (flags & WL_OUTPUT_MODE_CURRENT) {
-		fprintf(stderr, "Screen resolution: %dx%d pixels\n", width,
-			height);
-	}
-}
+static void key_repeat_stop(struct prog_state *state);
 
-static const struct wl_output_listener output_listener = {
-    .geometry = output_geometry,
-    .mode = output_mode,
-};
+static void seat_repeat_stop(struct seat_state *seat);
 
 static void wl_keyboard_listener_keymap(void *data,
 					struct wl_keyboard *wl_keyboard,
 					uint32_t format, int32_t fd,
 					uint32_t size) {
-	struct prog_state *client_state = data;
+	struct seat_state *seat = data;
+	struct prog_state *client_state = seat->state;
 	assert(format == WL_KEYBOARD_KEYMAP_FORMAT_XKB_V1);
+	startup_task_join(&client_state->startup.xkb);
 
 	char *map_shm = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
 	assert(map_shm != MAP_FAILED);
 
-	struct xkb_keymap *xkb_keymap = xkb_keymap_new_from_string(
-	    client_state->xkb_context, map_shm, XKB_KEYMAP_FORMAT_TEXT_V1,
-	    XKB_KEYMAP_COMPILE_NO_FLAGS);
+	struct xkb_keymap *xkb_keymap = keymap_cache_get(
+	    &client_state->keymaps, client_state->xkb_context, map_shm, size);
 	munmap(map_shm, size);
 	close(fd);
+	if (!xkb_keymap) {
+		return;
+	}
 
+	// the held key may mean something else, or not repeat, in the new map
+	seat_repeat_stop(seat);
 	struct xkb_state *xkb_state = xkb_state_new(xkb_keymap);
-	xkb_keymap_unref(client_state->xkb_keymap);
-	xkb_state_unref(client_state->xkb_state);
-	client_state->xkb_keymap = xkb_keymap;
-	client_state->xkb_state = xkb_state;
+	xkb_keymap_unref(seat->xkb_keymap);
+	xkb_state_unref(seat->xkb_state);
+	seat->xkb_keymap = xkb_keymap;
+	seat->xkb_state = xkb_state;
 }
 
 static void wl_keyboard_listener_enter(void *data,
@@ -78,77 +84,227 @@ void update_last_activity(struct prog_state *state) {
 	clock_gettime(CLOCK_MONOTONIC, &state->last_activity);
 }
 
-void clearPasswordBuffer(struct auth_state *auth_state) {
-	memset(auth_state->password_buffer, 0, auth_state->password_len);
-	auth_state->password_pos = 0;
+static void arm_inactivity_timer(struct prog_state *state);
+
+static void unlock(struct prog_state *state) {
+	ext_session_lock_v1_unlock_and_destroy(state->session_lock);
+	state->session_lock = NULL;
+	state->locked = false;
 }
 
-static void wl_keyboard_listener_key(void *data,
-				     struct wl_keyboard *wl_keyboard,
-				     uint32_t serial, uint32_t time,
-				     uint32_t key, uint32_t state) {
-	struct prog_state *client_state = data;
-	struct auth_state *auth_state = &client_state->auth_state;
+static void handle_unlock_timer(struct prog_state *state, int fd,
+				short revents) {
+	loop_remove_fd(&state->loop, fd);
+	close(fd);
+	state->unlock_timer_fd = -1;
+	unlock(state);
+}
+
+// Keeps the success icon up for a moment without blocking the loop.
+static int start_unlock_timer(struct prog_state *state) {
+	int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (fd < 0) {
+		return -1;
+	}
+	struct itimerspec delay = {
+	    .it_value = {.tv_nsec = 500000000},
+	};
+	if (timerfd_settime(fd, 0, &delay, NULL) != 0 ||
+	    loop_add_fd(&state->loop, fd, POLLIN, LOOP_SOURCE_TIMER,
+			handle_unlock_timer) != 0) {
+		close(fd);
+		return -1;
+	}
+	state->unlock_timer_fd = fd;
+	return 0;
+}
+
+// Called for the password and for the concurrent service, whichever wins.
+static void auth_done(struct prog_state *state, int result) {
+	key_repeat_stop(state);
+	// a password still being checked is the worker's until it returns
+	if (!state->auth_worker.running) {
+		clearPasswordBuffer(&state->auth_state);
+	}
+	if (result != 0) {
+		change_icon_state(state, AUTH_STATE_LOCKED);
+		anim_start(state, ANIM_SHAKE);
+		arm_inactivity_timer(state);
+		return;
+	}
+	change_icon_state(state, AUTH_STATE_SUCCESS);
+	anim_start(state, ANIM_NONE);
+	notice_clear(state);
+	if (start_unlock_timer(state) != 0) {
+		unlock(state);
+	}
+	arm_inactivity_timer(state);
+}
+
+static xkb_keysym_t key_lookup(struct seat_state *seat, uint32_t key,
+			       char buf[8], int *len) {
 	uint32_t keycode = key + 8;
-	xkb_keysym_t sym =
-	    xkb_state_key_get_one_sym(client_state->xkb_state, keycode);
+	*len = xkb_state_key_get_utf8(seat->xkb_state, keycode, buf, 8);
+	if (*len >= 8) {
+		*len = 0;
+	}
+	return xkb_state_key_get_one_sym(seat->xkb_state, keycode);
+}
 
-	if (state != WL_KEYBOARD_KEY_STATE_PRESSED)
+// Applies count presses of the same key. Repeats that piled up are edited
+// into the password together and cost a single icon change. event_time is
+// the wl_keyboard timestamp, NULL for repeats the locker made up itself.
+static void apply_key(struct prog_state *client_state, xkb_keysym_t sym,
+		      const char *buf, int len, uint64_t count,
+		      const uint32_t *event_time) {
+	struct auth_state *auth_state = &client_state->auth_state;
+	// any key counts as someone being there, typed or not
+	update_last_activity(client_state);
+	power_on(client_state);
+	// the auth worker owns the password buffer, and after a success
+	// nothing typed matters any more
+	if (client_state->auth_worker.running ||
+	    client_state->unlock_timer_fd >= 0)
 		return;
+	TRACE_BEGIN("key");
+	latency_input_begin(&client_state->latency, event_time);
 
-	if (sym == XKB_KEY_Escape) {
+	struct input_effect effect = input_handle_key(auth_state, sym, buf, len);
+	for (uint64_t i = 1; i < count && !effect.submit; i++) {
+		effect = input_handle_key(auth_state, sym, buf, len);
+	}
+	change_icon_state(client_state, effect.icon);
+	if (effect.submit) {
+		key_repeat_stop(client_state);
+	}
+	if (effect.submit && auth_start(client_state, auth_done) != 0) {
+		log_error(LOG_CAT_AUTH, "could not start authenticating");
 		change_icon_state(client_state, AUTH_STATE_LOCKED);
 		clearPasswordBuffer(auth_state);
-	} else if (sym == XKB_KEY_Return) {
-		change_icon_state(client_state, AUTH_STATE_AUTHENTICATING);
-		wl_display_flush(client_state->display);
-		wl_display_roundtrip(client_state->display);
-		if (auth_state->password_pos > 0) {
-			auth_state->password_buffer[auth_state->password_pos] =
-			    '\0';
-		}
-		if (authenticate_user(client_state) == 0) {
-			change_icon_state(client_state, AUTH_STATE_SUCCESS);
-			wl_display_flush(client_state->display);
-			wl_display_roundtrip(client_state->display);
-			struct timespec delay = {
-			    .tv_nsec = 5.0e8,
-			};
-			nanosleep(&delay, NULL);
-			ext_session_lock_v1_unlock_and_destroy(
-			    client_state->session_lock);
-			client_state->session_lock = NULL;
-			client_state->locked = false;
-			wl_display_roundtrip(client_state->display);
-		} else {
-			change_icon_state(client_state, AUTH_STATE_LOCKED);
-			clearPasswordBuffer(auth_state);
+	} else if (effect.submit) {
+		anim_start(client_state, ANIM_SPINNER);
+	} else if (sym == XKB_KEY_BackSpace || sym == XKB_KEY_Escape) {
+		anim_start(client_state, ANIM_ERASE);
+	} else if (input_key_types_text(sym, len)) {
+		anim_start(client_state, ANIM_TYPING);
+	}
+	arm_inactivity_timer(client_state);
+	latency_input_end(&client_state->latency);
+	TRACE_END("key");
+}
+
+static void seat_repeat_stop(struct seat_state *seat) {
+	struct key_repeat *repeat = &seat->repeat;
+	if (!repeat->active) {
+		return;
+	}
+	struct itimerspec off = {0};
+	timerfd_settime(repeat->timer_fd, 0, &off, NULL);
+	repeat->active = false;
+}
+
+static void key_repeat_stop(struct prog_state *state) {
+	struct seat_state *seat;
+	wl_list_for_each(seat, &state->seats, link) {
+		seat_repeat_stop(seat);
+	}
+}
+
+static void handle_repeat_timer(struct prog_state *state, int fd,
+				short revents) {
+	struct seat_state *seat;
+	wl_list_for_each(seat, &state->seats, link) {
+		if (seat->repeat.timer_fd == fd) {
+			break;
 		}
-	} else if (sym == XKB_KEY_BackSpace) {
-		if (auth_state->password_pos > 0) {
-			auth_state->password_pos--;
-			auth_state->password_buffer[auth_state->password_pos] =
-			    '\0';
+	}
+	uint64_t expirations;
+	// a stop between poll() and here leaves nothing to read
+	if (&seat->link == &state->seats ||
+	    read(fd, &expirations, sizeof(expirations)) !=
+		sizeof(expirations) ||
+	    !seat->repeat.active) {
+		return;
+	}
+	char buf[8];
+	int len;
+	// looked up again, a modifier may have changed while held
+	xkb_keysym_t sym = key_lookup(seat, seat->repeat.key, buf, &len);
+	TRACE_BEGIN("key repeat");
+	apply_key(state, sym, buf, len, expirations, NULL);
+	secret_wipe(buf, sizeof(buf));
+	TRACE_END("key repeat");
+}
+
+// Only edits repeat: holding Return or Escape must not submit or clear again.
+static void key_repeat_start(struct seat_state *seat, uint32_t key,
+			     xkb_keysym_t sym, int len) {
+	struct prog_state *state = seat->state;
+	struct key_repeat *repeat = &seat->repeat;
+	if (repeat->rate <= 0 ||
+	    !xkb_keymap_key_repeats(seat->xkb_keymap, key + 8) ||
+	    (sym != XKB_KEY_BackSpace && !input_key_types_text(sym, len))) {
+		return;
+	}
+	if (repeat->timer_fd < 0) {
+		int fd =
+		    timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+		if (fd < 0) {
+			return;
 		}
-		if (auth_state->password_pos == 0) {
-			change_icon_state(client_state, AUTH_STATE_LOCKED);
+		if (loop_add_fd(&state->loop, fd, POLLIN, LOOP_SOURCE_TIMER,
+				handle_repeat_timer) != 0) {
+			close(fd);
+			return;
 		}
-		update_last_activity(client_state);
-	} else {
-		change_icon_state(client_state, AUTH_STATE_TYPING);
-		char buf[8];
-
-		int len = xkb_state_key_get_utf8(client_state->xkb_state,
-						 keycode, buf, sizeof(buf));
-
-		if (len > 0 && auth_state->password_pos + len <
-				   auth_state->password_len - 1) {
-			update_last_activity(client_state);
-			memcpy(&auth_state
-				    ->password_buffer[auth_state->password_pos],
-			       buf, len);
-			auth_state->password_pos += len;
+		repeat->timer_fd = fd;
+	}
+	uint64_t interval = NS_PER_SEC / repeat->rate;
+	struct itimerspec spec = {
+	    .it_value = {.tv_sec = repeat->delay / 1000,
+			 .tv_nsec = repeat->delay % 1000 * 1000000},
+	    .it_interval = {.tv_sec = interval / NS_PER_SEC,
+			    .tv_nsec = interval % NS_PER_SEC},
+	};
+	if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) {
+		spec.it_value = spec.it_interval;
+	}
+	if (timerfd_settime(repeat->timer_fd, 0, &spec, NULL) == 0) {
+		repeat->key = key;
+		repeat->active = true;
+	}
+}
+
+static void wl_keyboard_listener_key(void *data,
+				     struct wl_keyboard *wl_keyboard,
+				     uint32_t serial, uint32_t time,
+				     uint32_t key, uint32_t state) {
+	struct seat_state *seat = data;
+	struct prog_state *client_state = seat->state;
+	if (!seat->xkb_state) {
+		return;
+	}
+	char buf[8];
+	int len;
+	xkb_keysym_t sym = key_lookup(seat, key, buf, &len);
+	input_record_key(&client_state->input_recorder, key, state,
+			 input_key_types_text(sym, len));
+
+	if (state != WL_KEYBOARD_KEY_STATE_PRESSED) {
+		if (key == seat->repeat.key) {
+			seat_repeat_stop(seat);
 		}
+		secret_wipe(buf, sizeof(buf));
+		return;
+	}
+	// the newest key is the one that repeats, whichever seat it is on
+	key_repeat_stop(client_state);
+	apply_key(client_state, sym, buf, len, 1, &time);
+	// the typed character is part of the password, not left on the stack
+	secret_wipe(buf, sizeof(buf));
+	if (!client_state->auth_worker.running &&
+	    client_state->unlock_timer_fd < 0) {
+		key_repeat_start(seat, key, sym, len);
 	}
 }
 
@@ -156,7 +312,8 @@ static void wl_keyboard_listener_leave(void *data,
 				       struct wl_keyboard *wl_keyboard,
 				       uint32_t serial,
 				       struct wl_surface *surface) {
-	//  NOTE: noop
+	struct seat_state *seat = data;
+	seat_repeat_stop(seat);
 }
 
 static void
@@ -164,15 +321,24 @@ wl_keyboard_listener_modifiers(void *data, struct wl_keyboard *wl_keyboard,
 			       uint32_t serial, uint32_t mods_depressed,
 			       uint32_t mods_latched, uint32_t mods_locked,
 			       uint32_t group) {
-	struct prog_state *client_state = data;
-	xkb_state_update_mask(client_state->xkb_state, mods_depressed,
-			      mods_latched, mods_locked, 0, 0, group);
+	struct seat_state *seat = data;
+	if (!seat->xkb_state) {
+		return;
+	}
+	input_record_modifiers(&seat->state->input_recorder);
+	xkb_state_update_mask(seat->xkb_state, mods_depressed, mods_latched,
+			      mods_locked, 0, 0, group);
 }
 
 static void wl_keyboard_listener_repeat_info(void *data,
 					     struct wl_keyboard *wl_keyboard,
 					     int32_t rate, int32_t delay) {
-	// noop
+	struct seat_state *seat = data;
+	seat->repeat.rate = rate;
+	seat->repeat.delay = delay;
+	if (rate <= 0) {
+		seat_repeat_stop(seat);
+	}
 }
 
 struct wl_keyboard_listener wl_keyboard_listener = {
@@ -186,17 +352,17 @@ struct wl_keyboard_listener wl_keyboard_listener = {
 
 void wl_seat_listener_capabilities(void *data, struct wl_seat *wl_seat,
 				   uint32_t capabilities) {
-	struct prog_state *state = data;
-	//  TODO: make a keyboard
+	struct seat_state *seat = data;
 	if ((capabilities & WL_SEAT_CAPABILITY_KEYBOARD) &&
-	    state->keyboard == NULL) {
-		state->keyboard = wl_seat_get_keyboard(state->seat);
-		wl_keyboard_add_listener(state->keyboard, &wl_keyboard_listener,
-					 state);
+	    seat->keyboard == NULL) {
+		seat->keyboard = wl_seat_get_keyboard(seat->wl_seat);
+		wl_keyboard_add_listener(seat->keyboard, &wl_keyboard_listener,
+					 seat);
 	} else if (!(capabilities & WL_SEAT_CAPABILITY_KEYBOARD) &&
-		   state->keyboard != NULL) {
-		wl_keyboard_release(state->keyboard);
-		state->keyboard = NULL;
+		   seat->keyboard != NULL) {
+		seat_repeat_stop(seat);
+		wl_keyboard_release(seat->keyboard);
+		seat->keyboard = NULL;
 	}
 }
 
@@ -209,6 +375,36 @@ static struct wl_seat_listener wl_seat_listener = {
     .capabilities = wl_seat_listener_capabilities,
     .name = wl_seat_listener_name};
 
+static void seat_create(struct prog_state *state, struct wl_seat *wl_seat,
+			uint32_t global_name) {
+	struct seat_state *seat = calloc(1, sizeof(*seat));
+	if (!seat) {
+		wl_seat_release(wl_seat);
+		return;
+	}
+	seat->state = state;
+	seat->global_name = global_name;
+	seat->wl_seat = wl_seat;
+	seat->repeat.timer_fd = -1;
+	wl_list_insert(state->seats.prev, &seat->link);
+	wl_seat_add_listener(wl_seat, &wl_seat_listener, seat);
+}
+
+static void seat_destroy(struct seat_state *seat) {
+	if (seat->repeat.timer_fd >= 0) {
+		loop_remove_fd(&seat->state->loop, seat->repeat.timer_fd);
+		close(seat->repeat.timer_fd);
+	}
+	if (seat->keyboard) {
+		wl_keyboard_release(seat->keyboard);
+	}
+	xkb_state_unref(seat->xkb_state);
+	xkb_keymap_unref(seat->xkb_keymap);
+	wl_seat_release(seat->wl_seat);
+	wl_list_remove(&seat->link);
+	free(seat);
+}
+
 static void reg_handle_global(void *data, struct wl_registry *wl_registry,
 			      uint32_t name, const char *interface,
 			      uint32_t version) {
@@ -217,6 +413,9 @@ static void reg_handle_global(void *data, struct wl_registry *wl_registry,
 	if (strcmp(interface, wl_compositor_interface.name) == 0) {
 		state->compositor = wl_registry_bind(
 		    wl_registry, name, &wl_compositor_interface, 4);
+	} else if (strcmp(interface, wl_subcompositor_interface.name) == 0) {
+		state->subcompositor = wl_registry_bind(
+		    wl_registry, name, &wl_subcompositor_interface, 1);
 	} else if (strcmp(interface, wl_shm_interface.name) == 0) {
 		state->shm =
 		    wl_registry_bind(wl_registry, name, &wl_shm_interface, 1);
@@ -226,22 +425,68 @@ static void reg_handle_global(void *data, struct wl_registry *wl_registry,
 		    wl_registry_bind(wl_registry, name,
 				     &ext_session_lock_manager_v1_interface, 1);
 	} else if (strcmp(interface, wl_seat_interface.name) == 0) {
-		state->seat =
-		    wl_registry_bind(wl_registry, name, &wl_seat_interface, 7);
-		wl_seat_add_listener(state->seat, &wl_seat_listener, state);
+		seat_create(state,
+			    wl_registry_bind(wl_registry, name,
+					     &wl_seat_interface, 7),
+			    name);
+	} else if (strcmp(interface, wp_presentation_interface.name) == 0) {
+		latency_bind(state, wl_registry, name);
+	} else if (strcmp(interface,
+			  zwlr_output_power_manager_v1_interface.name) == 0) {
+		power_bind(state, wl_registry, name);
+	} else if (strcmp(interface, ext_idle_notifier_v1_interface.name) ==
+		   0) {
+		state->idle_notifier = wl_registry_bind(
+		    wl_registry, name, &ext_idle_notifier_v1_interface, 1);
 	} else if (strcmp(interface, wl_output_interface.name) == 0) {
-		state->output = wl_registry_bind(wl_registry, name,
-						 &wl_output_interface, 1);
-		wl_output_add_listener(state->output, &output_listener, state);
+		// v2 for the scale event
+		struct wl_output *wl_output = wl_registry_bind(
+		    wl_registry, name, &wl_output_interface,
+		    version < 2 ? version : 2);
+		struct output_state *output =
+		    output_create(state, wl_output, name);
+		// outputs plugged in after locking need a lock surface too
+		if (output && state->session_lock) {
+			output_create_lock_surface(output);
+		}
 	}
 	// printf("Interface: %s,\n version: %d,\n name: %d\n", interface,
 	// version, name);
 }
 
+static int idle_arm(struct prog_state *state);
+static void idle_disarm(struct prog_state *state);
+static void idle_release(struct prog_state *state);
+
 static void reg_handle_global_remove(void *data,
 				     struct wl_registry *wl_registry,
 				     uint32_t name) {
-	/* no operation */
+	struct prog_state *state = data;
+	struct output_state *output, *tmp;
+	wl_list_for_each_safe(output, tmp, &state->outputs, link) {
+		if (output->global_name == name) {
+			output_destroy(output);
+			return;
+		}
+	}
+	struct seat_state *seat, *seat_tmp;
+	wl_list_for_each_safe(seat, seat_tmp, &state->seats, link) {
+		if (seat->global_name != name) {
+			continue;
+		}
+		// idle notifications belong to a seat, move them to the next
+		bool watched = seat == state->idle_seat;
+		if (watched) {
+			idle_disarm(state);
+			idle_release(state);
+		}
+		seat_destroy(seat);
+		if (watched && idle_arm(state) != 0) {
+			log_warn(LOG_CAT_CORE,
+				 "no seat left to watch, idle locking is off");
+		}
+		return;
+	}
 }
 
 static const struct wl_registry_listener reg_listener = {
@@ -249,32 +494,17 @@ static const struct wl_registry_listener reg_listener = {
     .global_remove = reg_handle_global_remove,
 };
 
-void getDisplay(struct prog_state *state) {
-	state->display = wl_display_connect(NULL);
-	if (state->display == NULL) {
-		fprintf(stderr, "Failed to connect to wayland display!!\n");
-		exit(EXIT_FAILURE);
-	}
-	struct wl_registry *registry = wl_display_get_registry(state->display);
-	if (registry == NULL) {
-		fprintf(stderr,
-			"Failed to get registry from wayland display!!\n");
-		exit(EXIT_FAILURE);
-	}
-	// fprintf(stdout, "Connection established!!\n");
-	wl_registry_add_listener(registry, &reg_listener, state);
-	wl_display_roundtrip(state->display);
-	wl_registry_destroy(registry);
-}
-
 void lock_locked(void *data, struct ext_session_lock_v1 *ext_session_lock_v1) {
 	struct prog_state *state = data;
 	state->locked = true;
+	startup_mark(&state->startup, STARTUP_MARK_LOCKED);
+	metrics_set(METRIC_TIME_TO_LOCK,
+		    startup_now_ns() - state->startup.begin_ns);
 }
 
 void lock_finished(void *data,
 		   struct ext_session_lock_v1 *ext_session_lock_v1) {
-	fprintf(stderr, "failed to lock session\n");
+	log_error(LOG_CAT_CORE, "failed to lock session");
 	exit(EXIT_FAILURE);
 }
 
@@ -283,143 +513,545 @@ struct ext_session_lock_v1_listener lock_listener = {
     .finished = lock_finished,
 };
 
-void lock_surface_configure(
-    void *data, struct ext_session_lock_surface_v1 *ext_session_lock_surface_v1,
-    uint32_t serial, uint32_t width, uint32_t height) {
-	fprintf(stderr, "Lock surface Configure called: %dx%d\n", width,
-		height);
+static void request_lock(struct prog_state *state) {
+	state->session_lock =
+	    ext_session_lock_manager_v1_lock(state->lock_manager);
+	ext_session_lock_v1_add_listener(state->session_lock, &lock_listener,
+					 state);
+	startup_phase(&state->startup, "lock request");
+	startup_mark(&state->startup, STARTUP_MARK_LOCK_REQUEST);
+
+	// lock surfaces may be created before the compositor confirms the lock
+	struct output_state *output;
+	wl_list_for_each(output, &state->outputs, link) {
+		output_create_lock_surface(output);
+	}
+	maybe_load_wallpaper(state);
+}
+
+// The seat has been idle for long enough that a lock is likely: decode the
+// wallpaper and render every output's frame while nobody is waiting for it.
+static void idle_prepare(struct prog_state *state) {
+	if (state->prepared || state->session_lock) {
+		return;
+	}
+	state->prepared = true;
+	TRACE_BEGIN("idle prepare");
+	load_wallpaper(state);
+	struct output_state *output;
+	wl_list_for_each(output, &state->outputs, link) {
+		output_prepare_buffer(output);
+	}
+	TRACE_END("idle prepare");
+	log_info(LOG_CAT_CORE, "idle, lock frames prepared");
+}
+
+// The user came back before the timeout, nothing needs to stay in memory.
+static void idle_release(struct prog_state *state) {
+	if (!state->prepared || state->session_lock) {
+		return;
+	}
+	state->prepared = false;
+	struct output_state *output;
+	wl_list_for_each(output, &state->outputs, link) {
+		output_drop_buffer(output);
+	}
+	image_loader_finish(&state->wallpaper);
+	state->wallpaper_started = false;
+	log_info(LOG_CAT_CORE, "active again, lock frames released");
+}
+
+static void idle_warning_idled(void *data,
+			       struct ext_idle_notification_v1 *notification) {
+	idle_prepare(data);
+}
+
+static void
+idle_warning_resumed(void *data,
+		     struct ext_idle_notification_v1 *notification) {
+	idle_release(data);
+}
+
+static const struct ext_idle_notification_v1_listener idle_warning_listener =
+    {
+	.idled = idle_warning_idled,
+	.resumed = idle_warning_resumed,
+};
+
+static void idle_disarm(struct prog_state *state) {
+	if (state->idle_warning) {
+		ext_idle_notification_v1_destroy(state->idle_warning);
+		state->idle_warning = NULL;
+	}
+	if (state->idle_lock) {
+		ext_idle_notification_v1_destroy(state->idle_lock);
+		state->idle_lock = NULL;
+	}
+	state->idle_seat = NULL;
+}
+
+static void idle_lock_idled(void *data,
+			    struct ext_idle_notification_v1 *notification) {
 	struct prog_state *state = data;
+	// the lock only happens once, nothing is idle driven after it
+	idle_disarm(state);
 
-	uint32_t stride = width * 4;
+	log_info(LOG_CAT_CORE, "idle timeout, locking");
+	// time-to-lock counts from the timeout, what was prepared before it
+	// shows up with negative times in the report
+	startup_begin(&state->startup);
+	request_lock(state);
+}
 
-	state->logical_width = width;
-	state->logical_height = height;
+static void idle_lock_resumed(void *data,
+			      struct ext_idle_notification_v1 *notification) {
+	//  NOTE: noop, the notification is destroyed once idled
+}
 
-	if (!state->buffer) {
-		createBuffer(width, height, stride, state);
-		if (state->buffer) {
-			fprintf(stderr, "Buffer created successfully\n");
-		} else {
-			fprintf(stderr, "Buffer creation failed!\n");
-			exit(EXIT_FAILURE);
-		}
+static const struct ext_idle_notification_v1_listener idle_lock_listener = {
+    .idled = idle_lock_idled,
+    .resumed = idle_lock_resumed,
+};
+
+static uint32_t seconds_to_ms(uint32_t seconds) {
+	return seconds > UINT32_MAX / 1000 ? UINT32_MAX : seconds * 1000;
+}
+
+// Waits for the seat to go idle instead of locking: one notification to
+// prepare the frames a little before the timeout, one to lock at it.
+static int idle_arm(struct prog_state *state) {
+	if (!state->idle_notifier || wl_list_empty(&state->seats)) {
+		return -1;
 	}
+	// the default seat, the first one announced
+	struct seat_state *seat =
+	    wl_container_of(state->seats.next, seat, link);
+	uint32_t timeout = state->config.idle_timeout;
+	uint32_t warning = state->config.idle_warning < timeout
+			       ? timeout - state->config.idle_warning
+			       : 0;
+	state->idle_warning = ext_idle_notifier_v1_get_idle_notification(
+	    state->idle_notifier, seconds_to_ms(warning), seat->wl_seat);
+	ext_idle_notification_v1_add_listener(state->idle_warning,
+					      &idle_warning_listener, state);
+	state->idle_lock = ext_idle_notifier_v1_get_idle_notification(
+	    state->idle_notifier, seconds_to_ms(timeout), seat->wl_seat);
+	ext_idle_notification_v1_add_listener(state->idle_lock,
+					      &idle_lock_listener, state);
+	state->idle_seat = seat;
+	log_info(LOG_CAT_CORE, "locking after %u idle seconds", timeout);
+	return 0;
+}
+
+// Every global has been announced and bound. Everything the lock needs is
+// requested back to back from here, the replies are handled as they come.
+static void registry_sync_done(void *data, struct wl_callback *callback,
+			       uint32_t callback_data) {
+	struct prog_state *state = data;
+	wl_callback_destroy(callback);
+	state->registry_sync = NULL;
+	state->registry_done = true;
+	startup_phase(&state->startup, "registry");
+	startup_mark(&state->startup, STARTUP_MARK_REGISTRY);
 
-	wl_surface_attach(state->surface, state->buffer, 0, 0);
-	ext_session_lock_surface_v1_ack_configure(ext_session_lock_surface_v1,
-						  serial);
-	wl_surface_commit(state->surface);
+	if (!state->compositor || !state->shm || !state->lock_manager) {
+		fprintf(stderr,
+			"the compositor does not support ext-session-lock-v1\n");
+		exit(EXIT_FAILURE);
+	}
+	// never take the lock without a way to authenticate
+	if (startup_task_join(&state->startup.pam) != 0) {
+		fprintf(stderr, "PAM start failed!!\n");
+		exit(2);
+	}
+
+	if (state->config.idle_timeout == 0) {
+		request_lock(state);
+	} else if (idle_arm(state) != 0) {
+		fprintf(stderr,
+			"the compositor does not support ext-idle-notify-v1\n");
+		exit(EXIT_FAILURE);
+	}
 }
 
-struct ext_session_lock_surface_v1_listener lock_surface_listener = {
-    .configure = lock_surface_configure,
+static const struct wl_callback_listener registry_sync_listener = {
+    .done = registry_sync_done,
 };
+
+void getDisplay(struct prog_state *state) {
+	state->display = wl_display_connect(NULL);
+	if (state->display == NULL) {
+		fprintf(stderr, "Failed to connect to wayland display!!\n");
+		exit(EXIT_FAILURE);
+	}
+	state->registry = wl_display_get_registry(state->display);
+	if (state->registry == NULL) {
+		fprintf(stderr,
+			"Failed to get registry from wayland display!!\n");
+		exit(EXIT_FAILURE);
+	}
+	wl_registry_add_listener(state->registry, &reg_listener, state);
+	// answered right after the initial globals, instead of a roundtrip
+	state->registry_sync = wl_display_sync(state->display);
+	wl_callback_add_listener(state->registry_sync, &registry_sync_listener,
+				 state);
+	//  NOTE: the registry is kept alive so outputs can be hotplugged while
+	//  locked
+}
+
+// The lock is up once the compositor confirmed it and every lock surface
+// has a frame. A frame prepared ahead of an idle lock only counts once the
+// surface was configured and the frame committed.
+static bool lock_ready(struct prog_state *state) {
+	if (!state->locked) {
+		return false;
+	}
+	struct output_state *output;
+	wl_list_for_each(output, &state->outputs, link) {
+		if (output->lock_surface && !output->width) {
+			return false;
+		}
+	}
+	return true;
+}
+
+
 void decay_to_locked(struct prog_state *state) {
-	fprintf(stderr, "Decaying state\n");
+	key_repeat_stop(state);
+	log_info(LOG_CAT_INPUT, "Decaying state");
+	metrics_count(METRIC_DECAYS);
 	clearPasswordBuffer(&state->auth_state);
 	change_icon_state(state, AUTH_STATE_LOCKED);
+	anim_start(state, ANIM_NONE);
+}
+
+static uint64_t timespec_ns(const struct timespec *ts) {
+	return (uint64_t)ts->tv_sec * NS_PER_SEC + ts->tv_nsec;
+}
+
+// When a typed password is cleared again, 0 while there is nothing to clear.
+static uint64_t decay_deadline(struct prog_state *state) {
+	if (!state->decay_enabled ||
+	    state->auth_state.current_state == AUTH_STATE_LOCKED ||
+	    state->auth_worker.running) {
+		return 0;
+	}
+	return timespec_ns(&state->last_activity) +
+	       state->decay_interval * NS_PER_SEC;
+}
+
+// When the outputs go off, never while a password is being checked.
+static uint64_t power_off_deadline(struct prog_state *state) {
+	if (!state->config.power_off_after || state->powered_off ||
+	    state->auth_worker.running || state->unlock_timer_fd >= 0) {
+		return 0;
+	}
+	return timespec_ns(&state->last_activity) +
+	       state->config.power_off_after * NS_PER_SEC;
 }
 
 bool should_decay_state(struct prog_state *state) {
-	if (state->auth_state.current_state == AUTH_STATE_LOCKED) {
-		return false;
+	uint64_t deadline = decay_deadline(state);
+	return deadline && deadline <= startup_now_ns();
+}
+
+// A single timerfd covers decay and power off. Key presses only move the
+// deadlines later, so the timer is left alone then and re-armed for the
+// new deadline when it fires; a locker nobody touches never wakes up.
+static void arm_inactivity_timer(struct prog_state *state) {
+	if (state->inactivity_timer_fd < 0) {
+		return;
+	}
+	uint64_t deadline = decay_deadline(state);
+	uint64_t off_at = power_off_deadline(state);
+	if (off_at && (!deadline || off_at < deadline)) {
+		deadline = off_at;
+	}
+	uint64_t armed = state->inactivity_deadline_ns;
+	if (deadline == armed || (deadline && armed && deadline > armed)) {
+		return;
 	}
+	struct itimerspec spec = {
+	    .it_value = {.tv_sec = deadline / NS_PER_SEC,
+			 .tv_nsec = deadline % NS_PER_SEC},
+	};
+	timerfd_settime(state->inactivity_timer_fd, TFD_TIMER_ABSTIME, &spec,
+			NULL);
+	state->inactivity_deadline_ns = deadline;
+}
 
-	struct timespec current;
-	clock_gettime(CLOCK_MONOTONIC, &current);
-	int32_t elapsed =
-	    (current.tv_sec + current.tv_nsec * 1e-9) -
-	    (state->last_activity.tv_sec + state->last_activity.tv_nsec * 1e-9);
-	elapsed = abs(elapsed);
+static void handle_inactivity_timer(struct prog_state *state, int fd,
+				    short revents) {
+	uint64_t expirations;
+	if (read(fd, &expirations, sizeof(expirations)) !=
+	    sizeof(expirations)) {
+		return;
+	}
+	state->inactivity_deadline_ns = 0;
+	if (should_decay_state(state)) {
+		decay_to_locked(state);
+	}
+	uint64_t off_at = power_off_deadline(state);
+	if (off_at && off_at <= startup_now_ns()) {
+		// nothing may be left pending once the timers stop
+		if (state->decay_enabled &&
+		    state->auth_state.current_state != AUTH_STATE_LOCKED) {
+			decay_to_locked(state);
+		}
+		power_off(state);
+	}
+	arm_inactivity_timer(state);
+}
 
-	if (elapsed < state->decay_interval) {
-		return false;
+static int setup_inactivity_timer(struct prog_state *state) {
+	if (!state->decay_enabled && !state->config.power_off_after) {
+		return 0;
+	}
+	int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (fd < 0) {
+		return -1;
+	}
+	if (loop_add_fd(&state->loop, fd, POLLIN, LOOP_SOURCE_TIMER,
+			handle_inactivity_timer) != 0) {
+		close(fd);
+		return -1;
 	}
+	state->inactivity_timer_fd = fd;
+	update_last_activity(state);
+	arm_inactivity_timer(state);
+	return 0;
+}
 
-	return true;
+static int init_xkb(struct prog_state *state) {
+	state->xkb_context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+	return state->xkb_context ? 0 : -1;
 }
 
-void decay_timer_callback(void *data, struct wl_callback *wl_callback,
-			  uint32_t callback_data);
+static void handle_signal(struct prog_state *state, int fd, short revents) {
+	struct signalfd_siginfo info;
+	if (read(fd, &info, sizeof(info)) != sizeof(info)) {
+		return;
+	}
+	if (info.ssi_signo == SIGUSR1) {
+		trace_dump();
+	}
+}
 
-const struct wl_callback_listener decay_callback_listener = {
-    .done = decay_timer_callback,
-};
+// SIGUSR1 dumps the trace; it is blocked before any worker starts so every
+// thread leaves it to the signalfd.
+static int setup_trace(struct prog_state *state) {
+	trace_init(state->config.trace_file);
+	trace_thread_name("main");
 
-void decay_timer_callback(void *data, struct wl_callback *wl_callback,
-			  uint32_t callback_data) {
-	struct prog_state *state = (struct prog_state *)data;
-	if (wl_callback) {
-		wl_callback_destroy(wl_callback);
+	sigset_t mask;
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGUSR1);
+	if (sigprocmask(SIG_BLOCK, &mask, NULL) != 0) {
+		return -1;
 	}
-	if (should_decay_state(state)) {
-		decay_to_locked(state);
+	int fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (fd < 0) {
+		return -1;
 	}
-	state->decay_callback = wl_display_sync(state->display);
-	wl_callback_add_listener(state->decay_callback,
-				 &decay_callback_listener, state);
+	return loop_add_fd(&state->loop, fd, POLLIN, LOOP_SOURCE_SIGNAL,
+			   handle_signal);
+}
+
+static void handle_stats_timer(struct prog_state *state, int fd,
+			       short revents) {
+	uint64_t expirations;
+	if (read(fd, &expirations, sizeof(expirations)) !=
+	    sizeof(expirations)) {
+		return;
+	}
+	loop_stats_report(&state->loop, "periodic");
+}
+
+static int setup_loop_stats(struct prog_state *state) {
+	int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (fd < 0) {
+		return -1;
+	}
+	struct itimerspec interval = {
+	    .it_interval = {.tv_sec = state->config.loop_stats_interval},
+	    .it_value = {.tv_sec = state->config.loop_stats_interval},
+	};
+	if (timerfd_settime(fd, 0, &interval, NULL) != 0 ||
+	    loop_add_fd(&state->loop, fd, POLLIN, LOOP_SOURCE_TIMER,
+			handle_stats_timer) != 0) {
+		close(fd);
+		return -1;
+	}
+	return 0;
 }
 
-int main() {
+int main(int argc, char **argv) {
+	if (argc > 1 && strcmp(argv[1], AUTH_HELPER_ARG) == 0) {
+		return auth_helper_main(argc, argv);
+	}
 	struct prog_state state = {0};
-	state.decay_enabled = true;
-	state.auth_state.current_state = AUTH_STATE_LOCKED;
-	state.decay_interval = 10;
-	if (init_pam(&state) != 0) {
-		fprintf(stderr, "PAM start failed!!\n");
-		exit(2);
+	int ret = config_load(&state.config, argc, argv);
+	if (ret != 0) {
+		config_finish(&state.config);
+		return ret > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 	}
+	if (state.config.profile_startup) {
+		// the parent only collects, every run locks in a fresh process
+		ret = startup_profile(&state.startup,
+				      state.config.profile_startup);
+		if (ret <= 0) {
+			config_finish(&state.config);
+			return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+		// the runs measure a cold lock, not one prepared while idle
+		state.config.idle_timeout = 0;
+	}
+	fprintf(stderr, "profile: %s\n",
+		config_profile_name(state.config.profile));
 
-	state.xkb_context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+	wl_list_init(&state.outputs);
+	wl_list_init(&state.seats);
+	wl_list_init(&state.buffers);
+	state.decay_enabled = state.config.decay_enabled;
+	state.auth_state.current_state = AUTH_STATE_LOCKED;
+	state.decay_interval = state.config.decay_interval;
+	state.unlock_timer_fd = -1;
+	state.inactivity_timer_fd = -1;
+	state.clockface.timer_fd = -1;
+	state.clockface.tz_fd = -1;
+	state.auth_worker.done_fd = -1;
+	state.auth_worker.message_fd = -1;
+	state.auth_worker.messages.fd = -1;
+	state.auth_concurrent.messages.fd = -1;
 
-	getDisplay(&state);
+	if (state.config.trace_file && setup_trace(&state) != 0) {
+		fprintf(stderr, "could not set up tracing\n");
+	}
 
-	state.session_lock =
-	    ext_session_lock_manager_v1_lock(state.lock_manager);
-	ext_session_lock_v1_add_listener(state.session_lock, &lock_listener,
-					 &state);
+	log_init(state.config.log_level);
 
-	wl_display_roundtrip(state.display);
+	// everything that does not need the compositor runs on workers while
+	// the registry and lock handshakes are in flight
+	startup_begin(&state.startup);
+	startup_task_start(&state.startup.pam, "pam", init_pam, &state);
+	startup_task_start(&state.startup.xkb, "xkb", init_xkb, &state);
+	startup_task_start(&state.startup.fonts, "fonts", prepare_fonts,
+			   &state);
 
-	state.surface = wl_compositor_create_surface(state.compositor);
-	if (!state.surface) {
-		fprintf(stderr, "surface is null\n");
-		exit(2);
+	// no roundtrips: the handshake advances from the registry, locked and
+	// configure events, see registry_sync_done()
+	getDisplay(&state);
+	while (!lock_ready(&state)) {
+		if (loop_dispatch(&state, -1) < 0) {
+			fprintf(stderr, "lost the compositor while locking\n");
+			exit(EXIT_FAILURE);
+		}
 	}
-	state.lock_surface = ext_session_lock_v1_get_lock_surface(
-	    state.session_lock, state.surface, state.output);
-	ext_session_lock_surface_v1_add_listener(
-	    state.lock_surface, &lock_surface_listener, &state);
-	// wl_surface_commit(state.surface);
 
-	if (state.decay_enabled) {
-		state.decay_callback = wl_display_sync(state.display);
-		wl_callback_add_listener(state.decay_callback,
-					 &decay_callback_listener, &state);
+	if (setup_inactivity_timer(&state) != 0) {
+		fprintf(stderr, "could not set up the inactivity timer\n");
+	}
+	startup_phase(&state.startup, "first frame");
+	startup_report(&state);
+	if (state.config.low_memory && memory_watch(&state) != 0) {
+		log_info(LOG_CAT_CORE, "memory pressure (PSI) is not available");
+	}
+	memory_report(&state, "locked");
+	if (!state.startup.profiling) {
+		clockface_start(&state);
+		if (auth_concurrent_start(&state, auth_done) != 0) {
+			log_error(LOG_CAT_AUTH,
+				  "could not start the concurrent PAM service");
+		}
 	}
 
-	wl_display_roundtrip(state.display);
+	if (state.config.metrics_socket) {
+		metrics_listen(&state.loop, state.config.metrics_socket);
+	}
+	if (state.startup.profiling) {
+		// a profiled run is over once the lock is up and drawn
+		while (!startup_profile_done(&state.startup) &&
+		       loop_dispatch(&state, -1) >= 0)
+			;
+		startup_profile_submit(&state);
+		ext_session_lock_v1_unlock_and_destroy(state.session_lock);
+		state.session_lock = NULL;
+		state.locked = false;
+	}
+	if (state.config.input_trace_file) {
+		input_recorder_open(&state.input_recorder,
+				    state.config.input_trace_file);
+	}
 
+	if (state.config.loop_stats_interval && setup_loop_stats(&state) != 0) {
+		fprintf(stderr, "could not set up the loop stats timer\n");
+	}
+	// idle cost is only interesting once the lock is up
+	loop_stats_begin(&state.loop);
 	while (state.locked) {
-		if (wl_display_dispatch(state.display) < 0) {
-			fprintf(stderr, "wl_display_dispatch() failed\n");
+		if (loop_dispatch(&state, -1) < 0) {
+			fprintf(stderr, "event loop dispatch failed\n");
 			ext_session_lock_v1_unlock_and_destroy(
 			    state.session_lock);
 			break;
 		}
 	}
+	// the unlock was only queued, make sure the compositor has it
+	wl_display_roundtrip(state.display);
+	auth_concurrent_stop(&state);
+	// the worker reads the password and writes to loop fds until it is done
+	auth_finish(&state);
 
 	//  NOTE: Clear all memory maybe make a function to clean shit when
 	//  exiting
 	clearPasswordBuffer(&state.auth_state);
-	ext_session_lock_surface_v1_destroy(state.lock_surface);
+	secret_arena_finish(&state.auth_state.secret);
+	input_recorder_close(&state.input_recorder);
+	loop_stats_report(&state.loop, "exit");
+	memory_report(&state, "exit");
+	latency_report(&state);
+	if (state.config.metrics_file) {
+		metrics_write_textfile(state.config.metrics_file);
+	}
+	metrics_finish(&state.loop);
+	struct output_state *output, *tmp;
+	wl_list_for_each_safe(output, tmp, &state.outputs, link) {
+		output_destroy(output);
+	}
+	clockface_finish(&state);
+	struct seat_state *seat, *seat_tmp;
+	wl_list_for_each_safe(seat, seat_tmp, &state.seats, link) {
+		seat_destroy(seat);
+	}
+	keymap_cache_finish(&state.keymaps);
 	ext_session_lock_manager_v1_destroy(state.lock_manager);
-	munmap(state.pool_data, state.shm_pool_size);
-	wl_shm_pool_destroy(state.pool);
+	if (state.idle_notifier) {
+		ext_idle_notifier_v1_destroy(state.idle_notifier);
+	}
+	if (state.power_manager) {
+		zwlr_output_power_manager_v1_destroy(state.power_manager);
+	}
+	latency_finish(&state.latency);
 	wl_shm_destroy(state.shm);
-	wl_buffer_destroy(state.buffer);
-	wl_surface_destroy(state.surface);
+	if (state.subcompositor) {
+		wl_subcompositor_destroy(state.subcompositor);
+	}
 	wl_compositor_destroy(state.compositor);
+	wl_registry_destroy(state.registry);
+	image_loader_finish(&state.wallpaper);
+	startup_task_join(&state.startup.xkb);
+	startup_task_join(&state.startup.fonts);
+	cairo_font_face_destroy(state.icon_font);
+	cairo_font_face_destroy(state.text_font);
+	for (size_t i = 0; i < state.loop.count; i++) {
+		close(state.loop.sources[i].fd);
+	}
+	if (state.auth_worker.message_fd >= 0) {
+		close(state.auth_worker.message_fd);
+	}
+	trace_finish();
+	log_finish();
+	config_finish(&state.config);
 	wl_display_disconnect(state.display);
 
 	fprintf(stderr,
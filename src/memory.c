@@ -0,0 +1,139 @@
+#include "memory.h"
+#include "draw.h"
+#include "log.h"
+#include "loop.h"
+#include "metrics.h"
+#include "render.h"
+#include "state.h"
+#include <fcntl.h>
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#define PSI_PATH "/proc/pressure/memory"
+// 150 ms of stalls within 2 s, unprivileged triggers need a 2 s window
+#define PSI_TRIGGER "some 150000 2000000"
+
+uint64_t memory_rss(void) {
+	FILE *statm = fopen("/proc/self/statm", "r");
+	if (!statm) {
+		return 0;
+	}
+	unsigned long size, resident;
+	int fields = fscanf(statm, "%lu %lu", &size, &resident);
+	fclose(statm);
+	if (fields != 2) {
+		return 0;
+	}
+	return (uint64_t)resident * sysconf(_SC_PAGESIZE);
+}
+
+uint64_t memory_peak_rss(void) {
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) {
+		return 0;
+	}
+	return (uint64_t)usage.ru_maxrss * 1024;
+}
+
+// two buffers of width x height logical pixels at scale
+static uint64_t overlay_bytes(uint64_t width, uint64_t height,
+			      uint64_t scale) {
+	return 2 * width * height * 4 * scale * scale;
+}
+
+uint64_t memory_output_bound(struct output_state *output) {
+	struct prog_state *state = output->state;
+	struct render_params params = {.icon_size = state->config.icon_size};
+	uint64_t scale = state->config.hidpi ? output->scale : 1;
+	uint64_t ring = render_anim_size(&params);
+
+	uint64_t bytes = (uint64_t)output->width * output->height * 4 * scale *
+			 scale;
+	// the backdrop is the icon box, which the ring square covers
+	bytes += ring * ring * 4 * scale * scale;
+	if (state->config.animations) {
+		bytes += overlay_bytes(ring, ring, scale);
+	}
+	uint64_t notice = render_notice_width(&params);
+	if (notice > output->width) {
+		notice = output->width;
+	}
+	bytes += overlay_bytes(notice, render_notice_height(&params), scale);
+	if (state->config.clock) {
+		bytes += overlay_bytes(state->clockface.width,
+				       state->clockface.height, scale);
+	}
+	return bytes;
+}
+
+void memory_report(struct prog_state *state, const char *when) {
+	log_info(LOG_CAT_CORE, "memory (%s): rss %llu KiB, peak %llu KiB",
+		 when, (unsigned long long)memory_rss() / 1024,
+		 (unsigned long long)memory_peak_rss() / 1024);
+	if (!state->config.low_memory) {
+		return;
+	}
+	struct output_state *output;
+	wl_list_for_each(output, &state->outputs, link) {
+		if (output->width) {
+			log_info(LOG_CAT_OUTPUT,
+				 "memory: %ux%u output holds at most %llu KiB",
+				 output->width, output->height,
+				 (unsigned long long)memory_output_bound(
+				     output) / 1024);
+		}
+	}
+}
+
+void memory_frames_done(struct prog_state *state) {
+	if (state->config.low_memory) {
+		release_wallpaper(state);
+	}
+}
+
+void memory_trim(struct prog_state *state) {
+	release_wallpaper(state);
+	struct output_state *output;
+	wl_list_for_each(output, &state->outputs, link) {
+		if (state->anim.kind == ANIM_NONE) {
+			anim_output_finish(&output->anim);
+		}
+		if (state->notice.text[0] == '\0') {
+			overlay_finish(&output->notice);
+		}
+	}
+	// freed frames and decoder buffers are often still held by malloc
+	malloc_trim(0);
+	metrics_count(METRIC_MEMORY_TRIMS);
+	memory_report(state, "trimmed");
+}
+
+static void handle_pressure(struct prog_state *state, int fd,
+			    short revents) {
+	if (revents & POLLERR) {
+		// the trigger was destroyed, e.g. the cgroup went away
+		loop_remove_fd(&state->loop, fd);
+		close(fd);
+		return;
+	}
+	log_info(LOG_CAT_CORE, "memory pressure, trimming");
+	memory_trim(state);
+}
+
+int memory_watch(struct prog_state *state) {
+	int fd = open(PSI_PATH, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0) {
+		return -1;
+	}
+	if (write(fd, PSI_TRIGGER, strlen(PSI_TRIGGER) + 1) < 0 ||
+	    loop_add_fd(&state->loop, fd, POLLPRI, LOOP_SOURCE_OTHER,
+			handle_pressure) != 0) {
+		close(fd);
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,259 @@
+#include "metrics.h"
+#include "loop.h"
+#include "memory.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// HDR style log-linear buckets: four per power of two from 1us to ~2 min,
+// so every bucket is within 25% of the values it holds.
+#define SUB_BUCKETS 4
+#define MIN_SHIFT 10
+#define MAX_SHIFT 36
+#define BUCKETS (1 + (MAX_SHIFT - MIN_SHIFT + 1) * SUB_BUCKETS)
+
+struct histogram {
+	atomic_uint_fast64_t buckets[BUCKETS + 1]; // last one is +Inf
+	atomic_uint_fast64_t sum_ns;
+	atomic_uint_fast64_t count;
+};
+
+struct metric_info {
+	const char *name;
+	const char *help;
+};
+
+static const struct metric_info counter_info[] = {
+    [METRIC_AUTH_ATTEMPTS] = {"locker_auth_attempts_total",
+			      "Passwords submitted to PAM"},
+    [METRIC_AUTH_FAILURES] = {"locker_auth_failures_total",
+			      "Passwords PAM rejected"},
+    [METRIC_DECAYS] = {"locker_decays_total",
+		       "Typed passwords cleared after inactivity"},
+    [METRIC_BUFFERS_ALLOCATED] = {"locker_buffers_allocated_total",
+				  "Shared memory buffers created"},
+    [METRIC_LOOP_ITERATIONS] = {"locker_loop_iterations_total",
+				"Event loop dispatch iterations"},
+    [METRIC_WAKEUPS_WAYLAND] = {"locker_wakeups_wayland_total",
+				"Event loop wakeups by the compositor"},
+    [METRIC_WAKEUPS_TIMER] = {"locker_wakeups_timer_total",
+			      "Event loop wakeups by timers"},
+    [METRIC_WAKEUPS_SIGNAL] = {"locker_wakeups_signal_total",
+			       "Event loop wakeups by signals"},
+    [METRIC_WAKEUPS_OTHER] = {"locker_wakeups_other_total",
+			      "Event loop wakeups by other sources"},
+    [METRIC_MEMORY_TRIMS] = {"locker_memory_trims_total",
+			     "Caches dropped under memory pressure"},
+    [METRIC_KEYMAP_COMPILES] = {"locker_keymap_compiles_total",
+				"Keymaps compiled, the cached ones excluded"},
+};
+
+static const struct metric_info histogram_info[] = {
+    [METRIC_FRAME_RENDER] = {"locker_frame_render_seconds",
+			     "Time to paint one buffer"},
+    [METRIC_PAM_AUTHENTICATE] = {"locker_pam_authenticate_seconds",
+				 "Duration of pam_authenticate"},
+    [METRIC_ANIM_FRAME] = {"locker_anim_frame_seconds",
+			   "Time to paint one frame of the feedback ring"},
+};
+
+static const struct metric_info gauge_info[] = {
+    [METRIC_TIME_TO_LOCK] = {"locker_time_to_lock_seconds",
+			     "From process start to the locked event"},
+    [METRIC_LOCKED_CPU_USER] = {"locker_locked_cpu_user_seconds",
+				"User CPU time while locked, at the last "
+				"loop report"},
+    [METRIC_LOCKED_CPU_SYSTEM] = {"locker_locked_cpu_system_seconds",
+				  "System CPU time while locked, at the "
+				  "last loop report"},
+};
+
+static atomic_uint_fast64_t counters[METRIC_COUNTER_COUNT];
+static struct histogram histograms[METRIC_HISTOGRAM_COUNT];
+static atomic_uint_fast64_t gauges[METRIC_GAUGE_COUNT];
+
+static int listen_fd = -1;
+static char listen_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+
+// A bucket holds the values above the previous bound up to and including its
+// own, like the le label it is exported with.
+static size_t bucket_index(uint64_t ns) {
+	if (ns <= (1ull << MIN_SHIFT)) {
+		return 0;
+	}
+	ns--;
+	int shift = 63 - __builtin_clzll(ns);
+	if (shift > MAX_SHIFT) {
+		return BUCKETS;
+	}
+	size_t sub = (ns >> (shift - 2)) & (SUB_BUCKETS - 1);
+	return 1 + (shift - MIN_SHIFT) * SUB_BUCKETS + sub;
+}
+
+static uint64_t bucket_bound(size_t index) {
+	if (index == 0) {
+		return 1ull << MIN_SHIFT;
+	}
+	int shift = MIN_SHIFT + (index - 1) / SUB_BUCKETS;
+	uint64_t sub = (index - 1) % SUB_BUCKETS;
+	return (SUB_BUCKETS + sub + 1) << (shift - 2);
+}
+
+void metrics_count(metric_counter_t counter) {
+	atomic_fetch_add_explicit(&counters[counter], 1, memory_order_relaxed);
+}
+
+void metrics_observe(metric_histogram_t histogram, uint64_t ns) {
+	struct histogram *h = &histograms[histogram];
+	atomic_fetch_add_explicit(&h->buckets[bucket_index(ns)], 1,
+				  memory_order_relaxed);
+	atomic_fetch_add_explicit(&h->sum_ns, ns, memory_order_relaxed);
+	atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+}
+
+void metrics_set(metric_gauge_t gauge, uint64_t ns) {
+	atomic_store_explicit(&gauges[gauge], ns, memory_order_relaxed);
+}
+
+static uint64_t load(atomic_uint_fast64_t *value) {
+	return atomic_load_explicit(value, memory_order_relaxed);
+}
+
+void metrics_write(FILE *out) {
+	for (size_t i = 0; i < METRIC_COUNTER_COUNT; i++) {
+		fprintf(out, "# HELP %s %s\n# TYPE %s counter\n%s %lu\n",
+			counter_info[i].name, counter_info[i].help,
+			counter_info[i].name, counter_info[i].name,
+			(unsigned long)load(&counters[i]));
+	}
+	for (size_t i = 0; i < METRIC_GAUGE_COUNT; i++) {
+		fprintf(out, "# HELP %s %s\n# TYPE %s gauge\n%s %.9f\n",
+			gauge_info[i].name, gauge_info[i].help,
+			gauge_info[i].name, gauge_info[i].name,
+			load(&gauges[i]) / 1e9);
+	}
+
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) == 0) {
+		fprintf(out,
+			"# HELP locker_peak_rss_bytes Peak resident set size\n"
+			"# TYPE locker_peak_rss_bytes gauge\n"
+			"locker_peak_rss_bytes %ld\n",
+			usage.ru_maxrss * 1024);
+	}
+	fprintf(out,
+		"# HELP locker_rss_bytes Resident set size\n"
+		"# TYPE locker_rss_bytes gauge\n"
+		"locker_rss_bytes %llu\n",
+		(unsigned long long)memory_rss());
+
+	for (size_t i = 0; i < METRIC_HISTOGRAM_COUNT; i++) {
+		const char *name = histogram_info[i].name;
+		struct histogram *h = &histograms[i];
+		fprintf(out, "# HELP %s %s\n# TYPE %s histogram\n", name,
+			histogram_info[i].help, name);
+		uint64_t cumulative = 0;
+		for (size_t b = 0; b < BUCKETS; b++) {
+			cumulative += load(&h->buckets[b]);
+			fprintf(out, "%s_bucket{le=\"%.9g\"} %lu\n", name,
+				bucket_bound(b) / 1e9,
+				(unsigned long)cumulative);
+		}
+		// concurrent writers can make the total run ahead of the
+		// buckets, keep +Inf consistent with _count
+		uint64_t count = load(&h->count);
+		fprintf(out,
+			"%s_bucket{le=\"+Inf\"} %lu\n%s_sum %.9f\n"
+			"%s_count %lu\n",
+			name, (unsigned long)count, name,
+			load(&h->sum_ns) / 1e9, name, (unsigned long)count);
+	}
+}
+
+int metrics_write_textfile(const char *path) {
+	char tmp[PATH_MAX];
+	if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp)) {
+		return -1;
+	}
+	FILE *out = fopen(tmp, "w");
+	if (!out) {
+		perror(tmp);
+		return -1;
+	}
+	metrics_write(out);
+	if (fclose(out) != 0 || rename(tmp, path) != 0) {
+		perror(path);
+		unlink(tmp);
+		return -1;
+	}
+	return 0;
+}
+
+static void handle_client(struct prog_state *state, int fd, short revents) {
+	int client = accept(fd, NULL, NULL);
+	if (client < 0) {
+		return;
+	}
+	fcntl(client, F_SETFD, FD_CLOEXEC);
+	// a scraper that stops reading must not stall the locker
+	struct timeval timeout = {.tv_usec = 100000};
+	setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+	FILE *out = fdopen(client, "w");
+	if (!out) {
+		close(client);
+		return;
+	}
+	metrics_write(out);
+	fclose(out);
+}
+
+int metrics_listen(struct event_loop *loop, const char *path) {
+	struct sockaddr_un addr = {.sun_family = AF_UNIX};
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "metrics socket path too long\n");
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		return -1;
+	}
+	// a socket left by an earlier run is in the way, anything else is not
+	// ours to delete
+	struct stat st;
+	if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+		unlink(path);
+	}
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+	    listen(fd, 4) != 0 ||
+	    loop_add_fd(loop, fd, POLLIN, LOOP_SOURCE_OTHER, handle_client) !=
+		0) {
+		fprintf(stderr, "metrics socket %s: %s\n", path,
+			strerror(errno));
+		close(fd);
+		return -1;
+	}
+	listen_fd = fd;
+	strcpy(listen_path, path);
+	return 0;
+}
+
+void metrics_finish(struct event_loop *loop) {
+	if (listen_fd < 0) {
+		return;
+	}
+	loop_remove_fd(loop, listen_fd);
+	close(listen_fd);
+	unlink(listen_path);
+	listen_fd = -1;
+}
@@ -0,0 +1,70 @@
+#include "notice.h"
+#include "overlay.h"
+#include "render.h"
+#include "state.h"
+#include "trace.h"
+#include <stdio.h>
+#include <string.h>
+
+void notice_draw(struct output_state *output) {
+	struct prog_state *state = output->state;
+	struct overlay *overlay = &output->notice;
+	// an overlay is only created for the first message
+	if (!overlay->surface && state->notice.text[0] == '\0') {
+		return;
+	}
+	startup_task_join(&state->startup.fonts);
+	struct render_params params = {
+	    .icon_font = state->icon_font,
+	    .icon_font_family = state->config.icon_font,
+	    .text_font = state->text_font,
+	    .icon_size = state->config.icon_size,
+	};
+	uint32_t width = render_notice_width(&params);
+	if (width > output->width) {
+		width = output->width;
+	}
+	uint32_t height = render_notice_height(&params);
+	int32_t x, y;
+	render_notice_origin(&params, output->width, output->height, width, &x,
+			     &y);
+	overlay->released = notice_draw;
+	if (!overlay_place(overlay, output, x, y, width, height)) {
+		return;
+	}
+	struct overlay_buffer *buffer = overlay_buffer(overlay);
+	if (!buffer) {
+		return;
+	}
+
+	TRACE_BEGIN("notice");
+	render_notice(&params, state->notice.text, state->notice.error, width,
+		      height, overlay->width * 4, overlay->scale, buffer->data);
+	overlay_commit(overlay, buffer, 0, 0, overlay->width, overlay->height);
+	TRACE_END("notice");
+}
+
+static void draw_all(struct prog_state *state) {
+	struct output_state *output;
+	wl_list_for_each(output, &state->outputs, link) {
+		notice_draw(output);
+	}
+}
+
+void notice_show(struct prog_state *state, const char *text, bool error) {
+	struct notice *notice = &state->notice;
+	if (notice->error == error && strcmp(notice->text, text) == 0) {
+		return;
+	}
+	snprintf(notice->text, sizeof(notice->text), "%s", text);
+	notice->error = error;
+	draw_all(state);
+}
+
+void notice_clear(struct prog_state *state) {
+	if (state->notice.text[0] == '\0') {
+		return;
+	}
+	state->notice.text[0] = '\0';
+	draw_all(state);
+}
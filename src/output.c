@@ -0,0 +1,226 @@
+#include "draw.h"
+#include "ext-session-lock-v1-protocol.h"
+#include "log.h"
+#include "memory.h"
+#include "state.h"
+#include "trace.h"
+#include "wlr-output-power-management-unstable-v1-protocol.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <wayland-client-protocol.h>
+#include <wayland-client.h>
+
+static void output_geometry(void *data, struct wl_output *wl_output, int32_t x,
+			    int32_t y, int32_t physical_width,
+			    int32_t physical_height, int32_t subpixel,
+			    const char *make, const char *model,
+			    int32_t transform) {
+	log_info(LOG_CAT_OUTPUT, "Physical screen widthxheight: %dx%d mm",
+		 physical_width, physical_height);
+}
+
+static void output_mode(void *data, struct wl_output *wl_output, uint32_t flags,
+			int32_t width, int32_t height, int32_t refresh) {
+	struct output_state *output = data;
+	if (flags & WL_OUTPUT_MODE_CURRENT) {
+		log_info(LOG_CAT_OUTPUT, "Screen resolution: %dx%d pixels",
+			 width, height);
+		output->mode_width = width;
+		output->mode_height = height;
+	}
+}
+
+static void output_done(void *data, struct wl_output *wl_output) {
+	struct output_state *output = data;
+	output->done = true;
+	maybe_load_wallpaper(output->state);
+}
+
+static void output_scale(void *data, struct wl_output *wl_output,
+			 int32_t factor) {
+	struct output_state *output = data;
+	output->scale = factor;
+}
+
+static const struct wl_output_listener output_listener = {
+    .geometry = output_geometry,
+    .mode = output_mode,
+    .done = output_done,
+    .scale = output_scale,
+};
+
+// Returns a buffer of the requested size, reusing one that another output
+// already renders into when the size and scale match.
+static struct lock_buffer *acquire_buffer(struct prog_state *state,
+					  uint32_t width, uint32_t height,
+					  uint32_t scale) {
+	struct lock_buffer *buffer;
+	wl_list_for_each(buffer, &state->buffers, link) {
+		if (buffer->width == width && buffer->height == height &&
+		    buffer->scale == scale) {
+			buffer->users++;
+			return buffer;
+		}
+	}
+
+	buffer = createBuffer(width, height, width * 4, scale, state);
+	if (buffer) {
+		buffer->users = 1;
+	}
+	return buffer;
+}
+
+static void release_buffer(struct lock_buffer *buffer) {
+	if (buffer && --buffer->users == 0) {
+		destroyBuffer(buffer);
+	}
+}
+
+static void lock_surface_configure(
+    void *data, struct ext_session_lock_surface_v1 *ext_session_lock_surface_v1,
+    uint32_t serial, uint32_t width, uint32_t height) {
+	log_debug(LOG_CAT_OUTPUT, "Lock surface Configure called: %dx%d",
+		  width, height);
+	struct output_state *output = data;
+	TRACE_BEGIN("configure");
+	startup_mark(&output->state->startup, STARTUP_MARK_CONFIGURE);
+
+	output->width = width;
+	output->height = height;
+
+	uint32_t scale = output->state->config.hidpi ? output->scale : 1;
+	uint32_t buffer_width = width * scale;
+	uint32_t buffer_height = height * scale;
+
+	// a configure may split an output away from the buffer it shared
+	if (!output->buffer || output->buffer->width != buffer_width ||
+	    output->buffer->height != buffer_height ||
+	    output->buffer->scale != scale) {
+		struct lock_buffer *old = output->buffer;
+		output->buffer = acquire_buffer(output->state, buffer_width,
+						buffer_height, scale);
+		release_buffer(old);
+		if (output->buffer) {
+			startup_mark(&output->state->startup,
+				     STARTUP_MARK_BUFFER);
+			log_debug(LOG_CAT_OUTPUT, "Buffer ready (%u users)",
+				  output->buffer->users);
+		} else {
+			log_error(LOG_CAT_OUTPUT, "Buffer creation failed!");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	TRACE_BEGIN("attach and commit");
+	wl_surface_set_buffer_scale(output->surface, scale);
+	wl_surface_attach(output->surface, output->buffer->buffer, 0, 0);
+	ext_session_lock_surface_v1_ack_configure(ext_session_lock_surface_v1,
+						  serial);
+	wl_surface_commit(output->surface);
+	output->buffer->busy = true;
+	startup_mark(&output->state->startup, STARTUP_MARK_COMMIT);
+	TRACE_END("attach and commit");
+	// a new or resized surface needs the clock (re)placed
+	clockface_draw(output);
+	notice_draw(output);
+	memory_frames_done(output->state);
+	TRACE_END("configure");
+}
+
+static const struct ext_session_lock_surface_v1_listener lock_surface_listener =
+    {
+	.configure = lock_surface_configure,
+};
+
+struct output_state *output_create(struct prog_state *state,
+				   struct wl_output *wl_output,
+				   uint32_t global_name) {
+	struct output_state *output = calloc(1, sizeof(*output));
+	if (!output) {
+		return NULL;
+	}
+	output->state = state;
+	output->output = wl_output;
+	output->global_name = global_name;
+	output->scale = 1;
+	latency_stats_init(&output->latency);
+	wl_output_add_listener(wl_output, &output_listener, output);
+	wl_list_insert(&state->outputs, &output->link);
+	return output;
+}
+
+void output_create_lock_surface(struct output_state *output) {
+	struct prog_state *state = output->state;
+	if (output->lock_surface) {
+		return;
+	}
+
+	output->surface = wl_compositor_create_surface(state->compositor);
+	if (!output->surface) {
+		log_error(LOG_CAT_OUTPUT, "surface is null");
+		exit(2);
+	}
+	output->lock_surface = ext_session_lock_v1_get_lock_surface(
+	    state->session_lock, output->surface, output->output);
+	ext_session_lock_surface_v1_add_listener(output->lock_surface,
+						 &lock_surface_listener, output);
+}
+
+void output_prepare_buffer(struct output_state *output) {
+	struct prog_state *state = output->state;
+	if (output->buffer || output->mode_width <= 0 ||
+	    output->mode_height <= 0) {
+		return;
+	}
+	// lock surfaces cover the output at its logical size, a guess that
+	// turns out wrong (e.g. a rotated output) is replaced on configure
+	int32_t output_scale = output->scale > 0 ? output->scale : 1;
+	uint32_t scale = state->config.hidpi ? output_scale : 1;
+	uint32_t width = output->mode_width / output_scale * scale;
+	uint32_t height = output->mode_height / output_scale * scale;
+	output->buffer = acquire_buffer(state, width, height, scale);
+	if (!output->buffer) {
+		log_warn(LOG_CAT_OUTPUT, "could not prepare a %ux%u buffer",
+			 width, height);
+	}
+}
+
+void output_drop_buffer(struct output_state *output) {
+	release_buffer(output->buffer);
+	output->buffer = NULL;
+}
+
+void output_restore_buffer(struct output_state *output) {
+	struct prog_state *state = output->state;
+	if (output->buffer || !output->width) {
+		return;
+	}
+	uint32_t scale = state->config.hidpi ? output->scale : 1;
+	output->buffer = acquire_buffer(state, output->width * scale,
+					output->height * scale, scale);
+	if (!output->buffer) {
+		log_error(LOG_CAT_OUTPUT, "Buffer creation failed!");
+		exit(EXIT_FAILURE);
+	}
+}
+
+void output_destroy(struct output_state *output) {
+	wl_list_remove(&output->link);
+	anim_output_finish(&output->anim);
+	overlay_finish(&output->clockface);
+	overlay_finish(&output->notice);
+	if (output->power) {
+		zwlr_output_power_v1_destroy(output->power);
+	}
+	if (output->lock_surface) {
+		ext_session_lock_surface_v1_destroy(output->lock_surface);
+	}
+	if (output->surface) {
+		wl_surface_destroy(output->surface);
+	}
+	release_buffer(output->buffer);
+	latency_stats_finish(&output->latency);
+	wl_output_destroy(output->output);
+	free(output);
+}
@@ -0,0 +1,152 @@
+#include "overlay.h"
+#include "latency.h"
+#include "log.h"
+#include "shared_memory.h"
+#include "state.h"
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <wayland-client-protocol.h>
+#include <wayland-client.h>
+
+static void buffer_release(void *data, struct wl_buffer *wl_buffer) {
+	struct overlay *overlay = data;
+	for (size_t i = 0; i < 2; i++) {
+		if (overlay->buffers[i].buffer == wl_buffer) {
+			overlay->buffers[i].busy = false;
+		}
+	}
+	if (overlay->waiting) {
+		overlay->waiting = false;
+		if (overlay->released) {
+			overlay->released(overlay->output);
+		}
+	}
+}
+
+static const struct wl_buffer_listener buffer_listener = {
+    .release = buffer_release,
+};
+
+static void free_buffers(struct overlay *overlay) {
+	for (size_t i = 0; i < 2; i++) {
+		if (overlay->buffers[i].buffer) {
+			wl_buffer_destroy(overlay->buffers[i].buffer);
+		}
+	}
+	if (overlay->pool_data) {
+		munmap(overlay->pool_data, overlay->pool_size);
+	}
+	memset(overlay->buffers, 0, sizeof(overlay->buffers));
+	overlay->pool_data = NULL;
+	overlay->pool_size = 0;
+	overlay->width = 0;
+	overlay->height = 0;
+}
+
+// Two buffers from one pool, one is drawn while the other is on screen.
+static int create_buffers(struct overlay *overlay, struct wl_shm *shm,
+			  uint32_t width, uint32_t height) {
+	uint32_t stride = width * 4;
+	size_t bytes = (size_t)stride * height;
+	int fd = allocate_shm_file(bytes * 2);
+	if (fd < 0) {
+		return -1;
+	}
+	uint8_t *data =
+	    mmap(NULL, bytes * 2, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (data == MAP_FAILED) {
+		close(fd);
+		return -1;
+	}
+	struct wl_shm_pool *pool = wl_shm_create_pool(shm, fd, bytes * 2);
+	for (size_t i = 0; i < 2; i++) {
+		overlay->buffers[i].data = data + bytes * i;
+		overlay->buffers[i].buffer =
+		    wl_shm_pool_create_buffer(pool, bytes * i, width, height,
+					      stride, WL_SHM_FORMAT_ARGB8888);
+		wl_buffer_add_listener(overlay->buffers[i].buffer,
+				       &buffer_listener, overlay);
+	}
+	wl_shm_pool_destroy(pool);
+	close(fd);
+	overlay->pool_data = data;
+	overlay->pool_size = bytes * 2;
+	overlay->width = width;
+	overlay->height = height;
+	return 0;
+}
+
+bool overlay_place(struct overlay *overlay, struct output_state *output,
+		   int32_t x, int32_t y, uint32_t width, uint32_t height) {
+	struct prog_state *state = output->state;
+	if (!output->width || !output->surface || !state->subcompositor) {
+		return false;
+	}
+	if (!overlay->surface) {
+		overlay->output = output;
+		overlay->surface = wl_compositor_create_surface(state->compositor);
+		overlay->subsurface = wl_subcompositor_get_subsurface(
+		    state->subcompositor, overlay->surface, output->surface);
+		wl_subsurface_set_desync(overlay->subsurface);
+		struct wl_region *region =
+		    wl_compositor_create_region(state->compositor);
+		wl_surface_set_input_region(overlay->surface, region);
+		wl_region_destroy(region);
+		overlay->x = INT32_MIN;
+	}
+
+	uint32_t scale = state->config.hidpi ? output->scale : 1;
+	if (overlay->width != width * scale ||
+	    overlay->height != height * scale) {
+		free_buffers(overlay);
+		if (create_buffers(overlay, state->shm, width * scale,
+				   height * scale) != 0) {
+			log_warn(LOG_CAT_RENDER, "no buffer for an overlay");
+			return false;
+		}
+		overlay->scale = scale;
+		wl_surface_set_buffer_scale(overlay->surface, scale);
+	}
+
+	if (x != overlay->x || y != overlay->y) {
+		wl_subsurface_set_position(overlay->subsurface, x, y);
+		// the position is applied with the parent's state
+		wl_surface_commit(output->surface);
+		overlay->x = x;
+		overlay->y = y;
+	}
+	return true;
+}
+
+struct overlay_buffer *overlay_buffer(struct overlay *overlay) {
+	for (size_t i = 0; i < 2; i++) {
+		if (!overlay->buffers[i].busy) {
+			return &overlay->buffers[i];
+		}
+	}
+	overlay->waiting = true;
+	return NULL;
+}
+
+void overlay_commit(struct overlay *overlay, struct overlay_buffer *buffer,
+		    int32_t x, int32_t y, int32_t width, int32_t height) {
+	wl_surface_attach(overlay->surface, buffer->buffer, 0, 0);
+	wl_surface_damage_buffer(overlay->surface, x, y, width, height);
+	// without redraw_typing the ring is all a key press changes
+	latency_commit(overlay->output, overlay->surface);
+	wl_surface_commit(overlay->surface);
+	buffer->busy = true;
+}
+
+void overlay_finish(struct overlay *overlay) {
+	free_buffers(overlay);
+	if (overlay->subsurface) {
+		wl_subsurface_destroy(overlay->subsurface);
+	}
+	if (overlay->surface) {
+		wl_surface_destroy(overlay->surface);
+	}
+	memset(overlay, 0, sizeof(*overlay));
+}
@@ -0,0 +1,92 @@
+#include "power.h"
+#include "log.h"
+#include "memory.h"
+#include "output.h"
+#include "state.h"
+#include "trace.h"
+#include "wlr-output-power-management-unstable-v1-protocol.h"
+#include <stdint.h>
+#include <wayland-client.h>
+
+static void output_power_mode(void *data, struct zwlr_output_power_v1 *power,
+			      uint32_t mode) {
+	log_debug(LOG_CAT_OUTPUT, "output power %s",
+		  mode == ZWLR_OUTPUT_POWER_V1_MODE_ON ? "on" : "off");
+}
+
+static void output_power_failed(void *data,
+				struct zwlr_output_power_v1 *power) {
+	struct output_state *output = data;
+	log_warn(LOG_CAT_OUTPUT, "the output cannot be powered off");
+	zwlr_output_power_v1_destroy(output->power);
+	output->power = NULL;
+}
+
+static const struct zwlr_output_power_v1_listener output_power_listener = {
+    .mode = output_power_mode,
+    .failed = output_power_failed,
+};
+
+static void set_mode(struct output_state *output, uint32_t mode) {
+	struct prog_state *state = output->state;
+	if (!output->power) {
+		if (!state->power_manager) {
+			return;
+		}
+		output->power = zwlr_output_power_manager_v1_get_output_power(
+		    state->power_manager, output->output);
+		zwlr_output_power_v1_add_listener(
+		    output->power, &output_power_listener, output);
+	}
+	zwlr_output_power_v1_set_mode(output->power, mode);
+}
+
+void power_bind(struct prog_state *state, struct wl_registry *registry,
+		uint32_t name) {
+	state->power_manager = wl_registry_bind(
+	    registry, name, &zwlr_output_power_manager_v1_interface, 1);
+}
+
+void power_off(struct prog_state *state) {
+	if (state->powered_off) {
+		return;
+	}
+	anim_start(state, ANIM_NONE);
+	clockface_suspend(state);
+	state->powered_off = true;
+	if (!state->power_manager) {
+		log_warn(LOG_CAT_OUTPUT, "the compositor cannot power outputs "
+					 "off, only freeing the frames");
+	}
+
+	TRACE_BEGIN("power off");
+	struct output_state *output;
+	wl_list_for_each(output, &state->outputs, link) {
+		set_mode(output, ZWLR_OUTPUT_POWER_V1_MODE_OFF);
+		output_drop_buffer(output);
+	}
+	TRACE_END("power off");
+	log_info(LOG_CAT_OUTPUT, "outputs powered off");
+}
+
+void power_on(struct prog_state *state) {
+	if (!state->powered_off) {
+		return;
+	}
+	state->powered_off = false;
+
+	TRACE_BEGIN("power on");
+	struct output_state *output;
+	wl_list_for_each(output, &state->outputs, link) {
+		set_mode(output, ZWLR_OUTPUT_POWER_V1_MODE_ON);
+	}
+	// panels take longer to wake up than a frame takes to render
+	wl_display_flush(state->display);
+	wl_list_for_each(output, &state->outputs, link) {
+		output_restore_buffer(output);
+	}
+	clockface_resume(state);
+	memory_frames_done(state);
+	TRACE_END("power on");
+	log_info(LOG_CAT_OUTPUT, "outputs powered on");
+}
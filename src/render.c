@@ -0,0 +1,637 @@
+#include "render.h"
+#include "theme.h"
+#include <cairo.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// the icon sits this many logical pixels below the centre
+#define ICON_OFFSET 200
+// HUD box in logical pixels, sized for its three lines of text
+#define HUD_MARGIN 10
+#define HUD_WIDTH 300
+#define HUD_HEIGHT 58
+#define HUD_FONT_SIZE 12
+// feedback ring timings, in seconds
+#define ANIM_TYPING_DURATION 0.35
+#define ANIM_SHAKE_DURATION 0.5
+#define ANIM_SHAKE_FREQUENCY 6.0
+#define ANIM_SPINNER_TURNS 1.0 // per second
+#define TURN 6.28318530717958647692 // a full circle in radians
+// clock text sizes relative to the icon, and the drop shadow offset
+#define CLOCK_TIME_SIZE 1.6
+#define CLOCK_DATE_SIZE 0.45
+#define CLOCK_SHADOW 1
+// PAM message line below the ring, relative to the icon
+#define NOTICE_FONT_SIZE 0.35
+#define NOTICE_WIDTH 12
+
+const char *render_icon_text(auth_state_t icon) {
+	switch (icon) {
+	case AUTH_STATE_LOCKED:
+		return "";
+	case AUTH_STATE_SUCCESS:
+		return "";
+	case AUTH_STATE_TYPING:
+		return "";
+	case AUTH_STATE_AUTHENTICATING:
+		return "";
+	}
+	fprintf(stderr, "Some invalid state for auth_state_t\n");
+	return "";
+}
+
+auth_state_t render_visible_icon(auth_state_t state, bool redraw_typing) {
+	if (state == AUTH_STATE_TYPING && !redraw_typing) {
+		return AUTH_STATE_LOCKED;
+	}
+	return state;
+}
+
+static struct render_rect round_out(double x, double y, double width,
+				    double height) {
+	int32_t x0 = floor(x), y0 = floor(y);
+	return (struct render_rect){
+	    .x = x0,
+	    .y = y0,
+	    .width = (int32_t)ceil(x + width) - x0,
+	    .height = (int32_t)ceil(y + height) - y0,
+	};
+}
+
+static struct render_rect rect_union(struct render_rect a,
+				     struct render_rect b) {
+	if (a.width <= 0 || a.height <= 0) {
+		return b;
+	}
+	int32_t x0 = a.x < b.x ? a.x : b.x;
+	int32_t y0 = a.y < b.y ? a.y : b.y;
+	int32_t x1 = a.x + a.width > b.x + b.width ? a.x + a.width
+						   : b.x + b.width;
+	int32_t y1 = a.y + a.height > b.y + b.height ? a.y + a.height
+						     : b.y + b.height;
+	return (struct render_rect){x0, y0, x1 - x0, y1 - y0};
+}
+
+static struct render_rect rect_clamp(struct render_rect r, uint32_t width,
+				     uint32_t height) {
+	int32_t x0 = r.x < 0 ? 0 : r.x;
+	int32_t y0 = r.y < 0 ? 0 : r.y;
+	int32_t x1 = r.x + r.width > (int32_t)width ? (int32_t)width
+						      : r.x + r.width;
+	int32_t y1 = r.y + r.height > (int32_t)height ? (int32_t)height
+						       : r.y + r.height;
+	if (x1 <= x0 || y1 <= y0) {
+		return (struct render_rect){0};
+	}
+	return (struct render_rect){x0, y0, x1 - x0, y1 - y0};
+}
+
+// Works out where the icon's origin goes and the pixels it will touch.
+static struct render_rect place_icon(cairo_t *cr,
+				     const struct render_params *params,
+				     auth_state_t icon, uint32_t width,
+				     uint32_t height, uint32_t scale,
+				     const struct theme_glyph **glyph_out,
+				     double *x, double *y) {
+	uint32_t size = params->icon_size * scale;
+	const struct theme_glyph *glyph = theme_find_glyph(icon, size);
+	*glyph_out = glyph;
+	if (glyph) {
+		*x = width / 2.0 - (glyph->ink_width / 2.0 + glyph->x_bearing);
+		*y = height / 2.0 -
+		     (glyph->ink_height / 2.0 + glyph->y_bearing) +
+		     ICON_OFFSET * scale;
+		return round_out(*x + glyph->x_offset, *y + glyph->y_offset,
+				 glyph->width, glyph->height);
+	}
+
+	if (params->icon_font) {
+		cairo_set_font_face(cr, params->icon_font);
+	} else {
+		cairo_select_font_face(cr, params->icon_font_family,
+				       CAIRO_FONT_SLANT_NORMAL,
+				       CAIRO_FONT_WEIGHT_BOLD);
+	}
+	cairo_set_font_size(cr, size);
+
+	cairo_text_extents_t extents;
+	cairo_text_extents(cr, render_icon_text(icon), &extents);
+	*x = width / 2.0 - (extents.width / 2.0 + extents.x_bearing);
+	*y = height / 2.0 - (extents.height / 2.0 + extents.y_bearing) +
+	     ICON_OFFSET * scale;
+	// a pixel of antialiasing on every side of the ink
+	return round_out(*x + extents.x_bearing - 1, *y + extents.y_bearing - 1,
+			 extents.width + 2, extents.height + 2);
+}
+
+static void draw_icon(cairo_t *cr, const struct render_params *params,
+		      auth_state_t icon, uint32_t width, uint32_t height,
+		      uint32_t scale) {
+	const struct theme_glyph *glyph;
+	double x, y;
+	place_icon(cr, params, icon, width, height, scale, &glyph, &x, &y);
+
+	cairo_set_source_rgb(cr, 0, 0, 0);
+	if (glyph) {
+		cairo_surface_t *mask = cairo_image_surface_create_for_data(
+		    (unsigned char *)glyph->data, CAIRO_FORMAT_A8, glyph->width,
+		    glyph->height, glyph->stride);
+		cairo_mask_surface(cr, mask, x + glyph->x_offset,
+				   y + glyph->y_offset);
+		cairo_surface_destroy(mask);
+		return;
+	}
+	cairo_move_to(cr, x, y);
+	cairo_show_text(cr, render_icon_text(icon));
+}
+
+void render_background(cairo_t *cr, const struct render_params *params,
+		       uint32_t width, uint32_t height) {
+	cairo_surface_t *image = params->wallpaper;
+	// the buffer still holds the previous frame, anything translucent
+	// needs an opaque base underneath
+	if (!image ||
+	    cairo_surface_get_content(image) != CAIRO_CONTENT_COLOR) {
+		cairo_set_source_rgb(cr, 0.2, 0.2, 0.2);
+		cairo_paint(cr);
+	}
+	if (!image) {
+		return;
+	}
+
+	double scale_x = (double)width / cairo_image_surface_get_width(image);
+	double scale_y =
+	    (double)height / cairo_image_surface_get_height(image);
+	cairo_save(cr);
+	cairo_scale(cr, scale_x, scale_y);
+	cairo_set_source_surface(cr, image, 0, 0);
+	cairo_pattern_set_filter(cairo_get_source(cr), params->filter);
+	cairo_paint(cr);
+	cairo_restore(cr);
+}
+
+void render_frame(const struct render_params *params, auth_state_t icon,
+		  uint32_t width, uint32_t height, uint32_t stride,
+		  uint32_t scale, void *pixels) {
+	cairo_surface_t *surface = cairo_image_surface_create_for_data(
+	    pixels, CAIRO_FORMAT_ARGB32, width, height, stride);
+	cairo_t *cr = cairo_create(surface);
+
+	render_background(cr, params, width, height);
+	draw_icon(cr, params, icon, width, height, scale);
+
+	cairo_destroy(cr);
+	cairo_surface_destroy(surface);
+}
+
+// Covers every icon so no state leaves pixels behind for the next.
+static struct render_rect icon_box(cairo_t *cr,
+				   const struct render_params *params,
+				   uint32_t width, uint32_t height,
+				   uint32_t scale) {
+	static const auth_state_t icons[] = {
+	    AUTH_STATE_LOCKED, AUTH_STATE_AUTHENTICATING, AUTH_STATE_SUCCESS,
+	    AUTH_STATE_TYPING};
+	struct render_rect box = {0};
+	for (size_t i = 0; i < sizeof(icons) / sizeof(icons[0]); i++) {
+		const struct theme_glyph *glyph;
+		double x, y;
+		box = rect_union(box, place_icon(cr, params, icons[i], width,
+						 height, scale, &glyph, &x,
+						 &y));
+	}
+	return rect_clamp(box, width, height);
+}
+
+struct render_backdrop *render_backdrop_create(
+    const struct render_params *params, uint32_t width, uint32_t height,
+    uint32_t scale) {
+	// the box depends on font metrics, measured on a scratch surface
+	cairo_surface_t *scratch =
+	    cairo_image_surface_create(CAIRO_FORMAT_A8, 1, 1);
+	cairo_t *cr = cairo_create(scratch);
+	struct render_rect box = icon_box(cr, params, width, height, scale);
+	cairo_destroy(cr);
+	cairo_surface_destroy(scratch);
+	struct render_backdrop *backdrop = calloc(1, sizeof(*backdrop));
+	if (!backdrop || box.width == 0) {
+		free(backdrop);
+		return NULL;
+	}
+	backdrop->box = box;
+	backdrop->pixels = malloc((size_t)box.width * box.height * 4);
+	if (!backdrop->pixels) {
+		free(backdrop);
+		return NULL;
+	}
+	cairo_surface_t *surface = cairo_image_surface_create_for_data(
+	    backdrop->pixels, CAIRO_FORMAT_ARGB32, box.width, box.height,
+	    box.width * 4);
+	cr = cairo_create(surface);
+	cairo_translate(cr, -box.x, -box.y);
+	render_background(cr, params, width, height);
+	cairo_destroy(cr);
+	cairo_surface_flush(surface);
+	cairo_surface_destroy(surface);
+	return backdrop;
+}
+
+void render_backdrop_destroy(struct render_backdrop *backdrop) {
+	if (backdrop) {
+		free(backdrop->pixels);
+		free(backdrop);
+	}
+}
+
+struct render_rect render_icon(const struct render_params *params,
+			       auth_state_t icon, uint32_t width,
+			       uint32_t height, uint32_t stride, uint32_t scale,
+			       void *pixels) {
+	cairo_surface_t *surface = cairo_image_surface_create_for_data(
+	    pixels, CAIRO_FORMAT_ARGB32, width, height, stride);
+	cairo_t *cr = cairo_create(surface);
+
+	struct render_rect box = icon_box(cr, params, width, height, scale);
+	cairo_rectangle(cr, box.x, box.y, box.width, box.height);
+	cairo_clip(cr);
+	const struct render_backdrop *backdrop = params->backdrop;
+	if (backdrop && memcmp(&backdrop->box, &box, sizeof(box)) == 0) {
+		cairo_surface_t *saved = cairo_image_surface_create_for_data(
+		    backdrop->pixels, CAIRO_FORMAT_ARGB32, box.width,
+		    box.height, box.width * 4);
+		cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+		cairo_set_source_surface(cr, saved, box.x, box.y);
+		cairo_paint(cr);
+		cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+		cairo_surface_destroy(saved);
+	} else {
+		render_background(cr, params, width, height);
+	}
+	draw_icon(cr, params, icon, width, height, scale);
+
+	cairo_destroy(cr);
+	cairo_surface_destroy(surface);
+	return box;
+}
+
+struct render_rect render_hud(const struct render_params *params,
+			      const struct render_hud *hud, uint32_t width,
+			      uint32_t height, uint32_t stride, uint32_t scale,
+			      void *pixels) {
+	struct render_rect box = rect_clamp(
+	    (struct render_rect){HUD_MARGIN * scale, HUD_MARGIN * scale,
+				 HUD_WIDTH * scale, HUD_HEIGHT * scale},
+	    width, height);
+	if (box.width == 0) {
+		return box;
+	}
+
+	cairo_surface_t *surface = cairo_image_surface_create_for_data(
+	    pixels, CAIRO_FORMAT_ARGB32, width, height, stride);
+	cairo_t *cr = cairo_create(surface);
+	cairo_rectangle(cr, box.x, box.y, box.width, box.height);
+	cairo_clip(cr);
+	// the previous HUD is blended into the frame, start from the wallpaper
+	render_background(cr, params, width, height);
+	cairo_set_source_rgba(cr, 0, 0, 0, 0.6);
+	cairo_paint(cr);
+
+	char lines[3][96];
+	snprintf(lines[0], sizeof(lines[0]),
+		 "render last %.2f avg %.2f max %.2f ms", hud->last_ns / 1e6,
+		 hud->avg_ns / 1e6, hud->max_ns / 1e6);
+	snprintf(lines[1], sizeof(lines[1]), "frames %llu damage %llu px",
+		 (unsigned long long)hud->frames,
+		 (unsigned long long)hud->damage_pixels);
+	snprintf(lines[2], sizeof(lines[2]), "buffers in flight %u/%u",
+		 hud->buffers_busy, hud->buffers);
+
+	cairo_select_font_face(cr, "monospace", CAIRO_FONT_SLANT_NORMAL,
+			       CAIRO_FONT_WEIGHT_NORMAL);
+	cairo_set_font_size(cr, HUD_FONT_SIZE * scale);
+	cairo_set_source_rgb(cr, 1, 1, 1);
+	for (size_t i = 0; i < 3; i++) {
+		cairo_move_to(cr, box.x + 6.0 * scale,
+			      box.y + (16.0 + 16.0 * i) * scale);
+		cairo_show_text(cr, lines[i]);
+	}
+
+	cairo_destroy(cr);
+	cairo_surface_destroy(surface);
+	return box;
+}
+
+// ring geometry scales with the icon, the shake needs room on both sides
+static double ring_radius(const struct render_params *params) {
+	return params->icon_size * 0.9;
+}
+
+static double ring_width(const struct render_params *params) {
+	return params->icon_size / 8.0 + 1.0;
+}
+
+static double shake_amplitude(const struct render_params *params) {
+	return params->icon_size / 4.0;
+}
+
+uint32_t render_anim_size(const struct render_params *params) {
+	return ceil(2.0 * (ring_radius(params) + ring_width(params) +
+			   shake_amplitude(params))) +
+	       2;
+}
+
+void render_anim_origin(const struct render_params *params, uint32_t width,
+			uint32_t height, int32_t *x, int32_t *y) {
+	int32_t half = render_anim_size(params) / 2;
+	*x = (int32_t)(width / 2) - half;
+	*y = (int32_t)(height / 2) + ICON_OFFSET - half;
+}
+
+static void stroke_ring(cairo_t *cr, double cx, double cy, double radius,
+			double from, double to) {
+	cairo_new_sub_path(cr);
+	cairo_arc(cr, cx, cy, radius, from, to);
+	cairo_stroke(cr);
+}
+
+bool render_anim(const struct render_params *params,
+		 const struct render_anim *anim, uint32_t stride,
+		 uint32_t scale, void *pixels) {
+	uint32_t size = render_anim_size(params);
+	cairo_surface_t *surface = cairo_image_surface_create_for_data(
+	    pixels, CAIRO_FORMAT_ARGB32, size * scale, size * scale, stride);
+	cairo_t *cr = cairo_create(surface);
+	cairo_set_operator(cr, CAIRO_OPERATOR_CLEAR);
+	cairo_paint(cr);
+	cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+	cairo_scale(cr, scale, scale);
+	cairo_set_line_width(cr, ring_width(params));
+
+	double centre = size / 2.0;
+	double radius = ring_radius(params);
+	bool moving = true;
+	switch (anim->kind) {
+	case ANIM_NONE:
+		moving = false;
+		break;
+	case ANIM_TYPING:
+	case ANIM_ERASE: {
+		double left = 1.0 - anim->t / ANIM_TYPING_DURATION;
+		if (left <= 0.0) {
+			moving = false;
+			break;
+		}
+		cairo_set_source_rgba(cr, 0, 0, 0, 0.25 * left);
+		stroke_ring(cr, centre, centre, radius, 0, TURN);
+		if (anim->kind == ANIM_ERASE) {
+			cairo_set_source_rgba(cr, 0.8, 0.2, 0.2, left);
+		} else {
+			cairo_set_source_rgba(cr, 0.3, 0.6, 1.0, left);
+		}
+		double from = anim->angle * TURN;
+		stroke_ring(cr, centre, centre, radius, from, from + TURN / 6);
+		break;
+	}
+	case ANIM_SPINNER: {
+		double start = fmod(anim->t * ANIM_SPINNER_TURNS, 1.0) * TURN;
+		cairo_set_source_rgba(cr, 0, 0, 0, 0.25);
+		stroke_ring(cr, centre, centre, radius, 0, TURN);
+		cairo_set_source_rgba(cr, 1, 1, 1, 0.9);
+		stroke_ring(cr, centre, centre, radius, start, start + TURN / 4);
+		break;
+	}
+	case ANIM_SHAKE: {
+		double left = 1.0 - anim->t / ANIM_SHAKE_DURATION;
+		if (left <= 0.0) {
+			moving = false;
+			break;
+		}
+		// a damped sine, the ring settles back in the middle
+		double dx = shake_amplitude(params) * left *
+			    sin(anim->t * ANIM_SHAKE_FREQUENCY * TURN);
+		cairo_set_source_rgba(cr, 0.8, 0.2, 0.2, left);
+		stroke_ring(cr, centre + dx, centre, radius, 0, TURN);
+		break;
+	}
+	}
+
+	cairo_destroy(cr);
+	cairo_surface_flush(surface);
+	cairo_surface_destroy(surface);
+	return moving;
+}
+
+static void clock_reset(struct render_clock *clock) {
+	for (size_t i = 0; i < RENDER_CLOCK_LINES; i++) {
+		cairo_scaled_font_destroy(clock->fonts[i]);
+		cairo_glyph_free(clock->lines[i].glyphs);
+	}
+	*clock = (struct render_clock){0};
+}
+
+// Fonts are resolved once per scale, the time and date differ only in size.
+static void clock_fonts(struct render_clock *clock,
+			const struct render_params *params, uint32_t scale) {
+	if (clock->scale == scale && clock->fonts[0]) {
+		return;
+	}
+	clock_reset(clock);
+	clock->scale = scale;
+
+	cairo_font_face_t *face =
+	    params->text_font ? params->text_font : params->icon_font;
+	if (!face) {
+		face = cairo_toy_font_face_create(params->icon_font_family,
+						  CAIRO_FONT_SLANT_NORMAL,
+						  CAIRO_FONT_WEIGHT_BOLD);
+	} else {
+		cairo_font_face_reference(face);
+	}
+	static const double sizes[RENDER_CLOCK_LINES] = {
+	    [RENDER_CLOCK_TIME] = CLOCK_TIME_SIZE,
+	    [RENDER_CLOCK_DATE] = CLOCK_DATE_SIZE,
+	};
+	cairo_matrix_t identity;
+	cairo_matrix_init_identity(&identity);
+	cairo_font_options_t *options = cairo_font_options_create();
+	for (size_t i = 0; i < RENDER_CLOCK_LINES; i++) {
+		cairo_matrix_t matrix;
+		cairo_matrix_init_scale(&matrix,
+					params->icon_size * sizes[i] * scale,
+					params->icon_size * sizes[i] * scale);
+		clock->fonts[i] =
+		    cairo_scaled_font_create(face, &matrix, &identity, options);
+	}
+	cairo_font_options_destroy(options);
+	cairo_font_face_destroy(face);
+}
+
+static void clock_shape(struct render_clock *clock,
+			enum render_clock_line line, const char *text) {
+	struct render_text *shaped = &clock->lines[line];
+	if (shaped->glyphs && strcmp(shaped->text, text) == 0) {
+		return;
+	}
+	cairo_glyph_free(shaped->glyphs);
+	shaped->glyphs = NULL;
+	shaped->glyph_count = 0;
+	shaped->width = 0;
+	snprintf(shaped->text, sizeof(shaped->text), "%s", text);
+	if (cairo_scaled_font_text_to_glyphs(
+		clock->fonts[line], 0, 0, shaped->text, -1, &shaped->glyphs,
+		&shaped->glyph_count, NULL, NULL, NULL) != CAIRO_STATUS_SUCCESS) {
+		shaped->glyphs = NULL;
+		shaped->glyph_count = 0;
+		return;
+	}
+	cairo_text_extents_t extents;
+	cairo_scaled_font_glyph_extents(clock->fonts[line], shaped->glyphs,
+					shaped->glyph_count, &extents);
+	shaped->width = extents.x_advance;
+}
+
+double render_clock_text_width(struct render_clock *clock,
+			       const struct render_params *params,
+			       enum render_clock_line line, const char *text) {
+	clock_fonts(clock, params, clock->scale ? clock->scale : 1);
+	cairo_text_extents_t extents;
+	cairo_scaled_font_text_extents(clock->fonts[line], text, &extents);
+	return extents.x_advance / clock->scale;
+}
+
+static double line_height(struct render_clock *clock,
+			  enum render_clock_line line) {
+	cairo_font_extents_t extents;
+	cairo_scaled_font_extents(clock->fonts[line], &extents);
+	return extents.ascent + extents.descent;
+}
+
+uint32_t render_clock_height(struct render_clock *clock,
+			     const struct render_params *params,
+			     bool with_date) {
+	clock_fonts(clock, params, clock->scale ? clock->scale : 1);
+	double height = line_height(clock, RENDER_CLOCK_TIME);
+	if (with_date) {
+		height += line_height(clock, RENDER_CLOCK_DATE);
+	}
+	return ceil(height / clock->scale) + CLOCK_SHADOW;
+}
+
+static void draw_line(cairo_t *cr, struct render_clock *clock,
+		      enum render_clock_line line, double box_width,
+		      double baseline, uint32_t scale) {
+	const struct render_text *shaped = &clock->lines[line];
+	double x = floor((box_width - shaped->width) / 2);
+	cairo_set_scaled_font(cr, clock->fonts[line]);
+	// a shadow keeps the text readable on light wallpapers
+	cairo_save(cr);
+	cairo_translate(cr, x + CLOCK_SHADOW * scale,
+			baseline + CLOCK_SHADOW * scale);
+	cairo_set_source_rgba(cr, 0, 0, 0, 0.6);
+	cairo_show_glyphs(cr, shaped->glyphs, shaped->glyph_count);
+	cairo_restore(cr);
+	cairo_save(cr);
+	cairo_translate(cr, x, baseline);
+	cairo_set_source_rgb(cr, 1, 1, 1);
+	cairo_show_glyphs(cr, shaped->glyphs, shaped->glyph_count);
+	cairo_restore(cr);
+}
+
+void render_clock(struct render_clock *clock,
+		  const struct render_params *params, const char *time,
+		  const char *date, uint32_t width, uint32_t height,
+		  uint32_t stride, uint32_t scale, void *pixels) {
+	clock_fonts(clock, params, scale);
+	clock_shape(clock, RENDER_CLOCK_TIME, time);
+	clock_shape(clock, RENDER_CLOCK_DATE, date);
+
+	cairo_surface_t *surface = cairo_image_surface_create_for_data(
+	    pixels, CAIRO_FORMAT_ARGB32, width * scale, height * scale, stride);
+	cairo_t *cr = cairo_create(surface);
+	cairo_set_operator(cr, CAIRO_OPERATOR_CLEAR);
+	cairo_paint(cr);
+	cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+
+	cairo_font_extents_t extents;
+	cairo_scaled_font_extents(clock->fonts[RENDER_CLOCK_TIME], &extents);
+	draw_line(cr, clock, RENDER_CLOCK_TIME, width * scale, extents.ascent,
+		  scale);
+	if (date[0] != '\0') {
+		double top = extents.ascent + extents.descent;
+		cairo_scaled_font_extents(clock->fonts[RENDER_CLOCK_DATE],
+					  &extents);
+		draw_line(cr, clock, RENDER_CLOCK_DATE, width * scale,
+			  top + extents.ascent, scale);
+	}
+
+	cairo_destroy(cr);
+	cairo_surface_flush(surface);
+	cairo_surface_destroy(surface);
+}
+
+void render_clock_finish(struct render_clock *clock) { clock_reset(clock); }
+
+uint32_t render_notice_width(const struct render_params *params) {
+	return params->icon_size * NOTICE_WIDTH;
+}
+
+uint32_t render_notice_height(const struct render_params *params) {
+	return ceil(params->icon_size * NOTICE_FONT_SIZE * 2);
+}
+
+void render_notice_origin(const struct render_params *params, uint32_t width,
+			  uint32_t height, uint32_t box_width, int32_t *x,
+			  int32_t *y) {
+	int32_t anim_x, anim_y;
+	render_anim_origin(params, width, height, &anim_x, &anim_y);
+	*x = ((int32_t)width - (int32_t)box_width) / 2;
+	*y = anim_y + render_anim_size(params);
+}
+
+void render_notice(const struct render_params *params, const char *text,
+		   bool error, uint32_t width, uint32_t height, uint32_t stride,
+		   uint32_t scale, void *pixels) {
+	cairo_surface_t *surface = cairo_image_surface_create_for_data(
+	    pixels, CAIRO_FORMAT_ARGB32, width * scale, height * scale, stride);
+	cairo_t *cr = cairo_create(surface);
+	cairo_set_operator(cr, CAIRO_OPERATOR_CLEAR);
+	cairo_paint(cr);
+	cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+
+	if (text[0] != '\0') {
+		if (params->text_font) {
+			cairo_set_font_face(cr, params->text_font);
+		} else if (params->icon_font) {
+			cairo_set_font_face(cr, params->icon_font);
+		} else {
+			cairo_select_font_face(cr, params->icon_font_family,
+					       CAIRO_FONT_SLANT_NORMAL,
+					       CAIRO_FONT_WEIGHT_BOLD);
+		}
+		cairo_set_font_size(cr,
+				    params->icon_size * NOTICE_FONT_SIZE * scale);
+		cairo_text_extents_t extents;
+		cairo_text_extents(cr, text, &extents);
+		double x = (width * scale - extents.x_advance) / 2;
+		double y = (height * scale - extents.height) / 2 -
+			   extents.y_bearing;
+		cairo_move_to(cr, x + CLOCK_SHADOW * scale,
+			      y + CLOCK_SHADOW * scale);
+		cairo_set_source_rgba(cr, 0, 0, 0, 0.6);
+		cairo_show_text(cr, text);
+		cairo_move_to(cr, x, y);
+		if (error) {
+			cairo_set_source_rgb(cr, 1, 0.4, 0.4);
+		} else {
+			cairo_set_source_rgb(cr, 1, 1, 1);
+		}
+		cairo_show_text(cr, text);
+	}
+
+	cairo_destroy(cr);
+	cairo_surface_flush(surface);
+	cairo_surface_destroy(surface);
+}
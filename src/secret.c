@@ -0,0 +1,65 @@
+// madvise and explicit_bzero are not POSIX
+#define _DEFAULT_SOURCE
+#include "secret.h"
+#include "log.h"
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+int secret_arena_init(struct secret_arena *arena, size_t size) {
+	long page = sysconf(_SC_PAGESIZE);
+	if (page <= 0) {
+		page = 4096;
+	}
+	size = (size + page - 1) / page * page;
+	void *base = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED) {
+		return -1;
+	}
+	*arena = (struct secret_arena){.base = base, .size = size};
+	arena->locked = mlock(base, size) == 0;
+	if (!arena->locked) {
+		log_warn(LOG_CAT_AUTH,
+			 "could not lock the password in memory (%s), it may "
+			 "be swapped out",
+			 strerror(errno));
+	}
+	if (madvise(base, size, MADV_DONTDUMP) != 0) {
+		log_warn(LOG_CAT_AUTH, "the password may end up in core dumps");
+	}
+#ifdef MADV_WIPEONFORK
+	// the concurrent PAM child has no use for it, before Linux 4.14 it
+	// gets a copy like everything else
+	madvise(base, size, MADV_WIPEONFORK);
+#endif
+	return 0;
+}
+
+void *secret_alloc(struct secret_arena *arena, size_t size) {
+	// keep everything handed out aligned for any type
+	size_t aligned = (size + 15) & ~(size_t)15;
+	if (!arena->base || aligned > arena->size - arena->used) {
+		return NULL;
+	}
+	void *data = arena->base + arena->used;
+	arena->used += aligned;
+	return data;
+}
+
+void secret_wipe(void *data, size_t size) {
+	explicit_bzero(data, size);
+}
+
+void secret_arena_finish(struct secret_arena *arena) {
+	if (!arena->base) {
+		return;
+	}
+	secret_wipe(arena->base, arena->size);
+	if (arena->locked) {
+		munlock(arena->base, arena->size);
+	}
+	munmap(arena->base, arena->size);
+	*arena = (struct secret_arena){0};
+}
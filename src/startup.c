@@ -0,0 +1,275 @@
+#include "startup.h"
+#include "state.h"
+#include "trace.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char *mark_names[STARTUP_MARK_COUNT] = {
+    [STARTUP_MARK_PAM] = "pam",
+    [STARTUP_MARK_XKB] = "xkb",
+    [STARTUP_MARK_REGISTRY] = "registry",
+    [STARTUP_MARK_LOCK_REQUEST] = "lock request",
+    [STARTUP_MARK_CONFIGURE] = "configure",
+    [STARTUP_MARK_BUFFER] = "buffer",
+    [STARTUP_MARK_DECODE] = "decode",
+    [STARTUP_MARK_COMMIT] = "commit",
+    [STARTUP_MARK_LOCKED] = "locked",
+};
+
+uint64_t startup_now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void startup_begin(struct startup *startup) {
+	startup->begin_ns = startup_now_ns();
+	startup->phase_count = 0;
+	memset(startup->marks, 0, sizeof(startup->marks));
+}
+
+void startup_mark(struct startup *startup, enum startup_mark mark) {
+	if (!startup->marks[mark]) {
+		startup->marks[mark] = startup_now_ns();
+	}
+}
+
+void startup_phase(struct startup *startup, const char *name) {
+	if (startup->phase_count == STARTUP_MAX_PHASES) {
+		return;
+	}
+	struct startup_phase *phase = &startup->phases[startup->phase_count++];
+	phase->name = name;
+	phase->end_ns = startup_now_ns();
+}
+
+static void *startup_task_run(void *data) {
+	struct startup_task *task = data;
+	trace_thread_name(task->name);
+	task->start_ns = startup_now_ns();
+	TRACE_BEGIN("startup task");
+	task->result = task->run(task->state);
+	TRACE_END("startup task");
+	task->end_ns = startup_now_ns();
+	return NULL;
+}
+
+void startup_task_start(struct startup_task *task, const char *name,
+			int (*run)(struct prog_state *state),
+			struct prog_state *state) {
+	task->name = name;
+	task->run = run;
+	task->state = state;
+	task->wait_ns = 0;
+	if (pthread_create(&task->thread, NULL, startup_task_run, task) != 0) {
+		// no worker available, run it inline
+		startup_task_run(task);
+		return;
+	}
+	task->running = true;
+}
+
+int startup_task_join(struct startup_task *task) {
+	if (task->running) {
+		uint64_t start = startup_now_ns();
+		pthread_join(task->thread, NULL);
+		task->wait_ns = startup_now_ns() - start;
+		task->running = false;
+	}
+	return task->result;
+}
+
+// negative for work done before begin_ns, e.g. ahead of an idle lock
+static double ms_since(const struct startup *startup, uint64_t ns) {
+	return ns ? (int64_t)(ns - startup->begin_ns) / 1e6 : 0.0;
+}
+
+static void report_task(const struct startup *startup,
+			const struct startup_task *task) {
+	if (!task->name) {
+		return;
+	}
+	fprintf(stderr,
+		"startup: %-12s %8.2f -> %8.2f ms  (worker, main waited %.2f "
+		"ms)\n",
+		task->name, ms_since(startup, task->start_ns),
+		ms_since(startup, task->end_ns), task->wait_ns / 1e6);
+}
+
+void startup_report(struct prog_state *state) {
+	const struct startup *startup = &state->startup;
+	uint64_t previous = startup->begin_ns;
+	for (size_t i = 0; i < startup->phase_count; i++) {
+		const struct startup_phase *phase = &startup->phases[i];
+		fprintf(stderr, "startup: %-12s %8.2f -> %8.2f ms  (main)\n",
+			phase->name, ms_since(startup, previous),
+			ms_since(startup, phase->end_ns));
+		previous = phase->end_ns;
+	}
+
+	// a worker's timestamps are only safe to read once it is joined. By the
+	// first frame these are done, or about to be needed by the first key.
+	startup_task_join(&state->startup.pam);
+	startup_task_join(&state->startup.xkb);
+	startup_task_join(&state->startup.fonts);
+	report_task(startup, &startup->pam);
+	report_task(startup, &startup->xkb);
+	report_task(startup, &startup->fonts);
+
+	// not joined here, an idle lock may still be decoding it
+	const struct image_loader *wallpaper = &state->wallpaper;
+	if (wallpaper->running) {
+		fprintf(stderr, "startup: %-12s still decoding\n", "wallpaper");
+	} else if (wallpaper->start_ns) {
+		fprintf(stderr,
+			"startup: %-12s %8.2f -> %8.2f ms  (worker, main "
+			"waited %.2f ms)\n",
+			"wallpaper", ms_since(startup, wallpaper->start_ns),
+			ms_since(startup, wallpaper->end_ns),
+			wallpaper->wait_ns / 1e6);
+	}
+}
+
+bool startup_profile_done(const struct startup *startup) {
+	return startup->marks[STARTUP_MARK_COMMIT] &&
+	       startup->marks[STARTUP_MARK_LOCKED];
+}
+
+void startup_profile_submit(struct prog_state *state) {
+	struct startup *startup = &state->startup;
+	// worker milestones are only final once the workers are joined
+	startup_task_join(&startup->pam);
+	startup_task_join(&startup->xkb);
+	startup->marks[STARTUP_MARK_PAM] = startup->pam.end_ns;
+	startup->marks[STARTUP_MARK_XKB] = startup->xkb.end_ns;
+	startup->marks[STARTUP_MARK_DECODE] = state->wallpaper.end_ns;
+
+	char line[STARTUP_MARK_COUNT * 24];
+	size_t len = 0;
+	for (size_t i = 0; i < STARTUP_MARK_COUNT; i++) {
+		uint64_t ns = startup->marks[i] ? startup->marks[i] -
+						      startup->begin_ns
+						: 0;
+		len += snprintf(line + len, sizeof(line) - len, "%llu%c",
+				(unsigned long long)ns,
+				i + 1 < STARTUP_MARK_COUNT ? ' ' : '\n');
+	}
+	if (write(startup->profile_fd, line, len) != (ssize_t)len) {
+		perror("failed to report the profiled run");
+	}
+	close(startup->profile_fd);
+	startup->profile_fd = -1;
+}
+
+// Waits for one forked run, returns 0 with its milestones.
+static int collect_run(int fd, pid_t pid, uint64_t *marks) {
+	char line[STARTUP_MARK_COUNT * 24];
+	size_t len = 0;
+	ssize_t n;
+	while (len < sizeof(line) - 1 &&
+	       (n = read(fd, line + len, sizeof(line) - 1 - len)) != 0) {
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+		len += n;
+	}
+	line[len] = '\0';
+	close(fd);
+
+	int status;
+	while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+		;
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		return -1;
+	}
+
+	char *cursor = line;
+	for (size_t i = 0; i < STARTUP_MARK_COUNT; i++) {
+		char *end;
+		marks[i] = strtoull(cursor, &end, 10);
+		if (end == cursor) {
+			return -1;
+		}
+		cursor = end;
+	}
+	return 0;
+}
+
+static int compare_u64(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return x < y ? -1 : x > y;
+}
+
+int startup_profile(struct startup *startup, uint32_t runs) {
+	uint64_t(*results)[STARTUP_MARK_COUNT] =
+	    calloc(runs, sizeof(*results));
+	if (!results) {
+		return -1;
+	}
+
+	uint32_t completed = 0;
+	for (uint32_t run = 0; run < runs; run++) {
+		int fds[2];
+		if (pipe(fds) != 0) {
+			perror("pipe");
+			break;
+		}
+		fflush(NULL);
+		pid_t pid = fork();
+		if (pid < 0) {
+			perror("fork");
+			close(fds[0]);
+			close(fds[1]);
+			break;
+		}
+		if (pid == 0) {
+			free(results);
+			close(fds[0]);
+			startup->profiling = true;
+			startup->profile_fd = fds[1];
+			return 1;
+		}
+		close(fds[1]);
+		if (collect_run(fds[0], pid, results[completed]) == 0) {
+			completed++;
+		} else {
+			fprintf(stderr, "startup profile: run %u failed\n",
+				run + 1);
+		}
+	}
+
+	fprintf(stderr, "startup profile: %u of %u runs locked\n", completed,
+		runs);
+	fprintf(stderr, "startup profile: %-12s %8s %8s %8s  (ms since start)\n",
+		"milestone", "min", "median", "max");
+	uint64_t *column = malloc(runs * sizeof(*column));
+	for (size_t i = 0; column && i < STARTUP_MARK_COUNT; i++) {
+		uint32_t count = 0;
+		for (uint32_t run = 0; run < completed; run++) {
+			// a run without a wallpaper never decodes
+			if (results[run][i]) {
+				column[count++] = results[run][i];
+			}
+		}
+		if (count == 0) {
+			continue;
+		}
+		qsort(column, count, sizeof(*column), compare_u64);
+		fprintf(stderr, "startup profile: %-12s %8.2f %8.2f %8.2f\n",
+			mark_names[i], column[0] / 1e6,
+			column[count / 2] / 1e6, column[count - 1] / 1e6);
+	}
+	free(column);
+	free(results);
+	return completed == runs ? 0 : -1;
+}
@@ -0,0 +1,29 @@
+#include "theme.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef HAVE_EMBEDDED_THEME
+// built without -Dtheme, everything resolves at runtime
+const struct theme_glyph theme_glyphs[] = {{0}};
+const size_t theme_glyph_count = 0;
+const uint8_t theme_background[] = {0};
+const size_t theme_background_size = 0;
+#endif
+
+const struct theme_glyph *theme_find_glyph(auth_state_t state, uint32_t size) {
+	for (size_t i = 0; i < theme_glyph_count; i++) {
+		if (theme_glyphs[i].state == state &&
+		    theme_glyphs[i].size == size) {
+			return &theme_glyphs[i];
+		}
+	}
+	return NULL;
+}
+
+bool theme_has_size(uint32_t size) {
+	return theme_find_glyph(AUTH_STATE_LOCKED, size) &&
+	       theme_find_glyph(AUTH_STATE_AUTHENTICATING, size) &&
+	       theme_find_glyph(AUTH_STATE_SUCCESS, size) &&
+	       theme_find_glyph(AUTH_STATE_TYPING, size);
+}
@@ -0,0 +1,163 @@
+#include "trace.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TRACE_RING_SIZE 16384 // events per thread, oldest are overwritten
+
+struct trace_event {
+	uint64_t ts_ns;
+	const char *name;
+	char phase;
+};
+
+// Written only by its own thread; the dumping thread reads up to head.
+struct trace_ring {
+	struct trace_ring *next;
+	uint32_t tid;
+	const char *thread_name;
+	_Atomic uint64_t head;
+	struct trace_event events[TRACE_RING_SIZE];
+};
+
+bool trace_enabled = false;
+
+static char *trace_path;
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct trace_ring *rings;
+static uint32_t next_tid = 1;
+static _Thread_local struct trace_ring *thread_ring;
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// first event of a thread allocates its ring, every later one is lock free
+static struct trace_ring *get_ring(void) {
+	if (thread_ring) {
+		return thread_ring;
+	}
+	struct trace_ring *ring = calloc(1, sizeof(*ring));
+	if (!ring) {
+		return NULL;
+	}
+	pthread_mutex_lock(&rings_lock);
+	ring->tid = next_tid++;
+	ring->next = rings;
+	rings = ring;
+	pthread_mutex_unlock(&rings_lock);
+	thread_ring = ring;
+	return ring;
+}
+
+void trace_record(const char *name, char phase) {
+	struct trace_ring *ring = get_ring();
+	if (!ring) {
+		return;
+	}
+	uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	struct trace_event *event = &ring->events[head % TRACE_RING_SIZE];
+	event->ts_ns = now_ns();
+	event->name = name;
+	event->phase = phase;
+	atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+void trace_init(const char *path) {
+	free(trace_path);
+	trace_path = strdup(path);
+	trace_enabled = trace_path != NULL;
+}
+
+void trace_thread_name(const char *name) {
+	if (!trace_enabled) {
+		return;
+	}
+	struct trace_ring *ring = get_ring();
+	if (ring) {
+		ring->thread_name = name;
+	}
+}
+
+static void write_string(FILE *file, const char *s) {
+	fputc('"', file);
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\') {
+			fputc('\\', file);
+		}
+		fputc(*s, file);
+	}
+	fputc('"', file);
+}
+
+int trace_dump(void) {
+	if (!trace_enabled) {
+		return -1;
+	}
+	FILE *file = fopen(trace_path, "w");
+	if (!file) {
+		fprintf(stderr, "trace: cannot write %s\n", trace_path);
+		return -1;
+	}
+
+	int pid = getpid();
+	bool first = true;
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+	pthread_mutex_lock(&rings_lock);
+	for (struct trace_ring *ring = rings; ring; ring = ring->next) {
+		if (ring->thread_name) {
+			fprintf(file,
+				"%s\n{\"name\":\"thread_name\",\"ph\":\"M\","
+				"\"pid\":%d,\"tid\":%u,\"args\":{\"name\":",
+				first ? "" : ",", pid, ring->tid);
+			write_string(file, ring->thread_name);
+			fprintf(file, "}}");
+			first = false;
+		}
+
+		// events still being written by other threads may be torn,
+		// which is acceptable for a debugging aid
+		uint64_t head =
+		    atomic_load_explicit(&ring->head, memory_order_acquire);
+		uint64_t start =
+		    head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+		for (uint64_t i = start; i < head; i++) {
+			const struct trace_event *event =
+			    &ring->events[i % TRACE_RING_SIZE];
+			fprintf(file, "%s\n{\"name\":", first ? "" : ",");
+			write_string(file, event->name);
+			fprintf(file,
+				",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,"
+				"\"tid\":%u%s}",
+				event->phase, event->ts_ns / 1000.0, pid,
+				ring->tid,
+				event->phase == 'i' ? ",\"s\":\"t\"" : "");
+			first = false;
+		}
+	}
+	pthread_mutex_unlock(&rings_lock);
+
+	fprintf(file, "\n]}\n");
+	int ret = fclose(file) == 0 ? 0 : -1;
+	fprintf(stderr, "trace: written to %s\n", trace_path);
+	return ret;
+}
+
+void trace_finish(void) {
+	if (trace_enabled) {
+		trace_dump();
+	}
+	trace_enabled = false;
+	// rings of threads that may still run are intentionally leaked
+	free(trace_path);
+	trace_path = NULL;
+}
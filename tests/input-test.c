@@ -0,0 +1,99 @@
+// Drives input_handle_key the way the locker does and checks the password
+// buffer and the effect of every key.
+#include "input.h"
+#include <stdio.h>
+#include <string.h>
+#include <xkbcommon/xkbcommon-keysyms.h>
+
+static int failures;
+
+#define CHECK(cond)                                                            \
+	do {                                                                   \
+		if (!(cond)) {                                                 \
+			fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__,     \
+				#cond);                                        \
+			failures++;                                            \
+		}                                                              \
+	} while (0)
+
+static char buffer[16];
+static struct auth_state auth;
+
+static struct input_effect press(xkb_keysym_t sym, const char *text) {
+	int len = text ? (int)strlen(text) : 0;
+	struct input_effect effect = input_handle_key(&auth, sym, text, len);
+	auth.current_state = effect.icon;
+	return effect;
+}
+
+static struct input_effect type(const char *text) {
+	return press(XKB_KEY_a, text);
+}
+
+int main(void) {
+	auth.password_buffer = buffer;
+	auth.password_len = sizeof(buffer);
+	auth.current_state = AUTH_STATE_LOCKED;
+
+	CHECK(input_key_types_text(XKB_KEY_a, 1));
+	CHECK(!input_key_types_text(XKB_KEY_Shift_L, 0));
+	CHECK(!input_key_types_text(XKB_KEY_Return, 1));
+	CHECK(!input_key_types_text(XKB_KEY_Escape, 1));
+	CHECK(!input_key_types_text(XKB_KEY_BackSpace, 1));
+
+	struct input_effect effect = type("a");
+	CHECK(effect.icon == AUTH_STATE_TYPING);
+	CHECK(!effect.submit);
+	CHECK(auth.password_pos == 1);
+
+	// BackSpace takes a whole character, not one byte of it
+	type("\xc3\xa9"); // é
+	type("\xe2\x82\xac"); // €
+	CHECK(auth.password_pos == 6);
+	effect = press(XKB_KEY_BackSpace, "\b");
+	CHECK(effect.icon == AUTH_STATE_TYPING);
+	CHECK(auth.password_pos == 3);
+	CHECK(memcmp(buffer, "a\xc3\xa9", 4) == 0);
+	press(XKB_KEY_BackSpace, "\b");
+	CHECK(auth.password_pos == 1);
+	effect = press(XKB_KEY_BackSpace, "\b");
+	CHECK(effect.icon == AUTH_STATE_LOCKED);
+	CHECK(auth.password_pos == 0);
+	effect = press(XKB_KEY_BackSpace, "\b");
+	CHECK(effect.icon == AUTH_STATE_LOCKED);
+	CHECK(auth.password_pos == 0);
+
+	// Return submits what was typed, terminated
+	type("p");
+	type("w");
+	effect = press(XKB_KEY_Return, "\r");
+	CHECK(effect.submit);
+	CHECK(effect.icon == AUTH_STATE_AUTHENTICATING);
+	CHECK(strcmp(buffer, "pw") == 0);
+
+	// Escape wipes the whole buffer
+	auth.current_state = AUTH_STATE_LOCKED;
+	type("x");
+	effect = press(XKB_KEY_Escape, "\x1b");
+	CHECK(!effect.submit);
+	CHECK(effect.icon == AUTH_STATE_LOCKED);
+	CHECK(auth.password_pos == 0);
+	for (size_t i = 0; i < sizeof(buffer); i++) {
+		CHECK(buffer[i] == '\0');
+	}
+
+	// a full buffer drops further text and keeps room for the terminator
+	for (int i = 0; i < 32; i++) {
+		type("z");
+	}
+	CHECK(auth.password_pos < auth.password_len - 1);
+	effect = press(XKB_KEY_Return, "\r");
+	CHECK(effect.submit);
+	CHECK(strlen(buffer) == auth.password_pos);
+
+	if (failures) {
+		fprintf(stderr, "%d checks failed\n", failures);
+		return 1;
+	}
+	return 0;
+}
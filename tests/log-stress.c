@@ -0,0 +1,94 @@
+// One producer against the log writer. Every message waits until the writer
+// has printed it, so the writer goes to sleep between messages and a lost
+// wakeup shows up as a message that never arrives. A final burst overflows
+// the ring and checks that printed plus dropped adds up.
+#include "log.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define HANDSHAKES 20000
+#define BURST 100000
+#define DEADLINE_NS 2000000000ull
+
+static atomic_ulong printed;
+static atomic_ulong dropped;
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// counts the lines the writer puts on stderr
+static void *reader_run(void *data) {
+	FILE *in = data;
+	char line[512];
+	while (fgets(line, sizeof(line), in)) {
+		unsigned long long lost;
+		if (sscanf(line, "log: %llu messages dropped", &lost) == 1) {
+			atomic_fetch_add(&dropped, lost);
+		} else {
+			atomic_fetch_add(&printed, 1);
+		}
+	}
+	return NULL;
+}
+
+static bool wait_printed(unsigned long count) {
+	uint64_t deadline = now_ns() + DEADLINE_NS;
+	while (atomic_load(&printed) < count) {
+		if (now_ns() > deadline) {
+			return false;
+		}
+		sched_yield();
+	}
+	return true;
+}
+
+int main(void) {
+	int fds[2];
+	if (pipe(fds) < 0) {
+		perror("pipe");
+		return 1;
+	}
+	int report = dup(STDERR_FILENO);
+	FILE *out = fdopen(report, "w");
+	dup2(fds[1], STDERR_FILENO);
+	close(fds[1]);
+	pthread_t reader;
+	pthread_create(&reader, NULL, reader_run, fdopen(fds[0], "r"));
+
+	log_init(LOG_LEVEL_INFO);
+	for (unsigned long i = 0; i < HANDSHAKES; i++) {
+		log_info(LOG_CAT_CORE, "handshake %lu", i);
+		if (!wait_printed(i + 1)) {
+			fprintf(out, "message %lu was never written, %lu were\n",
+				i, atomic_load(&printed));
+			return 1;
+		}
+	}
+	for (unsigned long i = 0; i < BURST; i++) {
+		log_info(LOG_CAT_CORE, "burst %lu", i);
+	}
+	log_finish();
+	// the reader sees the end of the pipe once stderr is closed
+	fclose(stderr);
+	pthread_join(reader, NULL);
+
+	unsigned long total = atomic_load(&printed) + atomic_load(&dropped);
+	fprintf(out, "%lu printed, %lu dropped\n", atomic_load(&printed),
+		atomic_load(&dropped));
+	if (total != HANDSHAKES + BURST) {
+		fprintf(out, "expected %d messages\n", HANDSHAKES + BURST);
+		return 1;
+	}
+	return 0;
+}
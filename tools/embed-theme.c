@@ -0,0 +1,394 @@
+/*
+ * Build time theme compiler.
+ *
+ * Reads a theme.ini, rasterises the icon of every auth_state_t at each
+ * configured size into an A8 mask and writes them, together with the optional
+ * fallback background, as C arrays the locker links against.
+ *
+ * The font is resolved through fontconfig up front. A missing family or a
+ * font lacking one of the icons fails the build rather than embedding
+ * whatever fontconfig falls back to. meson.build checks the family first and,
+ * unless embed_theme is enabled, skips embedding when it is not installed.
+ *
+ * usage: embed-theme theme.ini theme-data.c theme-data.c.d
+ */
+#include <cairo-ft.h>
+#include <cairo.h>
+#include <ctype.h>
+#include <fontconfig/fontconfig.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_SIZES 16
+
+struct theme {
+	char font[256];
+	bool bold;
+	int sizes[MAX_SIZES];
+	int size_count;
+	uint32_t icons[4]; // indexed like the icon_names below
+	char background[4096];
+};
+
+// order matches the auth_state_t names emitted into the generated source
+static const char *icon_names[] = {"locked", "authenticating", "success",
+				   "typing"};
+static const char *icon_states[] = {"AUTH_STATE_LOCKED",
+				    "AUTH_STATE_AUTHENTICATING",
+				    "AUTH_STATE_SUCCESS", "AUTH_STATE_TYPING"};
+
+static char *trim(char *s) {
+	while (isspace((unsigned char)*s)) {
+		s++;
+	}
+	char *end = s + strlen(s);
+	while (end > s && isspace((unsigned char)end[-1])) {
+		*--end = '\0';
+	}
+	return s;
+}
+
+static uint32_t parse_codepoint(const char *value) {
+	if (strncmp(value, "U+", 2) == 0 || strncmp(value, "u+", 2) == 0) {
+		return strtoul(value + 2, NULL, 16);
+	}
+	return strtoul(value, NULL, 0);
+}
+
+static int parse_theme(const char *path, struct theme *theme) {
+	FILE *file = fopen(path, "r");
+	if (!file) {
+		perror(path);
+		return -1;
+	}
+
+	char line[4096], section[64] = "";
+	int lineno = 0;
+	while (fgets(line, sizeof(line), file)) {
+		lineno++;
+		char *s = trim(line);
+		if (*s == '\0' || *s == '#' || *s == ';') {
+			continue;
+		}
+		if (*s == '[') {
+			char *end = strchr(s, ']');
+			if (!end) {
+				fprintf(stderr, "%s:%d: bad section\n", path,
+					lineno);
+				fclose(file);
+				return -1;
+			}
+			*end = '\0';
+			snprintf(section, sizeof(section), "%s", s + 1);
+			continue;
+		}
+		char *eq = strchr(s, '=');
+		if (!eq) {
+			fprintf(stderr, "%s:%d: expected key = value\n", path,
+				lineno);
+			fclose(file);
+			return -1;
+		}
+		*eq = '\0';
+		char *key = trim(s), *value = trim(eq + 1);
+
+		if (strcmp(section, "icons") == 0) {
+			if (strcmp(key, "font") == 0) {
+				snprintf(theme->font, sizeof(theme->font), "%s",
+					 value);
+			} else if (strcmp(key, "bold") == 0) {
+				theme->bold = strcmp(value, "true") == 0;
+			} else if (strcmp(key, "sizes") == 0) {
+				theme->size_count = 0;
+				for (char *tok = strtok(value, ", ");
+				     tok && theme->size_count < MAX_SIZES;
+				     tok = strtok(NULL, ", ")) {
+					theme->sizes[theme->size_count++] =
+					    atoi(tok);
+				}
+			} else {
+				for (int i = 0; i < 4; i++) {
+					if (strcmp(key, icon_names[i]) == 0) {
+						theme->icons[i] =
+						    parse_codepoint(value);
+					}
+				}
+			}
+		} else if (strcmp(section, "background") == 0 &&
+			   strcmp(key, "file") == 0) {
+			// relative to the directory holding theme.ini
+			const char *slash = strrchr(path, '/');
+			int dir_len = slash ? (int)(slash - path + 1) : 0;
+			snprintf(theme->background, sizeof(theme->background),
+				 "%.*s%s", value[0] == '/' ? 0 : dir_len, path,
+				 value);
+		}
+	}
+	fclose(file);
+
+	if (theme->size_count == 0) {
+		fprintf(stderr, "%s: no icon sizes\n", path);
+		return -1;
+	}
+	for (int i = 0; i < 4; i++) {
+		if (theme->icons[i] == 0) {
+			fprintf(stderr, "%s: missing icon '%s'\n", path,
+				icon_names[i]);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static void utf8_encode(uint32_t cp, char out[5]) {
+	if (cp < 0x80) {
+		out[0] = cp;
+		out[1] = '\0';
+	} else if (cp < 0x800) {
+		out[0] = 0xc0 | (cp >> 6);
+		out[1] = 0x80 | (cp & 0x3f);
+		out[2] = '\0';
+	} else if (cp < 0x10000) {
+		out[0] = 0xe0 | (cp >> 12);
+		out[1] = 0x80 | ((cp >> 6) & 0x3f);
+		out[2] = 0x80 | (cp & 0x3f);
+		out[3] = '\0';
+	} else {
+		out[0] = 0xf0 | (cp >> 18);
+		out[1] = 0x80 | ((cp >> 12) & 0x3f);
+		out[2] = 0x80 | ((cp >> 6) & 0x3f);
+		out[3] = 0x80 | (cp & 0x3f);
+		out[4] = '\0';
+	}
+}
+
+static bool has_family(FcPattern *match, const char *family) {
+	FcChar8 *name;
+	for (int i = 0; FcPatternGetString(match, FC_FAMILY, i, &name) ==
+			FcResultMatch;
+	     i++) {
+		if (FcStrCmpIgnoreCase(name, (const FcChar8 *)family) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Returns NULL, after saying why, unless the family itself is installed and
+// has every icon.
+static cairo_font_face_t *resolve_font(const struct theme *theme) {
+	FcPattern *pattern = FcPatternCreate();
+	FcPatternAddString(pattern, FC_FAMILY, (const FcChar8 *)theme->font);
+	FcPatternAddInteger(pattern, FC_WEIGHT,
+			    theme->bold ? FC_WEIGHT_BOLD : FC_WEIGHT_REGULAR);
+	FcConfigSubstitute(NULL, pattern, FcMatchPattern);
+	FcDefaultSubstitute(pattern);
+	FcResult result;
+	FcPattern *match = FcFontMatch(NULL, pattern, &result);
+	FcPatternDestroy(pattern);
+	if (!match) {
+		fprintf(stderr, "no font matches '%s'\n", theme->font);
+		return NULL;
+	}
+
+	FcChar8 *file = NULL;
+	FcPatternGetString(match, FC_FILE, 0, &file);
+	if (!has_family(match, theme->font)) {
+		FcChar8 *family = NULL;
+		FcPatternGetString(match, FC_FAMILY, 0, &family);
+		fprintf(stderr,
+			"font '%s' is not installed, fontconfig falls back to "
+			"'%s' (%s)\n",
+			theme->font, family ? (char *)family : "?",
+			file ? (char *)file : "?");
+		FcPatternDestroy(match);
+		return NULL;
+	}
+	FcCharSet *charset;
+	if (FcPatternGetCharSet(match, FC_CHARSET, 0, &charset) !=
+	    FcResultMatch) {
+		fprintf(stderr, "%s: no character coverage\n",
+			file ? (char *)file : theme->font);
+		FcPatternDestroy(match);
+		return NULL;
+	}
+	for (int i = 0; i < 4; i++) {
+		if (!FcCharSetHasChar(charset, theme->icons[i])) {
+			fprintf(stderr, "%s has no glyph for %s (U+%04X)\n",
+				file ? (char *)file : theme->font,
+				icon_names[i], theme->icons[i]);
+			FcPatternDestroy(match);
+			return NULL;
+		}
+	}
+
+	// the face keeps its own reference to the pattern
+	cairo_font_face_t *face = cairo_ft_font_face_create_for_pattern(match);
+	FcPatternDestroy(match);
+	if (cairo_font_face_status(face) != CAIRO_STATUS_SUCCESS) {
+		cairo_font_face_destroy(face);
+		return NULL;
+	}
+	return face;
+}
+
+static void write_bytes(FILE *out, const uint8_t *data, size_t size) {
+	for (size_t i = 0; i < size; i++) {
+		fprintf(out, "%s0x%02x,", i % 16 ? "" : "\n\t", data[i]);
+	}
+	fprintf(out, "\n");
+}
+
+static int write_glyph(FILE *out, const struct theme *theme,
+		       cairo_font_face_t *font, int icon, int size, int index) {
+	char text[5];
+	utf8_encode(theme->icons[icon], text);
+
+	cairo_surface_t *scratch =
+	    cairo_image_surface_create(CAIRO_FORMAT_A8, 1, 1);
+	cairo_t *cr = cairo_create(scratch);
+	cairo_set_font_face(cr, font);
+	cairo_set_font_size(cr, size);
+	cairo_text_extents_t extents;
+	cairo_text_extents(cr, text, &extents);
+	cairo_destroy(cr);
+	cairo_surface_destroy(scratch);
+
+	// one pixel of padding for antialiasing
+	int x0 = (int)floor(extents.x_bearing) - 1;
+	int y0 = (int)floor(extents.y_bearing) - 1;
+	int width = (int)ceil(extents.x_bearing + extents.width) + 1 - x0;
+	int height = (int)ceil(extents.y_bearing + extents.height) + 1 - y0;
+
+	cairo_surface_t *mask =
+	    cairo_image_surface_create(CAIRO_FORMAT_A8, width, height);
+	cr = cairo_create(mask);
+	cairo_set_font_face(cr, font);
+	cairo_set_font_size(cr, size);
+	cairo_set_source_rgb(cr, 0, 0, 0);
+	cairo_move_to(cr, -x0, -y0);
+	cairo_show_text(cr, text);
+	cairo_destroy(cr);
+	cairo_surface_flush(mask);
+	if (cairo_surface_status(mask) != CAIRO_STATUS_SUCCESS) {
+		cairo_surface_destroy(mask);
+		return -1;
+	}
+
+	int stride = cairo_image_surface_get_stride(mask);
+	fprintf(out, "/* %s, U+%04X at %dpx */\n", icon_names[icon],
+		theme->icons[icon], size);
+	fprintf(out, "static const uint8_t glyph_%d[] = {", index);
+	write_bytes(out, cairo_image_surface_get_data(mask),
+		    (size_t)stride * height);
+	fprintf(out, "};\n\n");
+	cairo_surface_destroy(mask);
+
+	return fprintf(out,
+		       "#define GLYPH_%d {%s, %d, %d, %d, %d, %d, %d, %.4f, "
+		       "%.4f, %.4f, %.4f, glyph_%d}\n\n",
+		       index, icon_states[icon], size, width, height, stride,
+		       x0, y0, extents.x_bearing, extents.y_bearing,
+		       extents.width, extents.height, index) < 0
+		   ? -1
+		   : 0;
+}
+
+static int write_background(FILE *out, const char *path) {
+	uint8_t *data = NULL;
+	size_t size = 0;
+	if (path[0]) {
+		FILE *file = fopen(path, "rb");
+		if (!file) {
+			perror(path);
+			return -1;
+		}
+		fseek(file, 0, SEEK_END);
+		size = ftell(file);
+		fseek(file, 0, SEEK_SET);
+		data = malloc(size);
+		if (!data || fread(data, 1, size, file) != size) {
+			fclose(file);
+			free(data);
+			return -1;
+		}
+		fclose(file);
+	}
+
+	fprintf(out, "const uint8_t theme_background[] = {");
+	if (size) {
+		write_bytes(out, data, size);
+	} else {
+		fprintf(out, "0");
+	}
+	fprintf(out, "};\nconst size_t theme_background_size = %zu;\n", size);
+	free(data);
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	if (argc != 4) {
+		fprintf(stderr, "usage: %s theme.ini output.c output.d\n",
+			argv[0]);
+		return 1;
+	}
+
+	struct theme theme = {.bold = true};
+	if (parse_theme(argv[1], &theme) != 0) {
+		return 1;
+	}
+
+	cairo_font_face_t *font = resolve_font(&theme);
+	if (!font) {
+		return 1;
+	}
+
+	FILE *out = fopen(argv[2], "w");
+	if (!out) {
+		perror(argv[2]);
+		cairo_font_face_destroy(font);
+		return 1;
+	}
+	fprintf(out, "/* Generated by embed-theme from %s, do not edit */\n"
+		     "#include \"theme.h\"\n\n",
+		argv[1]);
+
+	int count = 0;
+	for (int i = 0; i < theme.size_count; i++) {
+		for (int icon = 0; icon < 4; icon++) {
+			if (write_glyph(out, &theme, font, icon,
+					theme.sizes[i], count++) != 0) {
+				fprintf(stderr, "failed to rasterise %s\n",
+					icon_names[icon]);
+				fclose(out);
+				cairo_font_face_destroy(font);
+				return 1;
+			}
+		}
+	}
+	cairo_font_face_destroy(font);
+	fprintf(out, "const struct theme_glyph theme_glyphs[] = {\n");
+	for (int i = 0; i < count; i++) {
+		fprintf(out, "\tGLYPH_%d,\n", i);
+	}
+	fprintf(out, "};\nconst size_t theme_glyph_count = %d;\n\n", count);
+
+	if (write_background(out, theme.background) != 0) {
+		fclose(out);
+		return 1;
+	}
+	fclose(out);
+
+	FILE *dep = fopen(argv[3], "w");
+	if (!dep) {
+		perror(argv[3]);
+		return 1;
+	}
+	fprintf(dep, "%s: %s %s\n", argv[2], argv[1], theme.background);
+	fclose(dep);
+	return 0;
+}
@@ -0,0 +1,278 @@
+/*
+ * Replays a recorded input trace through the locker's key handling.
+ *
+ * Traces come from `locker --record-input FILE`. Every event goes through the
+ * same xkb lookup and input state machine as in the locker, and each change
+ * of the visible icon is rendered into memory the way a redraw would, so the
+ * cost of a typing session can be reproduced without a compositor or a
+ * password. Submitting is treated as a failed authentication.
+ *
+ * Events are replayed at their recorded pace unless --max-speed is given. A
+ * JSON summary with per-event handling time and the number of renders is
+ * printed on stdout.
+ *
+ * usage: input-replay [options] TRACE
+ */
+#include "input.h"
+#include "input_trace.h"
+#include "render.h"
+#include <cairo.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <xkbcommon/xkbcommon.h>
+
+#define MAX_SAMPLES 65536
+
+struct replay {
+	struct xkb_state *xkb_state;
+	struct auth_state auth;
+	struct render_params params;
+	bool redraw_typing;
+	uint32_t width;
+	uint32_t height;
+	uint32_t stride;
+	uint8_t *pixels;
+	uint32_t renders;
+	uint32_t submits;
+};
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void sleep_until(uint64_t deadline_ns) {
+	struct timespec ts = {
+	    .tv_sec = deadline_ns / 1000000000ull,
+	    .tv_nsec = deadline_ns % 1000000000ull,
+	};
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0)
+		;
+}
+
+// mirrors change_icon_state(), only icons that look different cost a frame
+static void set_icon(struct replay *replay, auth_state_t state) {
+	auth_state_t previous = replay->auth.current_state;
+	replay->auth.current_state = state;
+	if (render_visible_icon(previous, replay->redraw_typing) ==
+	    render_visible_icon(state, replay->redraw_typing)) {
+		return;
+	}
+	render_icon(&replay->params,
+		    render_visible_icon(state, replay->redraw_typing),
+		    replay->width, replay->height, replay->stride, 1,
+		    replay->pixels);
+	replay->renders++;
+}
+
+static void handle_event(struct replay *replay,
+			 const struct input_event *event) {
+	if (event->type == INPUT_EVENT_MODIFIERS) {
+		xkb_state_update_mask(replay->xkb_state, event->depressed,
+				      event->latched, event->locked, 0, 0,
+				      event->group);
+		return;
+	}
+	if (event->state != 1) {
+		return;
+	}
+
+	uint32_t keycode = event->key + 8;
+	xkb_keysym_t sym = xkb_state_key_get_one_sym(replay->xkb_state, keycode);
+	char buf[8];
+	int len =
+	    xkb_state_key_get_utf8(replay->xkb_state, keycode, buf, sizeof(buf));
+	if (len >= (int)sizeof(buf)) {
+		len = 0;
+	}
+
+	struct input_effect effect =
+	    input_handle_key(&replay->auth, sym, buf, len);
+	set_icon(replay, effect.icon);
+	if (effect.submit) {
+		replay->submits++;
+		set_icon(replay, AUTH_STATE_LOCKED);
+		clearPasswordBuffer(&replay->auth);
+	}
+}
+
+static int compare_u64(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return x < y ? -1 : x > y;
+}
+
+static uint64_t percentile(const uint64_t *sorted, uint32_t count,
+			   uint32_t pct) {
+	if (count == 0) {
+		return 0;
+	}
+	return sorted[(uint64_t)(count - 1) * pct / 100];
+}
+
+static void usage(const char *name) {
+	fprintf(stderr,
+		"usage: %s [options] TRACE\n"
+		"  --max-speed       do not wait between events\n"
+		"  --size WxH        frame size to render (1920x1080)\n"
+		"  --layout LAYOUT   xkb layout the trace was typed on (us)\n"
+		"  --no-typing-icon  keep the locked icon while typing\n"
+		"  --verbose         print every event\n",
+		name);
+}
+
+int main(int argc, char **argv) {
+	static const struct option long_options[] = {
+	    {"max-speed", no_argument, NULL, 'm'},
+	    {"size", required_argument, NULL, 's'},
+	    {"layout", required_argument, NULL, 'l'},
+	    {"no-typing-icon", no_argument, NULL, 'n'},
+	    {"verbose", no_argument, NULL, 'v'},
+	    {"help", no_argument, NULL, 'h'},
+	    {0},
+	};
+
+	struct replay replay = {
+	    .redraw_typing = true,
+	    .width = 1920,
+	    .height = 1080,
+	    .params =
+		{
+		    .filter = CAIRO_FILTER_GOOD,
+		    .icon_font_family = "JetBrainsMono Nerd Font",
+		    .icon_size = 50,
+		},
+	};
+	const char *layout = "us";
+	bool max_speed = false;
+	bool verbose = false;
+
+	int opt;
+	while ((opt = getopt_long(argc, argv, "h", long_options, NULL)) != -1) {
+		switch (opt) {
+		case 'm':
+			max_speed = true;
+			break;
+		case 's':
+			if (sscanf(optarg, "%ux%u", &replay.width,
+				   &replay.height) != 2 ||
+			    replay.width == 0 || replay.height == 0) {
+				fprintf(stderr, "bad size '%s'\n", optarg);
+				return 1;
+			}
+			break;
+		case 'l':
+			layout = optarg;
+			break;
+		case 'n':
+			replay.redraw_typing = false;
+			break;
+		case 'v':
+			verbose = true;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (optind != argc - 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	FILE *trace = fopen(argv[optind], "r");
+	if (!trace) {
+		perror("failed to open the trace");
+		return 1;
+	}
+
+	struct xkb_context *context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+	struct xkb_rule_names names = {.layout = layout};
+	struct xkb_keymap *keymap =
+	    context ? xkb_keymap_new_from_names(context, &names,
+						XKB_KEYMAP_COMPILE_NO_FLAGS)
+		    : NULL;
+	if (!keymap) {
+		fprintf(stderr, "failed to compile the '%s' keymap\n", layout);
+		return 1;
+	}
+	replay.xkb_state = xkb_state_new(keymap);
+
+	replay.auth.password_len = 256;
+	replay.auth.password_buffer = calloc(replay.auth.password_len, 1);
+	replay.auth.current_state = AUTH_STATE_LOCKED;
+	replay.stride = replay.width * 4;
+	replay.pixels = malloc((size_t)replay.stride * replay.height);
+	uint64_t *samples = malloc(MAX_SAMPLES * sizeof(*samples));
+	if (!replay.auth.password_buffer || !replay.pixels || !samples) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	replay.params.icon_font = cairo_toy_font_face_create(
+	    replay.params.icon_font_family, CAIRO_FONT_SLANT_NORMAL,
+	    CAIRO_FONT_WEIGHT_BOLD);
+	// the locker has a frame on screen before the first key arrives
+	render_frame(&replay.params, AUTH_STATE_LOCKED, replay.width,
+		     replay.height, replay.stride, 1, replay.pixels);
+
+	uint32_t events = 0, count = 0;
+	uint64_t total_ns = 0;
+	uint64_t start = now_ns();
+	struct input_event event;
+	int ret;
+	while ((ret = input_trace_read(trace, &event)) == 1) {
+		if (!max_speed) {
+			sleep_until(start + event.time_us * 1000);
+		}
+		uint32_t renders = replay.renders;
+		uint64_t before = now_ns();
+		handle_event(&replay, &event);
+		uint64_t elapsed = now_ns() - before;
+
+		events++;
+		total_ns += elapsed;
+		if (count < MAX_SAMPLES) {
+			samples[count++] = elapsed;
+		}
+		if (verbose) {
+			printf("{\"time_us\":%llu,\"type\":\"%s\",\"key\":%u,"
+			       "\"handle_ns\":%llu,\"renders\":%u}\n",
+			       (unsigned long long)event.time_us,
+			       event.type == INPUT_EVENT_KEY ? "key" : "mods",
+			       event.key, (unsigned long long)elapsed,
+			       replay.renders - renders);
+		}
+	}
+	if (ret < 0) {
+		fprintf(stderr, "malformed trace after %u events\n", events);
+		return 1;
+	}
+	uint64_t wall_ns = now_ns() - start;
+
+	qsort(samples, count, sizeof(*samples), compare_u64);
+	printf("{\"events\":%u,\"renders\":%u,\"submits\":%u,"
+	       "\"size\":\"%ux%u\",\"max_speed\":%s,"
+	       "\"handle_ns\":{\"p50\":%llu,\"p99\":%llu,\"max\":%llu,"
+	       "\"total\":%llu},\"wall_ns\":%llu}\n",
+	       events, replay.renders, replay.submits, replay.width,
+	       replay.height, max_speed ? "true" : "false",
+	       (unsigned long long)percentile(samples, count, 50),
+	       (unsigned long long)percentile(samples, count, 99),
+	       (unsigned long long)(count ? samples[count - 1] : 0),
+	       (unsigned long long)total_ns, (unsigned long long)wall_ns);
+
+	free(samples);
+	free(replay.pixels);
+	free(replay.auth.password_buffer);
+	cairo_font_face_destroy(replay.params.icon_font);
+	xkb_state_unref(replay.xkb_state);
+	xkb_keymap_unref(keymap);
+	xkb_context_unref(context);
+	fclose(trace);
+	return 0;
+}
@@ -0,0 +1,75 @@
+/*
+ * A PAM module standing in for a fingerprint reader, to try the concurrent
+ * service without one.
+ *
+ * It tells the user it is waiting, sleeps and then succeeds. Arguments:
+ *   delay=SECONDS    how long to wait (3, 0 with password=)
+ *   fail             fail instead of succeeding
+ *   password=SECRET  ask for a password and succeed only on SECRET, the
+ *                    end-to-end test checks the password path with it
+ *
+ * Install it and point a service at it, then lock with that service:
+ *   echo 'auth required /path/to/pam_locker_delay.so delay=5' \
+ *       > /etc/pam.d/locker-delay
+ *   echo 'account required pam_permit.so' >> /etc/pam.d/locker-delay
+ *   locker --concurrent-pam locker-delay
+ */
+#include <security/pam_appl.h>
+#include <security/pam_ext.h>
+#include <security/pam_modules.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+int pam_sm_authenticate(pam_handle_t *pamh, int flags, int argc,
+			const char **argv) {
+	unsigned long delay = 3;
+	bool delay_set = false;
+	bool fail = false;
+	const char *password = NULL;
+	for (int i = 0; i < argc; i++) {
+		if (strncmp(argv[i], "delay=", 6) == 0) {
+			delay = strtoul(argv[i] + 6, NULL, 10);
+			delay_set = true;
+		} else if (strcmp(argv[i], "fail") == 0) {
+			fail = true;
+		} else if (strncmp(argv[i], "password=", 9) == 0) {
+			password = argv[i] + 9;
+		}
+	}
+
+	if (password) {
+		char *response = NULL;
+		if (pam_prompt(pamh, PAM_PROMPT_ECHO_OFF, &response,
+			       "Password: ") != PAM_SUCCESS ||
+		    !response) {
+			return PAM_AUTH_ERR;
+		}
+		fail = fail || strcmp(response, password) != 0;
+		memset(response, 0, strlen(response));
+		free(response);
+		if (!delay_set) {
+			delay = 0;
+		}
+	}
+
+	if (delay && !(flags & PAM_SILENT)) {
+		pam_info(pamh, "Waiting %lu seconds", delay);
+	}
+	struct timespec wait = {.tv_sec = delay};
+	while (nanosleep(&wait, &wait) != 0)
+		;
+	if (fail) {
+		if (!(flags & PAM_SILENT)) {
+			pam_error(pamh, "No match");
+		}
+		return PAM_AUTH_ERR;
+	}
+	return PAM_SUCCESS;
+}
+
+int pam_sm_setcred(pam_handle_t *pamh, int flags, int argc,
+		   const char **argv) {
+	return PAM_SUCCESS;
+}
@@ -0,0 +1,1188 @@
+/*
+ * Stand-in compositor for end-to-end runs of the locker.
+ *
+ * Implements just enough of wl_compositor, wl_subcompositor, wl_shm,
+ * wl_seat/wl_keyboard, wl_output and ext_session_lock_manager_v1 to take a
+ * lock, then spawns the
+ * locker against its own socket, replays a scripted key sequence and records
+ * every commit. Nothing is displayed, so it runs headless in CI.
+ *
+ * The key script is plain text typed one key per interval, plus tokens:
+ *   <Return> <Escape> <BackSpace>  any xkb keysym name
+ *   <sleep MS>                      pause the script
+ *   <configure WxH>                 resize every output and reconfigure
+ *
+ * A JSON summary with time-to-lock, per-keystroke commit latency and the
+ * number of full-frame uploads is printed on stdout. The exit status says
+ * whether the session was locked with a frame on every output and, with
+ * --expect-unlock N, whether the N-th <Return> and no earlier one unlocked
+ * it and the locker then exited cleanly. With --expect-overlays it also
+ * fails unless subsurfaces were committed while locked and the lock surfaces
+ * were not damaged after the lock.
+ *
+ * usage: test-compositor [options] -- locker [locker options]
+ */
+#include "ext-session-lock-v1-server-protocol.h"
+#include "shared_memory.h"
+#include <getopt.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <wayland-server-core.h>
+#include <wayland-server-protocol.h>
+#include <wayland-server.h>
+#include <xkbcommon/xkbcommon-keysyms.h>
+#include <xkbcommon/xkbcommon.h>
+
+#define MAX_OUTPUTS 8
+#define MAX_SAMPLES 1024
+#define REFRESH_MHZ 60000
+
+struct server;
+
+struct test_output {
+	struct wl_list link; // server.outputs
+	struct server *server;
+	int index;
+	int32_t width; // mode, in pixels
+	int32_t height;
+	int32_t scale;
+	struct wl_global *global;
+	struct wl_list resources;
+	struct test_surface *lock_surface;
+	bool presented; // a lock surface buffer was committed
+};
+
+struct test_surface {
+	struct server *server;
+	struct wl_resource *resource;
+	struct wl_resource *lock_surface;
+	struct wl_resource *subsurface; // NULL unless this is a subsurface
+	struct test_output *output;
+
+	struct wl_resource *pending_buffer;
+	bool attached;
+	// pending damage in buffer coordinates, empty when x1 <= x0
+	int32_t damage_x0, damage_y0, damage_x1, damage_y1;
+	bool damage_all;
+	struct wl_list pending_frames; // wl_callback resources
+};
+
+struct server {
+	struct wl_display *display;
+	struct wl_event_loop *loop;
+	struct wl_list outputs;	  // test_output.link
+	struct wl_list keyboards; // wl_keyboard resources
+	struct wl_list frames;	  // callbacks waiting for the next refresh
+	struct wl_event_source *refresh_timer;
+
+	struct xkb_context *xkb_context;
+	struct xkb_keymap *keymap;
+	int keymap_fd;
+	uint32_t keymap_size;
+
+	struct wl_resource *lock;
+	struct test_surface *focus;
+	bool locked;
+	bool unlocked;
+
+	const char *script;
+	size_t script_pos;
+	uint32_t key_interval;
+	uint32_t settle;
+	struct wl_event_source *script_timer;
+	struct wl_event_source *timeout_timer;
+
+	pid_t child;
+	int child_status;
+	bool child_running;
+
+	const char *dump_dir;
+	bool verbose;
+
+	// measurements, CLOCK_MONOTONIC
+	uint64_t spawn_ns;
+	uint64_t lock_request_ns;
+	uint64_t locked_ns;
+	uint64_t unlock_ns;
+	uint64_t key_ns; // last key sent and not yet answered by a commit
+	uint32_t keys;
+	uint32_t returns; // <Return>s sent so far
+	uint32_t returns_at_unlock;
+	int expect_unlock; // the <Return> that must unlock, -1 for none
+	uint32_t commits;
+	uint32_t full_uploads;
+	uint64_t damaged_bytes;
+	bool expect_overlays;
+	uint32_t overlay_commits; // subsurface buffers while locked
+	uint64_t locked_damage;	  // lock surface bytes damaged after locking
+	uint32_t key_samples[MAX_SAMPLES]; // microseconds
+	uint32_t key_sample_count;
+};
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint32_t now_ms(void) { return now_ns() / 1000000; }
+
+static double since_ms(struct server *server, uint64_t ns) {
+	return ns ? (ns - server->spawn_ns) / 1e6 : -1;
+}
+
+static void remove_resource_link(struct wl_resource *resource) {
+	wl_list_remove(wl_resource_get_link(resource));
+}
+
+static void destroy_resource(struct wl_client *client,
+			     struct wl_resource *resource) {
+	wl_resource_destroy(resource);
+}
+
+// ---- outputs ----
+
+static void send_output_state(struct test_output *output,
+			      struct wl_resource *resource) {
+	wl_output_send_geometry(resource, 0, 0, 0, 0,
+				WL_OUTPUT_SUBPIXEL_UNKNOWN, "locker",
+				"test-compositor", WL_OUTPUT_TRANSFORM_NORMAL);
+	wl_output_send_mode(resource,
+			    WL_OUTPUT_MODE_CURRENT | WL_OUTPUT_MODE_PREFERRED,
+			    output->width, output->height, REFRESH_MHZ);
+	if (wl_resource_get_version(resource) >= 2) {
+		wl_output_send_scale(resource, output->scale);
+		wl_output_send_done(resource);
+	}
+}
+
+static const struct wl_output_interface output_impl = {
+    .release = destroy_resource,
+};
+
+static void bind_output(struct wl_client *client, void *data,
+			uint32_t version, uint32_t id) {
+	struct test_output *output = data;
+	struct wl_resource *resource =
+	    wl_resource_create(client, &wl_output_interface, version, id);
+	if (!resource) {
+		wl_client_post_no_memory(client);
+		return;
+	}
+	wl_resource_set_implementation(resource, &output_impl, output,
+				       remove_resource_link);
+	wl_list_insert(&output->resources, wl_resource_get_link(resource));
+	send_output_state(output, resource);
+}
+
+static void configure_lock_surface(struct test_output *output) {
+	struct test_surface *surface = output->lock_surface;
+	if (!surface) {
+		return;
+	}
+	struct server *server = output->server;
+	ext_session_lock_surface_v1_send_configure(
+	    surface->lock_surface, wl_display_next_serial(server->display),
+	    output->width / output->scale, output->height / output->scale);
+}
+
+// ---- surfaces ----
+
+static void surface_attach(struct wl_client *client,
+			   struct wl_resource *resource,
+			   struct wl_resource *buffer, int32_t x, int32_t y) {
+	struct test_surface *surface = wl_resource_get_user_data(resource);
+	surface->pending_buffer = buffer;
+	surface->attached = true;
+}
+
+static void add_damage(struct test_surface *surface, int32_t x, int32_t y,
+		       int32_t width, int32_t height) {
+	if (surface->damage_x1 <= surface->damage_x0) {
+		surface->damage_x0 = x;
+		surface->damage_y0 = y;
+		surface->damage_x1 = x + width;
+		surface->damage_y1 = y + height;
+		return;
+	}
+	if (x < surface->damage_x0) {
+		surface->damage_x0 = x;
+	}
+	if (y < surface->damage_y0) {
+		surface->damage_y0 = y;
+	}
+	if (x + width > surface->damage_x1) {
+		surface->damage_x1 = x + width;
+	}
+	if (y + height > surface->damage_y1) {
+		surface->damage_y1 = y + height;
+	}
+}
+
+static void surface_damage(struct wl_client *client,
+			   struct wl_resource *resource, int32_t x, int32_t y,
+			   int32_t width, int32_t height) {
+	// surface coordinates, do not bother with the scale
+	struct test_surface *surface = wl_resource_get_user_data(resource);
+	surface->damage_all = true;
+}
+
+static void surface_damage_buffer(struct wl_client *client,
+				  struct wl_resource *resource, int32_t x,
+				  int32_t y, int32_t width, int32_t height) {
+	struct test_surface *surface = wl_resource_get_user_data(resource);
+	add_damage(surface, x, y, width, height);
+}
+
+static void surface_frame(struct wl_client *client,
+			  struct wl_resource *resource, uint32_t id) {
+	struct test_surface *surface = wl_resource_get_user_data(resource);
+	struct wl_resource *callback =
+	    wl_resource_create(client, &wl_callback_interface, 1, id);
+	if (!callback) {
+		wl_client_post_no_memory(client);
+		return;
+	}
+	wl_resource_set_implementation(callback, NULL, NULL,
+				       remove_resource_link);
+	wl_list_insert(surface->pending_frames.prev,
+		       wl_resource_get_link(callback));
+}
+
+static void surface_set_region(struct wl_client *client,
+			       struct wl_resource *resource,
+			       struct wl_resource *region) {}
+
+static void surface_set_int(struct wl_client *client,
+			    struct wl_resource *resource, int32_t value) {}
+
+static uint64_t hash_buffer(const uint8_t *data, int32_t width,
+			    int32_t height, int32_t stride) {
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (int32_t y = 0; y < height; y++) {
+		const uint8_t *row = data + (size_t)y * stride;
+		for (int32_t x = 0; x < width * 4; x++) {
+			hash = (hash ^ row[x]) * 0x100000001b3ull;
+		}
+	}
+	return hash;
+}
+
+static void dump_buffer(struct server *server, const uint8_t *data,
+			int32_t width, int32_t height, int32_t stride) {
+	char path[4096];
+	snprintf(path, sizeof(path), "%s/commit-%04u.ppm", server->dump_dir,
+		 server->commits);
+	FILE *file = fopen(path, "wb");
+	if (!file) {
+		perror(path);
+		return;
+	}
+	fprintf(file, "P6\n%d %d\n255\n", width, height);
+	for (int32_t y = 0; y < height; y++) {
+		const uint32_t *row = (const uint32_t *)(data + (size_t)y * stride);
+		for (int32_t x = 0; x < width; x++) {
+			uint8_t rgb[3] = {row[x] >> 16, row[x] >> 8, row[x]};
+			fwrite(rgb, 1, sizeof(rgb), file);
+		}
+	}
+	fclose(file);
+}
+
+static void maybe_send_locked(struct server *server);
+
+static void surface_commit(struct wl_client *client,
+			   struct wl_resource *resource) {
+	struct test_surface *surface = wl_resource_get_user_data(resource);
+	struct server *server = surface->server;
+
+	wl_list_insert_list(server->frames.prev, &surface->pending_frames);
+	wl_list_init(&surface->pending_frames);
+	if (!wl_list_empty(&server->frames)) {
+		wl_event_source_timer_update(server->refresh_timer,
+					     1000000 / REFRESH_MHZ);
+	}
+
+	struct wl_shm_buffer *shm = surface->attached && surface->pending_buffer
+					? wl_shm_buffer_get(surface->pending_buffer)
+					: NULL;
+	if (shm) {
+		uint64_t commit_ns = now_ns();
+		int32_t width = wl_shm_buffer_get_width(shm);
+		int32_t height = wl_shm_buffer_get_height(shm);
+		int32_t stride = wl_shm_buffer_get_stride(shm);
+
+		if (surface->damage_all) {
+			surface->damage_x0 = surface->damage_y0 = 0;
+			surface->damage_x1 = width;
+			surface->damage_y1 = height;
+		}
+		int32_t x0 = surface->damage_x0 < 0 ? 0 : surface->damage_x0;
+		int32_t y0 = surface->damage_y0 < 0 ? 0 : surface->damage_y0;
+		int32_t x1 = surface->damage_x1 > width ? width
+							: surface->damage_x1;
+		int32_t y1 = surface->damage_y1 > height ? height
+							 : surface->damage_y1;
+		uint64_t damaged =
+		    x1 > x0 && y1 > y0 ? (uint64_t)(x1 - x0) * (y1 - y0) * 4 : 0;
+		bool full = damaged == (uint64_t)width * height * 4;
+
+		wl_shm_buffer_begin_access(shm);
+		const uint8_t *data = wl_shm_buffer_get_data(shm);
+		uint64_t hash = hash_buffer(data, width, height, stride);
+		if (server->dump_dir) {
+			dump_buffer(server, data, width, height, stride);
+		}
+		wl_shm_buffer_end_access(shm);
+
+		server->commits++;
+		server->full_uploads += full;
+		server->damaged_bytes += damaged;
+		if (server->locked && surface->subsurface) {
+			server->overlay_commits++;
+		} else if (server->locked && surface->output) {
+			server->locked_damage += damaged;
+		}
+		if (server->key_ns && server->key_sample_count < MAX_SAMPLES) {
+			server->key_samples[server->key_sample_count++] =
+			    (commit_ns - server->key_ns) / 1000;
+			server->key_ns = 0;
+		}
+		if (server->verbose) {
+			printf("{\"event\":\"commit\",\"t_ms\":%.3f,\"output\":"
+			       "%d,\"size\":\"%dx%d\",\"damage\":\"%d,%d %dx%d\","
+			       "\"full\":%s,\"hash\":\"%016llx\"}\n",
+			       since_ms(server, commit_ns),
+			       surface->output ? surface->output->index : -1,
+			       width, height, x0, y0, x1 - x0, y1 - y0,
+			       full ? "true" : "false",
+			       (unsigned long long)hash);
+		}
+		// contents are copied out above, the client may reuse it
+		wl_buffer_send_release(surface->pending_buffer);
+
+		if (surface->output) {
+			surface->output->presented = true;
+			maybe_send_locked(server);
+		}
+	}
+
+	surface->pending_buffer = NULL;
+	surface->attached = false;
+	surface->damage_all = false;
+	surface->damage_x0 = surface->damage_x1 = 0;
+	surface->damage_y0 = surface->damage_y1 = 0;
+}
+
+static const struct wl_surface_interface surface_impl = {
+    .destroy = destroy_resource,
+    .attach = surface_attach,
+    .damage = surface_damage,
+    .frame = surface_frame,
+    .set_opaque_region = surface_set_region,
+    .set_input_region = surface_set_region,
+    .commit = surface_commit,
+    .set_buffer_transform = surface_set_int,
+    .set_buffer_scale = surface_set_int,
+    .damage_buffer = surface_damage_buffer,
+};
+
+static void surface_destroy(struct wl_resource *resource) {
+	struct test_surface *surface = wl_resource_get_user_data(resource);
+	struct wl_resource *callback, *tmp;
+	wl_resource_for_each_safe(callback, tmp, &surface->pending_frames) {
+		wl_resource_destroy(callback);
+	}
+	if (surface->lock_surface) {
+		wl_resource_set_user_data(surface->lock_surface, NULL);
+	}
+	if (surface->subsurface) {
+		wl_resource_set_user_data(surface->subsurface, NULL);
+	}
+	if (surface->output) {
+		surface->output->lock_surface = NULL;
+	}
+	if (surface->server->focus == surface) {
+		surface->server->focus = NULL;
+	}
+	free(surface);
+}
+
+static void region_add(struct wl_client *client, struct wl_resource *resource,
+		       int32_t x, int32_t y, int32_t width, int32_t height) {}
+
+static const struct wl_region_interface region_impl = {
+    .destroy = destroy_resource,
+    .add = region_add,
+    .subtract = region_add,
+};
+
+static void compositor_create_surface(struct wl_client *client,
+				      struct wl_resource *resource,
+				      uint32_t id) {
+	struct test_surface *surface = calloc(1, sizeof(*surface));
+	if (!surface) {
+		wl_client_post_no_memory(client);
+		return;
+	}
+	surface->server = wl_resource_get_user_data(resource);
+	wl_list_init(&surface->pending_frames);
+	surface->resource =
+	    wl_resource_create(client, &wl_surface_interface,
+			       wl_resource_get_version(resource), id);
+	if (!surface->resource) {
+		free(surface);
+		wl_client_post_no_memory(client);
+		return;
+	}
+	wl_resource_set_implementation(surface->resource, &surface_impl,
+				       surface, surface_destroy);
+}
+
+static void compositor_create_region(struct wl_client *client,
+				     struct wl_resource *resource,
+				     uint32_t id) {
+	struct wl_resource *region =
+	    wl_resource_create(client, &wl_region_interface, 1, id);
+	if (!region) {
+		wl_client_post_no_memory(client);
+		return;
+	}
+	wl_resource_set_implementation(region, &region_impl, NULL, NULL);
+}
+
+static const struct wl_compositor_interface compositor_impl = {
+    .create_surface = compositor_create_surface,
+    .create_region = compositor_create_region,
+};
+
+static void bind_compositor(struct wl_client *client, void *data,
+			    uint32_t version, uint32_t id) {
+	struct wl_resource *resource =
+	    wl_resource_create(client, &wl_compositor_interface, version, id);
+	if (!resource) {
+		wl_client_post_no_memory(client);
+		return;
+	}
+	wl_resource_set_implementation(resource, &compositor_impl, data, NULL);
+}
+
+// ---- subsurfaces ----
+
+// Placement and sync mode do not matter here, nothing is composited.
+static void subsurface_set_position(struct wl_client *client,
+				    struct wl_resource *resource, int32_t x,
+				    int32_t y) {}
+
+static void subsurface_place(struct wl_client *client,
+			     struct wl_resource *resource,
+			     struct wl_resource *sibling) {}
+
+static void subsurface_set_mode(struct wl_client *client,
+				struct wl_resource *resource) {}
+
+static const struct wl_subsurface_interface subsurface_impl = {
+    .destroy = destroy_resource,
+    .set_position = subsurface_set_position,
+    .place_above = subsurface_place,
+    .place_below = subsurface_place,
+    .set_sync = subsurface_set_mode,
+    .set_desync = subsurface_set_mode,
+};
+
+static void subsurface_destroy(struct wl_resource *resource) {
+	struct test_surface *surface = wl_resource_get_user_data(resource);
+	if (surface) {
+		surface->subsurface = NULL;
+	}
+}
+
+static void subcompositor_get_subsurface(struct wl_client *client,
+					 struct wl_resource *resource,
+					 uint32_t id,
+					 struct wl_resource *surface_resource,
+					 struct wl_resource *parent) {
+	struct test_surface *surface =
+	    wl_resource_get_user_data(surface_resource);
+	struct wl_resource *subsurface =
+	    wl_resource_create(client, &wl_subsurface_interface, 1, id);
+	if (!subsurface) {
+		wl_client_post_no_memory(client);
+		return;
+	}
+	wl_resource_set_implementation(subsurface, &subsurface_impl, surface,
+				       subsurface_destroy);
+	surface->subsurface = subsurface;
+}
+
+static const struct wl_subcompositor_interface subcompositor_impl = {
+    .destroy = destroy_resource,
+    .get_subsurface = subcompositor_get_subsurface,
+};
+
+static void bind_subcompositor(struct wl_client *client, void *data,
+			       uint32_t version, uint32_t id) {
+	struct wl_resource *resource =
+	    wl_resource_create(client, &wl_subcompositor_interface, 1, id);
+	if (!resource) {
+		wl_client_post_no_memory(client);
+		return;
+	}
+	wl_resource_set_implementation(resource, &subcompositor_impl, data,
+				       NULL);
+}
+
+static int handle_refresh(void *data) {
+	struct server *server = data;
+	uint32_t time = now_ms();
+	struct wl_resource *callback, *tmp;
+	wl_resource_for_each_safe(callback, tmp, &server->frames) {
+		wl_callback_send_done(callback, time);
+		wl_resource_destroy(callback);
+	}
+	return 0;
+}
+
+// ---- seat ----
+
+static void send_enter(struct server *server, struct wl_resource *keyboard) {
+	if (!server->focus) {
+		return;
+	}
+	struct wl_array keys;
+	wl_array_init(&keys);
+	wl_keyboard_send_enter(keyboard, wl_display_next_serial(server->display),
+			       server->focus->resource, &keys);
+	wl_keyboard_send_modifiers(
+	    keyboard, wl_display_next_serial(server->display), 0, 0, 0, 0);
+	wl_array_release(&keys);
+}
+
+static const struct wl_keyboard_interface keyboard_impl = {
+    .release = destroy_resource,
+};
+
+static void seat_get_keyboard(struct wl_client *client,
+			      struct wl_resource *resource, uint32_t id) {
+	struct server *server = wl_resource_get_user_data(resource);
+	struct wl_resource *keyboard =
+	    wl_resource_create(client, &wl_keyboard_interface,
+			       wl_resource_get_version(resource), id);
+	if (!keyboard) {
+		wl_client_post_no_memory(client);
+		return;
+	}
+	wl_resource_set_implementation(keyboard, &keyboard_impl, server,
+				       remove_resource_link);
+	wl_list_insert(&server->keyboards, wl_resource_get_link(keyboard));
+
+	wl_keyboard_send_keymap(keyboard, WL_KEYBOARD_KEYMAP_FORMAT_XKB_V1,
+				server->keymap_fd, server->keymap_size);
+	if (wl_resource_get_version(keyboard) >= 4) {
+		wl_keyboard_send_repeat_info(keyboard, 25, 600);
+	}
+	if (server->locked) {
+		send_enter(server, keyboard);
+	}
+}
+
+static void seat_get_unsupported(struct wl_client *client,
+				 struct wl_resource *resource, uint32_t id) {
+	wl_resource_post_error(resource, WL_SEAT_ERROR_MISSING_CAPABILITY,
+			       "only a keyboard is available");
+}
+
+static const struct wl_seat_interface seat_impl = {
+    .get_pointer = seat_get_unsupported,
+    .get_keyboard = seat_get_keyboard,
+    .get_touch = seat_get_unsupported,
+    .release = destroy_resource,
+};
+
+static void bind_seat(struct wl_client *client, void *data, uint32_t version,
+		      uint32_t id) {
+	struct wl_resource *resource =
+	    wl_resource_create(client, &wl_seat_interface, version, id);
+	if (!resource) {
+		wl_client_post_no_memory(client);
+		return;
+	}
+	wl_resource_set_implementation(resource, &seat_impl, data, NULL);
+	wl_seat_send_capabilities(resource, WL_SEAT_CAPABILITY_KEYBOARD);
+	if (version >= 2) {
+		wl_seat_send_name(resource, "seat0");
+	}
+}
+
+static int create_keymap(struct server *server) {
+	struct xkb_rule_names names = {
+	    .rules = "evdev", .model = "pc105", .layout = "us"};
+	server->xkb_context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+	server->keymap = xkb_keymap_new_from_names(server->xkb_context, &names,
+						   XKB_KEYMAP_COMPILE_NO_FLAGS);
+	if (!server->keymap) {
+		return -1;
+	}
+	char *text =
+	    xkb_keymap_get_as_string(server->keymap, XKB_KEYMAP_FORMAT_TEXT_V1);
+	server->keymap_size = strlen(text) + 1;
+	server->keymap_fd = allocate_shm_file(server->keymap_size);
+	if (server->keymap_fd < 0) {
+		free(text);
+		return -1;
+	}
+	char *map = mmap(NULL, server->keymap_size, PROT_READ | PROT_WRITE,
+			 MAP_SHARED, server->keymap_fd, 0);
+	if (map == MAP_FAILED) {
+		free(text);
+		return -1;
+	}
+	memcpy(map, text, server->keymap_size);
+	munmap(map, server->keymap_size);
+	free(text);
+	return 0;
+}
+
+static xkb_keycode_t find_keycode(struct server *server, xkb_keysym_t sym) {
+	xkb_keycode_t min = xkb_keymap_min_keycode(server->keymap);
+	xkb_keycode_t max = xkb_keymap_max_keycode(server->keymap);
+	for (xkb_keycode_t code = min; code <= max; code++) {
+		const xkb_keysym_t *syms;
+		int count = xkb_keymap_key_get_syms_by_level(server->keymap,
+							     code, 0, 0, &syms);
+		for (int i = 0; i < count; i++) {
+			if (syms[i] == sym) {
+				return code;
+			}
+		}
+	}
+	return XKB_KEYCODE_INVALID;
+}
+
+static void send_key(struct server *server, xkb_keysym_t sym) {
+	xkb_keycode_t code = find_keycode(server, sym);
+	if (code == XKB_KEYCODE_INVALID) {
+		fprintf(stderr, "no key for keysym 0x%x\n", sym);
+		return;
+	}
+	server->key_ns = now_ns();
+	server->keys++;
+	if (sym == XKB_KEY_Return) {
+		server->returns++;
+	}
+	struct wl_resource *keyboard;
+	wl_resource_for_each(keyboard, &server->keyboards) {
+		uint32_t time = now_ms();
+		wl_keyboard_send_key(keyboard,
+				     wl_display_next_serial(server->display),
+				     time, code - 8,
+				     WL_KEYBOARD_KEY_STATE_PRESSED);
+		wl_keyboard_send_key(keyboard,
+				     wl_display_next_serial(server->display),
+				     time, code - 8,
+				     WL_KEYBOARD_KEY_STATE_RELEASED);
+	}
+}
+
+// ---- session lock ----
+
+static void lock_surface_ack_configure(struct wl_client *client,
+				       struct wl_resource *resource,
+				       uint32_t serial) {}
+
+static const struct ext_session_lock_surface_v1_interface lock_surface_impl = {
+    .destroy = destroy_resource,
+    .ack_configure = lock_surface_ack_configure,
+};
+
+static void lock_surface_destroy(struct wl_resource *resource) {
+	struct test_surface *surface = wl_resource_get_user_data(resource);
+	if (!surface) {
+		return;
+	}
+	if (surface->output) {
+		surface->output->lock_surface = NULL;
+		surface->output = NULL;
+	}
+	surface->lock_surface = NULL;
+}
+
+static void lock_get_lock_surface(struct wl_client *client,
+				  struct wl_resource *resource, uint32_t id,
+				  struct wl_resource *surface_resource,
+				  struct wl_resource *output_resource) {
+	struct test_surface *surface =
+	    wl_resource_get_user_data(surface_resource);
+	struct test_output *output = wl_resource_get_user_data(output_resource);
+	if (output->lock_surface) {
+		wl_resource_post_error(
+		    resource, EXT_SESSION_LOCK_V1_ERROR_DUPLICATE_OUTPUT,
+		    "output %d already has a lock surface", output->index);
+		return;
+	}
+	surface->lock_surface = wl_resource_create(
+	    client, &ext_session_lock_surface_v1_interface, 1, id);
+	if (!surface->lock_surface) {
+		wl_client_post_no_memory(client);
+		return;
+	}
+	wl_resource_set_implementation(surface->lock_surface,
+				       &lock_surface_impl, surface,
+				       lock_surface_destroy);
+	surface->output = output;
+	output->lock_surface = surface;
+	output->presented = false;
+	configure_lock_surface(output);
+}
+
+static void lock_unlock_and_destroy(struct wl_client *client,
+				    struct wl_resource *resource) {
+	struct server *server = wl_resource_get_user_data(resource);
+	server->unlocked = true;
+	server->unlock_ns = now_ns();
+	server->returns_at_unlock = server->returns;
+	wl_resource_destroy(resource);
+}
+
+static const struct ext_session_lock_v1_interface lock_impl = {
+    .destroy = destroy_resource,
+    .get_lock_surface = lock_get_lock_surface,
+    .unlock_and_destroy = lock_unlock_and_destroy,
+};
+
+static void lock_destroy(struct wl_resource *resource) {
+	struct server *server = wl_resource_get_user_data(resource);
+	if (server->lock == resource) {
+		server->lock = NULL;
+	}
+}
+
+static void maybe_send_locked(struct server *server) {
+	if (server->locked || !server->lock) {
+		return;
+	}
+	struct test_output *output;
+	wl_list_for_each(output, &server->outputs, link) {
+		if (!output->presented) {
+			return;
+		}
+	}
+	server->locked = true;
+	server->locked_ns = now_ns();
+	ext_session_lock_v1_send_locked(server->lock);
+
+	output = wl_container_of(server->outputs.next, output, link);
+	server->focus = output->lock_surface;
+	struct wl_resource *keyboard;
+	wl_resource_for_each(keyboard, &server->keyboards) {
+		send_enter(server, keyboard);
+	}
+	wl_event_source_timer_update(server->script_timer,
+				     server->script ? server->key_interval
+						    : server->settle);
+}
+
+static void manager_lock(struct wl_client *client, struct wl_resource *resource,
+			 uint32_t id) {
+	struct server *server = wl_resource_get_user_data(resource);
+	struct wl_resource *lock = wl_resource_create(
+	    client, &ext_session_lock_v1_interface, 1, id);
+	if (!lock) {
+		wl_client_post_no_memory(client);
+		return;
+	}
+	wl_resource_set_implementation(lock, &lock_impl, server, lock_destroy);
+	if (server->lock || server->locked) {
+		ext_session_lock_v1_send_finished(lock);
+		return;
+	}
+	server->lock = lock;
+	server->lock_request_ns = now_ns();
+}
+
+static const struct ext_session_lock_manager_v1_interface manager_impl = {
+    .destroy = destroy_resource,
+    .lock = manager_lock,
+};
+
+static void bind_manager(struct wl_client *client, void *data,
+			 uint32_t version, uint32_t id) {
+	struct wl_resource *resource = wl_resource_create(
+	    client, &ext_session_lock_manager_v1_interface, version, id);
+	if (!resource) {
+		wl_client_post_no_memory(client);
+		return;
+	}
+	wl_resource_set_implementation(resource, &manager_impl, data, NULL);
+}
+
+// ---- script ----
+
+static void reconfigure(struct server *server, int32_t width,
+			int32_t height) {
+	struct test_output *output;
+	wl_list_for_each(output, &server->outputs, link) {
+		output->width = width;
+		output->height = height;
+		struct wl_resource *resource;
+		wl_resource_for_each(resource, &output->resources) {
+			send_output_state(output, resource);
+		}
+		configure_lock_surface(output);
+	}
+}
+
+// Runs the next script step, returns the delay before the one after it.
+static uint32_t script_step(struct server *server) {
+	const char *s = server->script + server->script_pos;
+	if (*s != '<') {
+		server->script_pos++;
+		send_key(server, xkb_utf32_to_keysym((unsigned char)*s));
+		return server->key_interval;
+	}
+
+	const char *end = strchr(s, '>');
+	if (!end) {
+		fprintf(stderr, "unterminated token in key script\n");
+		server->script_pos += strlen(s);
+		return 0;
+	}
+	char token[64];
+	snprintf(token, sizeof(token), "%.*s", (int)(end - s - 1), s + 1);
+	server->script_pos += end - s + 1;
+
+	unsigned value, width, height;
+	if (sscanf(token, "sleep %u", &value) == 1) {
+		return value;
+	}
+	if (sscanf(token, "configure %ux%u", &width, &height) == 2) {
+		reconfigure(server, width, height);
+		return server->key_interval;
+	}
+	xkb_keysym_t sym =
+	    xkb_keysym_from_name(token, XKB_KEYSYM_CASE_INSENSITIVE);
+	if (sym == XKB_KEY_NoSymbol) {
+		fprintf(stderr, "unknown key <%s>\n", token);
+	} else {
+		send_key(server, sym);
+	}
+	return server->key_interval;
+}
+
+static int handle_script(void *data) {
+	struct server *server = data;
+	if (!server->script || !server->script[server->script_pos]) {
+		// done, give the locker a moment to finish up
+		if (server->child_running) {
+			kill(server->child, SIGTERM);
+		}
+		return 0;
+	}
+	// the locker binds the keyboard asynchronously
+	if (wl_list_empty(&server->keyboards)) {
+		wl_event_source_timer_update(server->script_timer, 10);
+		return 0;
+	}
+	uint32_t delay = script_step(server);
+	bool done = !server->script[server->script_pos];
+	wl_event_source_timer_update(server->script_timer,
+				     done ? server->settle
+					  : (delay ? delay : 1));
+	return 0;
+}
+
+static int handle_timeout(void *data) {
+	struct server *server = data;
+	fprintf(stderr, "timed out\n");
+	if (server->child_running) {
+		kill(server->child, SIGKILL);
+	} else {
+		wl_display_terminate(server->display);
+	}
+	return 0;
+}
+
+static int handle_sigchld(int signal, void *data) {
+	struct server *server = data;
+	if (waitpid(server->child, &server->child_status, WNOHANG) ==
+	    server->child) {
+		server->child_running = false;
+		wl_display_terminate(server->display);
+	}
+	return 0;
+}
+
+static int spawn(struct server *server, const char *socket, char **argv) {
+	server->spawn_ns = now_ns();
+	server->child = fork();
+	if (server->child < 0) {
+		perror("fork");
+		return -1;
+	}
+	if (server->child == 0) {
+		sigset_t mask;
+		sigemptyset(&mask);
+		sigprocmask(SIG_SETMASK, &mask, NULL);
+		setenv("WAYLAND_DISPLAY", socket, 1);
+		unsetenv("WAYLAND_SOCKET");
+		execvp(argv[0], argv);
+		perror(argv[0]);
+		_exit(127);
+	}
+	server->child_running = true;
+	return 0;
+}
+
+static int compare_samples(const void *a, const void *b) {
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+	return (x > y) - (x < y);
+}
+
+static void print_summary(struct server *server) {
+	uint32_t n = server->key_sample_count;
+	qsort(server->key_samples, n, sizeof(*server->key_samples),
+	      compare_samples);
+	double p50 = n ? server->key_samples[(n - 1) * 50 / 100] / 1000.0 : -1;
+	double p99 = n ? server->key_samples[(n - 1) * 99 / 100] / 1000.0 : -1;
+	double max = n ? server->key_samples[n - 1] / 1000.0 : -1;
+	int status = WIFEXITED(server->child_status)
+			 ? WEXITSTATUS(server->child_status)
+			 : -WTERMSIG(server->child_status);
+
+	printf("{\"lock_request_ms\":%.3f,\"time_to_lock_ms\":%.3f,"
+	       "\"unlock_ms\":%.3f,\"commits\":%u,\"full_frame_uploads\":%u,"
+	       "\"damaged_bytes\":%llu,\"keys\":%u,\"keys_with_commit\":%u,"
+	       "\"key_commit_p50_ms\":%.3f,\"key_commit_p99_ms\":%.3f,"
+	       "\"key_commit_max_ms\":%.3f,\"overlay_commits\":%u,"
+	       "\"locked_damage\":%llu,\"locked\":%s,\"unlocked\":%s,"
+	       "\"exit_status\":%d}\n",
+	       since_ms(server, server->lock_request_ns),
+	       since_ms(server, server->locked_ns),
+	       since_ms(server, server->unlock_ns), server->commits,
+	       server->full_uploads, (unsigned long long)server->damaged_bytes,
+	       server->keys, n, p50, p99, max, server->overlay_commits,
+	       (unsigned long long)server->locked_damage, server->locked ? "true" : "false",
+	       server->unlocked ? "true" : "false", status);
+}
+
+// Says what went wrong on stderr, returns the exit status of the run.
+static int verdict(struct server *server) {
+	if (!server->locked) {
+		fprintf(stderr, "FAIL: never locked, an output got no frame\n");
+		return 1;
+	}
+	if (server->expect_overlays && server->overlay_commits == 0) {
+		fprintf(stderr, "FAIL: no subsurface was committed\n");
+		return 1;
+	}
+	if (server->expect_overlays && server->locked_damage > 0) {
+		fprintf(stderr,
+			"FAIL: %llu bytes of lock surface damaged after "
+			"locking\n",
+			(unsigned long long)server->locked_damage);
+		return 1;
+	}
+	if (server->expect_unlock < 0) {
+		return 0;
+	}
+	if (!server->unlocked) {
+		fprintf(stderr, "FAIL: never unlocked\n");
+		return 1;
+	}
+	if (server->returns_at_unlock != (uint32_t)server->expect_unlock) {
+		fprintf(stderr, "FAIL: unlocked after Return %u, expected %d\n",
+			server->returns_at_unlock, server->expect_unlock);
+		return 1;
+	}
+	if (!WIFEXITED(server->child_status) ||
+	    WEXITSTATUS(server->child_status) != 0) {
+		fprintf(stderr, "FAIL: the locker did not exit cleanly\n");
+		return 1;
+	}
+	return 0;
+}
+
+static void usage(const char *name) {
+	fprintf(stderr,
+		"usage: %s [options] -- locker [locker options]\n"
+		"  --output WxH[@scale]  add an output, 1920x1080 by default\n"
+		"  --keys SCRIPT         keys to type once locked\n"
+		"  --key-interval MS     delay between keys (50)\n"
+		"  --settle MS           wait after the script (1000)\n"
+		"  --timeout MS          give up after this long (15000)\n"
+		"  --expect-unlock N     fail unless the N-th Return unlocks\n"
+		"  --expect-overlays     fail unless only subsurfaces change\n"
+		"                        once locked\n"
+		"  --dump DIR            write every committed buffer as PPM\n"
+		"  --verbose             print every commit\n",
+		name);
+}
+
+int main(int argc, char **argv) {
+	static const struct option long_options[] = {
+	    {"output", required_argument, NULL, 'o'},
+	    {"keys", required_argument, NULL, 'k'},
+	    {"key-interval", required_argument, NULL, 'i'},
+	    {"settle", required_argument, NULL, 's'},
+	    {"timeout", required_argument, NULL, 't'},
+	    {"expect-unlock", required_argument, NULL, 'u'},
+	    {"expect-overlays", no_argument, NULL, 'O'},
+	    {"dump", required_argument, NULL, 'd'},
+	    {"verbose", no_argument, NULL, 'v'},
+	    {"help", no_argument, NULL, 'h'},
+	    {0},
+	};
+
+	struct server server = {
+	    .key_interval = 50,
+	    .settle = 1000,
+	    .keymap_fd = -1,
+	    .expect_unlock = -1,
+	};
+	int32_t sizes[MAX_OUTPUTS][3];
+	int output_count = 0;
+	uint32_t timeout = 15000;
+
+	int opt;
+	while ((opt = getopt_long(argc, argv, "h", long_options, NULL)) != -1) {
+		switch (opt) {
+		case 'o':
+			if (output_count == MAX_OUTPUTS) {
+				fprintf(stderr, "too many outputs\n");
+				return 1;
+			}
+			sizes[output_count][2] = 1;
+			if (sscanf(optarg, "%dx%d@%d", &sizes[output_count][0],
+				   &sizes[output_count][1],
+				   &sizes[output_count][2]) < 2 ||
+			    sizes[output_count][2] < 1) {
+				fprintf(stderr, "bad output '%s'\n", optarg);
+				return 1;
+			}
+			output_count++;
+			break;
+		case 'k':
+			server.script = optarg;
+			break;
+		case 'i':
+			server.key_interval = strtoul(optarg, NULL, 10);
+			break;
+		case 's':
+			server.settle = strtoul(optarg, NULL, 10);
+			break;
+		case 't':
+			timeout = strtoul(optarg, NULL, 10);
+			break;
+		case 'u':
+			server.expect_unlock = atoi(optarg);
+			break;
+		case 'O':
+			server.expect_overlays = true;
+			break;
+		case 'd':
+			server.dump_dir = optarg;
+			break;
+		case 'v':
+			server.verbose = true;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (optind >= argc) {
+		usage(argv[0]);
+		return 1;
+	}
+	if (output_count == 0) {
+		sizes[0][0] = 1920;
+		sizes[0][1] = 1080;
+		sizes[0][2] = 1;
+		output_count = 1;
+	}
+
+	// CI runners often have no session, make a runtime dir of our own
+	char runtime_dir[] = "/tmp/test-compositor-XXXXXX";
+	if (!getenv("XDG_RUNTIME_DIR")) {
+		if (!mkdtemp(runtime_dir)) {
+			perror("mkdtemp");
+			return 1;
+		}
+		setenv("XDG_RUNTIME_DIR", runtime_dir, 1);
+	}
+
+	if (create_keymap(&server) != 0) {
+		fprintf(stderr, "failed to create a keymap\n");
+		return 1;
+	}
+
+	server.display = wl_display_create();
+	server.loop = wl_display_get_event_loop(server.display);
+	wl_list_init(&server.outputs);
+	wl_list_init(&server.keyboards);
+	wl_list_init(&server.frames);
+	const char *socket = wl_display_add_socket_auto(server.display);
+	if (!socket) {
+		fprintf(stderr, "failed to add a wayland socket\n");
+		return 1;
+	}
+
+	wl_display_init_shm(server.display);
+	wl_global_create(server.display, &wl_compositor_interface, 4, &server,
+			 bind_compositor);
+	wl_global_create(server.display, &wl_subcompositor_interface, 1,
+			 &server, bind_subcompositor);
+	wl_global_create(server.display, &wl_seat_interface, 7, &server,
+			 bind_seat);
+	wl_global_create(server.display, &ext_session_lock_manager_v1_interface,
+			 1, &server, bind_manager);
+	struct test_output outputs[MAX_OUTPUTS] = {0};
+	for (int i = 0; i < output_count; i++) {
+		struct test_output *output = &outputs[i];
+		output->server = &server;
+		output->index = i;
+		output->width = sizes[i][0];
+		output->height = sizes[i][1];
+		output->scale = sizes[i][2];
+		wl_list_init(&output->resources);
+		output->global = wl_global_create(
+		    server.display, &wl_output_interface, 4, output, bind_output);
+		wl_list_insert(server.outputs.prev, &output->link);
+	}
+
+	server.refresh_timer =
+	    wl_event_loop_add_timer(server.loop, handle_refresh, &server);
+	server.script_timer =
+	    wl_event_loop_add_timer(server.loop, handle_script, &server);
+	server.timeout_timer =
+	    wl_event_loop_add_timer(server.loop, handle_timeout, &server);
+	wl_event_source_timer_update(server.timeout_timer, timeout);
+	// blocks SIGCHLD for the signalfd, spawn() unblocks it in the child
+	wl_event_loop_add_signal(server.loop, SIGCHLD, handle_sigchld, &server);
+
+	if (spawn(&server, socket, argv + optind) != 0) {
+		return 1;
+	}
+	wl_display_run(server.display);
+
+	print_summary(&server);
+	int ret = verdict(&server);
+
+	wl_display_destroy_clients(server.display);
+	wl_display_destroy(server.display);
+	close(server.keymap_fd);
+	xkb_keymap_unref(server.keymap);
+	xkb_context_unref(server.xkb_context);
+	if (strcmp(runtime_dir, "/tmp/test-compositor-XXXXXX") != 0) {
+		rmdir(runtime_dir);
+	}
+	return ret;
+}